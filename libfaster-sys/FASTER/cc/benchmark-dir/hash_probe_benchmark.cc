@@ -0,0 +1,177 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "core/alloc.h"
+#include "core/hash_bucket.h"
+#include "core/key_hash.h"
+
+/// Compares the ways of searching a hash bucket chain for a tag: FASTER's original entry-by-entry
+/// loop, HashBucket::ProbeScalar(), and HashBucket::ProbeAvx2(), on tables loaded with 0.5 to 4
+/// keys per bucket, so that chains grow overflow buckets. Lookups of keys in the table stop at
+/// their entry; lookups of other keys walk the whole chain.
+
+using namespace FASTER::core;
+
+static constexpr uint64_t kNumBuckets = 1 << 20;
+static constexpr uint64_t kNumLookups = 1 << 23;
+/// Each method's best of this many runs is reported.
+static constexpr uint32_t kNumRuns = 3;
+static constexpr double kLoadFactors[] = { 0.5, 1.0, 2.0, 3.0, 4.0 };
+
+/// Main buckets, followed by overflow buckets. An overflow entry holds the index of the next
+/// bucket in the chain.
+class Table {
+ public:
+  Table(uint64_t num_keys, uint64_t num_buckets)
+    : mask_{ num_buckets - 1 }
+    , size_{ num_buckets } {
+    // A chain only grows a bucket once its last bucket is full.
+    uint64_t capacity = num_buckets + num_keys / HashBucket::kNumEntries + 1;
+    buckets_ = reinterpret_cast<HashBucket*>(FASTER::core::aligned_alloc(
+                 Constants::kCacheLineBytes, capacity * sizeof(HashBucket)));
+    std::memset(buckets_, 0, capacity * sizeof(HashBucket));
+  }
+  ~Table() {
+    aligned_free(buckets_);
+  }
+
+  void Insert(KeyHash hash) {
+    uint64_t idx = hash.idx(mask_ + 1);
+    while(true) {
+      HashBucket& bucket = buckets_[idx];
+      for(uint32_t entry_idx = 0; entry_idx < HashBucket::kNumEntries; ++entry_idx) {
+        if(bucket.entries[entry_idx].load().unused()) {
+          bucket.entries[entry_idx].store(HashBucketEntry{ Address{ 64 }, hash.tag(), false });
+          return;
+        }
+      }
+      HashBucketOverflowEntry overflow_entry = bucket.overflow_entry.load();
+      if(overflow_entry.unused()) {
+        bucket.overflow_entry.store(HashBucketOverflowEntry{ FixedPageAddress{ size_ } });
+        idx = size_++;
+      } else {
+        idx = overflow_entry.address().control();
+      }
+    }
+  }
+
+  /// Searches the chain for "hash", with "probe" returning the bucket's matches.
+  template <class P>
+  inline bool Find(KeyHash hash, P probe) const {
+    const HashBucket* bucket = &buckets_[hash.idx(mask_ + 1)];
+    while(true) {
+      if(probe(*bucket, hash.tag()) != 0) {
+        return true;
+      }
+      HashBucketOverflowEntry overflow_entry = bucket->overflow_entry.load();
+      if(overflow_entry.unused()) {
+        return false;
+      }
+      bucket = &buckets_[overflow_entry.address().control()];
+    }
+  }
+
+  uint64_t num_overflow_buckets() const {
+    return size_ - (mask_ + 1);
+  }
+
+ private:
+  uint64_t mask_;
+  uint64_t size_;
+  HashBucket* buckets_;
+};
+
+/// Nanoseconds per lookup.
+template <class P>
+double run(const Table& table, const std::vector<KeyHash>& lookups, P probe, uint64_t& found) {
+  double best = 0;
+  for(uint32_t run = 0; run < kNumRuns; ++run) {
+    found = 0;
+    auto start_time = std::chrono::high_resolution_clock::now();
+    for(KeyHash hash : lookups) {
+      found += table.Find(hash, probe);
+    }
+    std::chrono::nanoseconds duration = std::chrono::high_resolution_clock::now() - start_time;
+    double ns = (double)duration.count() / lookups.size();
+    best = run == 0 ? ns : std::min(best, ns);
+  }
+  return best;
+}
+
+int main(int argc, char* argv[]) {
+  auto loop_probe = [](const HashBucket& bucket, uint16_t tag) -> uint32_t {
+    for(uint32_t entry_idx = 0; entry_idx < HashBucket::kNumEntries; ++entry_idx) {
+      HashBucketEntry entry = bucket.entries[entry_idx].load();
+      if(entry.unused()) {
+        continue;
+      }
+      if(tag == entry.tag() && !entry.tentative()) {
+        return 1;
+      }
+    }
+    return 0;
+  };
+  auto scalar_probe = [](const HashBucket& bucket, uint16_t tag) {
+    uint32_t matches, free;
+    bucket.ProbeScalar(tag, matches, free);
+    return matches;
+  };
+#ifdef FASTER_SIMD_PROBE
+  bool simd = SimdProbeSupported();
+  auto simd_probe = [](const HashBucket& bucket, uint16_t tag) {
+    uint32_t matches, free;
+    bucket.ProbeAvx2(tag, matches, free);
+    return matches;
+  };
+#else
+  bool simd = false;
+#endif
+
+  printf("%8s %10s %6s %12s %12s %12s\n", "keys/bkt", "overflow", "hits", "loop ns",
+         "scalar ns", "avx2 ns");
+  for(double load_factor : kLoadFactors) {
+    uint64_t num_keys = static_cast<uint64_t>(load_factor * kNumBuckets);
+    std::mt19937_64 rng{ 42 };
+    std::vector<KeyHash> keys(num_keys);
+    Table table{ num_keys, kNumBuckets };
+    for(KeyHash& hash : keys) {
+      hash = KeyHash{ rng() };
+      table.Insert(hash);
+    }
+
+    for(bool hits : { true, false }) {
+      std::vector<KeyHash> lookups(kNumLookups);
+      std::uniform_int_distribution<uint64_t> distribution{ 0, num_keys - 1 };
+      for(KeyHash& hash : lookups) {
+        hash = hits ? keys[distribution(rng)] : KeyHash{ rng() };
+      }
+
+      uint64_t found_loop, found_scalar, found_simd = 0;
+      double loop_ns = run(table, lookups, loop_probe, found_loop);
+      double scalar_ns = run(table, lookups, scalar_probe, found_scalar);
+      double simd_ns = 0;
+#ifdef FASTER_SIMD_PROBE
+      if(simd) {
+        simd_ns = run(table, lookups, simd_probe, found_simd);
+      }
+#endif
+      if(found_scalar != found_loop || (simd && found_simd != found_loop)) {
+        printf("Probes disagree: %" PRIu64 " / %" PRIu64 " / %" PRIu64 " found\n", found_loop,
+               found_scalar, found_simd);
+        return 1;
+      }
+      printf("%8.1f %10" PRIu64 " %6s %12.1f %12.1f %12.1f\n", load_factor,
+             table.num_overflow_buckets(), hits ? "yes" : "no", loop_ns, scalar_ns, simd_ns);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../../../faster_c.h"
+
+/// Compares per-key mlkv_read() against mlkv_read_batch(), on a single thread, for batch sizes
+/// from 128 to 16K keys.
+
+static constexpr uint64_t kNanosPerSecond = 1000000000;
+
+static constexpr uint64_t kNumKeys = 1 << 22;
+static constexpr uint64_t kValueLength = 64;
+static constexpr uint64_t kMinBatchSize = 128;
+static constexpr uint64_t kMaxBatchSize = 16384;
+static constexpr uint64_t kOpsPerRun = 1 << 22;
+
+static_assert(kOpsPerRun % kMaxBatchSize == 0, "kOpsPerRun % kMaxBatchSize != 0");
+
+void setup_store(faster_t* store) {
+  std::vector<uint8_t> value(kValueLength, 42);
+  for(uint64_t key = 0; key < kNumKeys; ++key) {
+    faster_upsert(store, key, value.data(), kValueLength);
+  }
+  faster_complete_pending(store, true);
+  printf("Finished populating store: contains %" PRIu64 " elements.\n", kNumKeys);
+}
+
+double run_single(faster_t* store, const std::vector<uint64_t>& keys) {
+  std::vector<uint8_t> output(kValueLength);
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for(uint64_t key : keys) {
+    mlkv_read(store, key, output.data(), kValueLength);
+  }
+  faster_complete_pending(store, true);
+  std::chrono::nanoseconds duration = std::chrono::high_resolution_clock::now() - start_time;
+  return (double)keys.size() / ((double)duration.count() / kNanosPerSecond);
+}
+
+double run_batch(faster_t* store, const std::vector<uint64_t>& keys, uint64_t batch_size) {
+  std::vector<uint8_t> output(batch_size * kValueLength);
+  std::vector<uint8_t> statuses(batch_size);
+  auto start_time = std::chrono::high_resolution_clock::now();
+  for(uint64_t idx = 0; idx < keys.size(); idx += batch_size) {
+    mlkv_read_batch(store, &keys[idx], batch_size, output.data(), kValueLength, statuses.data());
+  }
+  std::chrono::nanoseconds duration = std::chrono::high_resolution_clock::now() - start_time;
+  return (double)keys.size() / ((double)duration.count() / kNanosPerSecond);
+}
+
+int main(int argc, char* argv[]) {
+  std::string storage = argc > 1 ? argv[1] : "storage";
+  // Hash table with kNumKeys / 2 buckets, and a 4 GB log that holds the whole table in memory.
+  faster_t* store = faster_open(kNumKeys / 2, 4294967296, storage.c_str());
+  faster_start_session(store);
+
+  printf("Populating the store...\n");
+  setup_store(store);
+
+  std::mt19937_64 rng{ 42 };
+  std::uniform_int_distribution<uint64_t> distribution{ 0, kNumKeys - 1 };
+  std::vector<uint64_t> keys(kOpsPerRun);
+  for(uint64_t& key : keys) {
+    key = distribution(rng);
+  }
+
+  printf("%10s %16s %16s %8s\n", "batch", "single ops/s", "batch ops/s", "speedup");
+  for(uint64_t batch_size = kMinBatchSize; batch_size <= kMaxBatchSize; batch_size *= 2) {
+    double single = run_single(store, keys);
+    double batch = run_batch(store, keys, batch_size);
+    printf("%10" PRIu64 " %16.0f %16.0f %8.2f\n", batch_size, single, batch, batch / single);
+  }
+
+  faster_stop_session(store);
+  faster_destroy(store);
+  return 0;
+}
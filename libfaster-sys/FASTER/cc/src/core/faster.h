@@ -12,6 +12,7 @@
 #include <cstdio>
 #include <cstring>
 #include <type_traits>
+#include <vector>
 #include <algorithm>
 
 #include "device/file_system_disk.h"
@@ -20,14 +21,17 @@
 #include "checkpoint_locks.h"
 #include "checkpoint_state.h"
 #include "constants.h"
+#include "frequency_sketch.h"
 #include "gc_state.h"
 #include "grow_state.h"
 #include "guid.h"
 #include "hash_table.h"
 #include "internal_contexts.h"
+#include "io_queue_controller.h"
 #include "key_hash.h"
 #include "malloc_fixed_page_size.h"
 #include "persistent_memory_malloc.h"
+#include "read_cache.h"
 #include "record.h"
 #include "recovery_status.h"
 #include "state_transitions.h"
@@ -104,7 +108,14 @@ class FasterKv {
     , disk{ filename, epoch_, config }
     , hlog{ filename.empty() /*hasNoBackingStorage*/, log_size, epoch_, disk, disk.log(), log_mutable_fraction, pre_allocate_log }
     , system_state_{ Action::None, Phase::REST, 1 }
-    , num_pending_ios{ 0 } {
+    , io_size_hint_{ 0 }
+    , dense_index_{ false }
+    , read_cache_{ epoch_ }
+    , promote_threshold_{ 0 }
+    , promote_cursor_{ Address::kInvalidAddress }
+    , read_only_promotions_{ 0 }
+    , disk_promotions_{ 0 }
+    , cold_records_{ 0 } {
     if(!Utility::IsPowerOfTwo(table_size)) {
       throw std::invalid_argument{ " Size is not a power of 2" };
     }
@@ -112,6 +123,9 @@ class FasterKv {
       throw std::invalid_argument{ " Cannot allocate such a large hash table " };
     }
 
+    // The disk counts the reads it submits against the queue's limit.
+    disk.SetIoQueue(&io_queue_);
+
     resize_info_.version = 0;
     state_[0].Initialize(table_size, disk.log().alignment());
     overflow_buckets_allocator_[0].Initialize(disk.log().alignment(), epoch_);
@@ -126,6 +140,13 @@ class FasterKv {
   uint64_t ContinueSession(const Guid& guid);
   void StopSession();
   void Refresh();
+  /// For a thread that waits for another thread from inside an operation (e.g., in a context's
+  /// GetAtomic() or RmwAtomic()), holding a pointer "ptr" into a record: lets page flushes and
+  /// head shifts go on meanwhile, without the phase changes that Refresh() may make. Returns
+  /// false, without refreshing, if the record is no longer in the mutable region. Otherwise it
+  /// refreshes, and returns whether the record is still mutable: only then does the record stay
+  /// in memory until the next call (it must first be flushed, and that waits for this thread).
+  bool RefreshWhileWaiting(const void* ptr);
 
   /// Store interface
   template <class RC>
@@ -142,6 +163,57 @@ class FasterKv {
 
   inline bool CompletePending(bool wait = false);
 
+  /// Software prefetch, for batched operations: pull the key's hash bucket, or the record at the
+  /// head of its hash chain, into cache ahead of a Read() or Rmw() on the same key. Must be
+  /// called from inside a session.
+  inline void PrefetchBucket(KeyHash hash) const;
+  inline void PrefetchRecord(KeyHash hash) const;
+
+  /// Expected size of a value_t (header included), for stores whose values all have about the
+  /// same size. The first read of a record from disk then fetches the whole record, instead of
+  /// the header, then the key, then the value; larger records still fall back to follow-up reads.
+  /// 0 (the default) disables the hint.
+  void SetValueSizeHint(uint32_t value_size);
+
+  /// Dense-index mode, for keys that are small dense integer IDs (e.g., embedding-table rows):
+  /// the key's hash must be its ID, in [0, DenseCapacity()), and each ID owns one fixed entry of
+  /// the hash table, so lookups need no tag compare or overflow-bucket walk. The index cannot grow
+  /// in this mode. Must be called before the first session starts, and before Recover().
+  void SetDenseIndex();
+  inline uint64_t DenseCapacity() const {
+    return state_[resize_info_.version].size() * HashBucket::kNumEntries;
+  }
+
+  /// Read cache, for hot records that have been evicted to disk: records read from disk are kept
+  /// in a separate, size-bounded in-memory log of "size" bytes (see ReadCache), so later reads and
+  /// RMWs of them need no I/O, while the hybrid log is neither polluted nor flushed. Hits in the
+  /// oldest "second_chance_fraction" of the cache copy the record back to its tail. Must be called
+  /// before the first session starts.
+  void SetReadCache(uint64_t size, double second_chance_fraction = 0.1);
+  inline ReadCacheStats GetReadCacheStats() const {
+    return read_cache_.Stats();
+  }
+
+  /// Frequency-based promotion, so that records read often but written rarely are not lost to
+  /// the FIFO order of the log: Read()s count their keys in a count-min sketch with
+  /// "sketch_width" counters per row (see FrequencySketch). A record read from disk is copied to
+  /// the tail of the log once its key's count reaches "threshold"; PromoteHotRecords() does the
+  /// same for records in the read-only region. With a read cache, a record read from disk is
+  /// admitted to it only if its key has been read before, so one-hit wonders take no space. Must
+  /// be called before the first session starts.
+  void SetPromotion(uint64_t sketch_width, uint32_t threshold);
+  /// Maintenance pass, from inside a session: scans up to "max_bytes" of the read-only region,
+  /// from where the last pass stopped, and copies each record that is the latest for its key and
+  /// whose key is hot to the tail of the log. Returns the number of records promoted.
+  uint64_t PromoteHotRecords(uint64_t max_bytes);
+  PromotionStats GetPromotionStats() const;
+
+  /// Reads from disk are throttled by an adaptive limit on how many may be in flight (see
+  /// IoQueueController).
+  inline IoQueueStats GetIoQueueStats() const {
+    return io_queue_.Stats();
+  }
+
   /// Checkpoint/recovery operations.
   bool Checkpoint(void(*index_persistence_callback)(Status result),
                   void(*hybrid_log_persistence_callback)(Status result,
@@ -173,6 +245,7 @@ class FasterKv {
 
  private:
   typedef Record<key_t, value_t> record_t;
+  typedef typename ReadCache<record_t>::EntryHeader read_cache_entry_t;
 
   typedef PendingContext<key_t> pending_context_t;
 
@@ -198,6 +271,8 @@ class FasterKv {
   // Find the hash bucket entry, if any, corresponding to the specified hash.
   // The caller can use the "expected_entry" to CAS its desired address into the entry.
   inline const AtomicHashBucketEntry* FindEntry(KeyHash hash, HashBucketEntry& expected_entry) const;
+  /// Dense-index mode: the entry owned by the key ID.
+  inline const AtomicHashBucketEntry* DenseEntry(KeyHash hash) const;
   // If a hash bucket entry corresponding to the specified hash exists, return it; otherwise,
   // create a new entry. The caller can use the "expected_entry" to CAS its desired address into
   // the entry.
@@ -207,6 +282,17 @@ class FasterKv {
                                       Address min_offset) const;
   inline Address TraceBackForKeyMatch(const key_t& key, Address from_address,
                                       Address min_offset) const;
+  // Follows the on-disk part of a hash chain, from "address", through the read cache. Returns the
+  // cache entry whose record has a matching key, if any; otherwise, "address" is where the chain
+  // leaves the cache.
+  template<class C>
+  inline const read_cache_entry_t* TraceBackForKeyMatchReadCache(const C& ctxt,
+      Address& address) const;
+  // Copies "record", the latest record for its key, to the tail of the log, if the key's hash
+  // bucket entry is still "expected_entry". "record" must not be in the log, since allocating
+  // the copy can close the record's page.
+  inline bool PromoteRecord(const record_t* record, KeyHash hash,
+                            AtomicHashBucketEntry* atomic_entry, HashBucketEntry expected_entry);
   Address TraceBackForOtherChainStart(uint64_t old_size,  uint64_t new_size, Address from_address,
                                       Address min_address, uint8_t side);
 
@@ -228,8 +314,11 @@ class FasterKv {
   inline Status RetryLater(ExecutionContext& ctx, pending_context_t& pending_context,
                            bool& async);
   inline constexpr uint32_t MinIoRequestSize() const;
+  inline uint32_t FirstIoRequestSize() const;
   inline Status IssueAsyncIoRequest(ExecutionContext& ctx, pending_context_t& pending_context,
                                     bool& async);
+  /// Waits while the disk has too many reads in flight (see IoQueueController).
+  void ThrottleReads();
 
   void AsyncGetFromDisk(Address address, uint32_t num_records, AsyncIOCallback callback,
                         AsyncIOContext& context);
@@ -320,8 +409,26 @@ class FasterKv {
   /// Grow (hash table) state.
   GrowState grow_;
 
-  /// Global count of pending I/Os, used for throttling.
-  std::atomic<uint64_t> num_pending_ios;
+  /// Pending reads, and throttling of new ones.
+  IoQueueController io_queue_;
+
+  /// Size of the first read issued for a record on disk, if larger than MinIoRequestSize().
+  std::atomic<uint32_t> io_size_hint_;
+
+  /// Set by SetDenseIndex().
+  bool dense_index_;
+
+  /// Enabled by SetReadCache(). (Reads count hits and give entries second chances.)
+  mutable ReadCache<record_t> read_cache_;
+
+  /// Enabled by SetPromotion(). (Reads count their keys.)
+  mutable FrequencySketch sketch_;
+  uint32_t promote_threshold_;
+  /// Where the next PromoteHotRecords() pass starts.
+  AtomicAddress promote_cursor_;
+  std::atomic<uint64_t> read_only_promotions_;
+  std::atomic<uint64_t> disk_promotions_;
+  std::atomic<uint64_t> cold_records_;
 
   /// Space for two contexts per thread, stored inline.
   ThreadContext thread_contexts_[Thread::kMaxNumThreads];
@@ -357,6 +464,7 @@ inline uint64_t FasterKv<K, V, D>::ContinueSession(const Guid& session_id) {
 
 template <class K, class V, class D>
 inline void FasterKv<K, V, D>::Refresh() {
+  disk.Submit();
   epoch_.ProtectAndDrain();
   // We check if we are in normal mode
   SystemState new_state = system_state_.load();
@@ -366,6 +474,17 @@ inline void FasterKv<K, V, D>::Refresh() {
   HandleSpecialPhases();
 }
 
+template <class K, class V, class D>
+inline bool FasterKv<K, V, D>::RefreshWhileWaiting(const void* ptr) {
+  Address address = hlog.AddressOf(ptr);
+  if(address == Address::kInvalidAddress || address < hlog.read_only_address.load()) {
+    return false;
+  }
+  disk.Submit();
+  epoch_.ProtectAndDrain();
+  return address >= hlog.read_only_address.load();
+}
+
 template <class K, class V, class D>
 inline void FasterKv<K, V, D>::StopSession() {
   // If this thread is still involved in some activity, wait until it finishes.
@@ -392,6 +511,11 @@ inline void FasterKv<K, V, D>::StopSession() {
 template <class K, class V, class D>
 inline const AtomicHashBucketEntry* FasterKv<K, V, D>::FindEntry(KeyHash hash,
     HashBucketEntry& expected_entry) const {
+  if(dense_index_) {
+    const AtomicHashBucketEntry* atomic_entry = DenseEntry(hash);
+    expected_entry = atomic_entry->load();
+    return expected_entry.unused() ? nullptr : atomic_entry;
+  }
   expected_entry = HashBucketEntry::kInvalidEntry;
   // Truncate the hash to get a bucket page_index < state[version].size.
   uint32_t version = resize_info_.version;
@@ -401,19 +525,16 @@ inline const AtomicHashBucketEntry* FasterKv<K, V, D>::FindEntry(KeyHash hash,
   while(true) {
     // Search through the bucket looking for our key. Last entry is reserved
     // for the overflow pointer.
-    for(uint32_t entry_idx = 0; entry_idx < HashBucket::kNumEntries; ++entry_idx) {
+    uint32_t matches, free;
+    bucket->Probe(hash.tag(), matches, free);
+    for(; matches != 0; matches &= matches - 1) {
+      uint32_t entry_idx = HashBucket::FirstEntry(matches);
       HashBucketEntry entry = bucket->entries[entry_idx].load();
-      if(entry.unused()) {
-        continue;
-      }
-      if(hash.tag() == entry.tag()) {
-        // Found a matching tag. (So, the input hash matches the entry on 14 tag bits +
-        // log_2(table size) address bits.)
-        if(!entry.tentative()) {
-          // If (final key, return immediately)
-          expected_entry = entry;
-          return &bucket->entries[entry_idx];
-        }
+      if(entry.matches(hash.tag())) {
+        // Found a final entry with a matching tag. (So, the input hash matches the entry on 14
+        // tag bits + log_2(table size) address bits.)
+        expected_entry = entry;
+        return &bucket->entries[entry_idx];
       }
     }
 
@@ -440,16 +561,16 @@ inline AtomicHashBucketEntry* FasterKv<K, V, D>::FindTentativeEntry(KeyHash hash
   while(true) {
     // Search through the bucket looking for our key. Last entry is reserved
     // for the overflow pointer.
-    for(uint32_t entry_idx = 0; entry_idx < HashBucket::kNumEntries; ++entry_idx) {
+    uint32_t matches, free;
+    bucket->Probe(hash.tag(), matches, free);
+    if(free != 0 && !atomic_entry) {
+      // Found a free slot; keep track of it, and continue looking for a match.
+      atomic_entry = &bucket->entries[HashBucket::FirstEntry(free)];
+    }
+    for(; matches != 0; matches &= matches - 1) {
+      uint32_t entry_idx = HashBucket::FirstEntry(matches);
       HashBucketEntry entry = bucket->entries[entry_idx].load();
-      if(entry.unused()) {
-        if(!atomic_entry) {
-          // Found a free slot; keep track of it, and continue looking for a match.
-          atomic_entry = &bucket->entries[entry_idx];
-        }
-        continue;
-      }
-      if(hash.tag() == entry.tag() && !entry.tentative()) {
+      if(entry.matches(hash.tag())) {
         // Found a match. (So, the input hash matches the entry on 14 tag bits +
         // log_2(table size) address bits.) Return it to caller.
         expected_entry = entry;
@@ -520,6 +641,12 @@ bool FasterKv<K, V, D>::HasConflictingEntry(KeyHash hash, const HashBucket* buck
 template <class K, class V, class D>
 inline AtomicHashBucketEntry* FasterKv<K, V, D>::FindOrCreateEntry(KeyHash hash,
     HashBucketEntry& expected_entry) {
+  if(dense_index_) {
+    // The key owns its entry; an unused entry is installed by the caller's CAS.
+    AtomicHashBucketEntry* atomic_entry = const_cast<AtomicHashBucketEntry*>(DenseEntry(hash));
+    expected_entry = atomic_entry->load();
+    return atomic_entry;
+  }
   // Truncate the hash to get a bucket page_index < state[version].size.
   const uint32_t version = resize_info_.version;
   assert(version <= 1);
@@ -686,6 +813,38 @@ inline bool FasterKv<K, V, D>::CompletePending(bool wait) {
   return false;
 }
 
+template <class K, class V, class D>
+inline const AtomicHashBucketEntry* FasterKv<K, V, D>::DenseEntry(KeyHash hash) const {
+  uint64_t id = hash.control();
+  assert(id < DenseCapacity());
+  return &state_[resize_info_.version].bucket(id / HashBucket::kNumEntries)
+         .entries[id % HashBucket::kNumEntries];
+}
+
+template <class K, class V, class D>
+inline void FasterKv<K, V, D>::PrefetchBucket(KeyHash hash) const {
+  if(dense_index_) {
+    Utility::Prefetch(DenseEntry(hash));
+    return;
+  }
+  const HashBucket* bucket = &state_[resize_info_.version].bucket(hash);
+  Utility::Prefetch(bucket);
+}
+
+template <class K, class V, class D>
+inline void FasterKv<K, V, D>::PrefetchRecord(KeyHash hash) const {
+  HashBucketEntry entry;
+  const AtomicHashBucketEntry* atomic_entry = FindEntry(hash, entry);
+  if(!atomic_entry) {
+    return;
+  }
+  Address address = entry.address();
+  if(address >= hlog.head_address.load()) {
+    // Only the head of the chain: the record header, key and value header share its first line.
+    Utility::Prefetch(hlog.Get(address));
+  }
+}
+
 template <class K, class V, class D>
 inline void FasterKv<K, V, D>::CompleteIoPendingRequests(ExecutionContext& context) {
   AsyncIOContext* ctxt;
@@ -771,6 +930,9 @@ inline OperationStatus FasterKv<K, V, D>::InternalRead(C& pending_context) const
   }
 
   KeyHash hash = pending_context.get_key_hash();
+  if(sketch_.enabled()) {
+    sketch_.Increment(hash);
+  }
   HashBucketEntry entry;
   const AtomicHashBucketEntry* atomic_entry = FindEntry(hash, entry);
   if(!atomic_entry) {
@@ -815,7 +977,7 @@ inline OperationStatus FasterKv<K, V, D>::InternalRead(C& pending_context) const
     if (reinterpret_cast<const record_t*>(hlog.Get(address))->header.tombstone) {
       return OperationStatus::NOT_FOUND;
     }
-    pending_context.GetAtomic(hlog.Get(address));
+    pending_context.GetAtomic(hlog.Get(address), address);
     return OperationStatus::SUCCESS;
   } else if(address >= head_address) {
     // Immutable region
@@ -823,9 +985,22 @@ inline OperationStatus FasterKv<K, V, D>::InternalRead(C& pending_context) const
     if (reinterpret_cast<const record_t*>(hlog.Get(address))->header.tombstone) {
       return OperationStatus::NOT_FOUND;
     }
-    pending_context.Get(hlog.Get(address));
+    pending_context.Get(hlog.Get(address), address);
     return OperationStatus::SUCCESS;
   } else if(address >= begin_address) {
+    if(read_cache_.enabled()) {
+      const read_cache_entry_t* cached = TraceBackForKeyMatchReadCache(pending_context, address);
+      if(cached) {
+        const record_t* record = cached->record();
+        if(record->header.tombstone) {
+          return OperationStatus::NOT_FOUND;
+        }
+        pending_context.Get(record, Address::kInvalidAddress);
+        return OperationStatus::SUCCESS;
+      } else if(address < begin_address) {
+        return OperationStatus::NOT_FOUND;
+      }
+    }
     // Record not available in-memory
     pending_context.go_async(thread_ctx().phase, thread_ctx().version, address, entry);
     return OperationStatus::RECORD_ON_DISK;
@@ -950,6 +1125,10 @@ inline OperationStatus FasterKv<K, V, D>::InternalUpsert(C& pending_context) {
 
   // Create a record and attempt RCU.
 create_record:
+  if(hlog.Exhausted()) {
+    // An in-memory log that cannot grow without dropping live records.
+    return OperationStatus::OUT_OF_MEMORY;
+  }
   uint32_t record_size = record_t::size(pending_context.key_size(), pending_context.value_size());
   Address new_address = BlockAllocate(record_size);
   record_t* record = reinterpret_cast<record_t*>(hlog.Get(new_address));
@@ -996,6 +1175,9 @@ inline OperationStatus FasterKv<K, V, D>::InternalRmw(C& pending_context, bool r
   Address read_only_address = hlog.read_only_address.load();
   Address safe_read_only_address = hlog.safe_read_only_address.load();
   uint64_t latest_record_version = 0;
+  // The old record, if it is on disk but in the read cache.
+  const record_t* cached_record = nullptr;
+  uint64_t cached_offset = 0;
 
   if(address >= head_address) {
     // Multiple keys may share the same hash. Try to find the most recent record with a matching
@@ -1111,6 +1293,16 @@ inline OperationStatus FasterKv<K, V, D>::InternalRmw(C& pending_context, bool r
   } else if(address >= head_address) {
     goto create_record;
   } else if(address >= begin_address) {
+    if(read_cache_.enabled()) {
+      const read_cache_entry_t* cached = TraceBackForKeyMatchReadCache(pending_context, address);
+      if(cached) {
+        cached_record = cached->record();
+        cached_offset = read_cache_.OffsetOf(cached);
+        goto create_record;
+      } else if(address < begin_address) {
+        goto create_record;
+      }
+    }
     // Need to obtain old record from disk.
     if(!retrying) {
       pending_context.go_async(phase, version, address, expected_entry);
@@ -1128,9 +1320,19 @@ create_record:
   const record_t* old_record = nullptr;
   if(address >= head_address) {
     old_record = reinterpret_cast<const record_t*>(hlog.Get(address));
-    if(old_record->header.tombstone) {
-      old_record = nullptr;
-    }
+  } else if(cached_record) {
+    old_record = cached_record;
+  }
+  if(old_record != nullptr && old_record->header.tombstone) {
+    old_record = nullptr;
+  }
+  if((old_record == nullptr || address < hlog.begin_address.load()) &&
+     !pending_context.RmwInitialAllowed()) {
+    // The context does not create missing records.
+    return OperationStatus::NOT_FOUND;
+  }
+  if(hlog.Exhausted()) {
+    return OperationStatus::OUT_OF_MEMORY;
   }
   uint32_t record_size = old_record != nullptr ?
     record_t::size(pending_context.key_size(), pending_context.value_size(old_record)) :
@@ -1157,11 +1359,12 @@ create_record:
 
   if(old_record == nullptr || address < hlog.begin_address.load()) {
     pending_context.RmwInitial(new_record);
-  } else if(address >= head_address) {
+  } else if(address >= head_address ||
+            (cached_record != nullptr && read_cache_.Contains(cached_offset))) {
     pending_context.RmwCopy(old_record, new_record);
   } else {
     // The block we allocated for the new record caused the head address to advance beyond
-    // the old record. Need to obtain the old record from disk.
+    // the old record (or the read cache to evict it). Need to obtain the old record from disk.
     new_record->header.invalid = true;
     if(!retrying) {
       pending_context.go_async(phase, version, address, expected_entry);
@@ -1192,6 +1395,9 @@ inline OperationStatus FasterKv<K, V, D>::InternalRetryPendingRmw(
   OperationStatus status = InternalRmw(pending_context, true);
   if(status == OperationStatus::SUCCESS && pending_context.version != thread_ctx().version) {
     status = OperationStatus::SUCCESS_UNMARK;
+  } else if(status == OperationStatus::NOT_FOUND &&
+            pending_context.version != thread_ctx().version) {
+    status = OperationStatus::NOT_FOUND_UNMARK;
   }
   return status;
 }
@@ -1296,6 +1502,10 @@ inline OperationStatus FasterKv<K, V, D>::InternalDelete(C& pending_context) {
   }
 
 create_record:
+  if(hlog.Exhausted()) {
+    // An in-memory log that cannot grow without dropping live records.
+    return OperationStatus::OUT_OF_MEMORY;
+  }
   uint32_t record_size = record_t::size(pending_context.key_size(), pending_context.value_size());
   Address new_address = BlockAllocate(record_size);
   record_t* record = reinterpret_cast<record_t*>(hlog.Get(new_address));
@@ -1349,6 +1559,29 @@ inline Address FasterKv<K, V, D>::TraceBackForKeyMatch(const key_t& key, Address
   return from_address;
 }
 
+template <class K, class V, class D>
+template<class C>
+inline const typename FasterKv<K, V, D>::read_cache_entry_t*
+FasterKv<K, V, D>::TraceBackForKeyMatchReadCache(const C& ctxt, Address& address) const {
+  Address begin_address = hlog.begin_address.load();
+  while(address >= begin_address) {
+    const read_cache_entry_t* at_address;
+    const read_cache_entry_t* entry = read_cache_.Find(address, [&ctxt](const record_t* record) {
+      return ctxt.is_key_equal(record->key());
+    }, at_address);
+    if(entry) {
+      read_cache_.Touch(entry);
+      return entry;
+    }
+    if(!at_address) {
+      // Records of other keys that are not cached might hold this key.
+      return nullptr;
+    }
+    address = at_address->record()->header.previous_address();
+  }
+  return nullptr;
+}
+
 template <class K, class V, class D>
 inline Status FasterKv<K, V, D>::HandleOperationStatus(ExecutionContext& ctx,
     pending_context_t& pending_context, OperationStatus internal_status, bool& async) {
@@ -1411,11 +1644,15 @@ inline Status FasterKv<K, V, D>::HandleOperationStatus(ExecutionContext& ctx,
   case OperationStatus::SUCCESS_UNMARK:
     checkpoint_locks_.get_lock(pending_context.get_key_hash()).unlock_old();
     return Status::Ok;
+  case OperationStatus::NOT_FOUND:
+    return Status::NotFound;
   case OperationStatus::NOT_FOUND_UNMARK:
     checkpoint_locks_.get_lock(pending_context.get_key_hash()).unlock_old();
     return Status::NotFound;
   case OperationStatus::CPR_SHIFT_DETECTED:
     return PivotAndRetry(ctx, pending_context, async);
+  case OperationStatus::OUT_OF_MEMORY:
+    return Status::OutOfMemory;
   }
   // not reached
   assert(false);
@@ -1459,16 +1696,136 @@ inline constexpr uint32_t FasterKv<K, V, D>::MinIoRequestSize() const {
                alignof(value_t)));
 }
 
+template <class K, class V, class D>
+inline uint32_t FasterKv<K, V, D>::FirstIoRequestSize() const {
+  return std::max(MinIoRequestSize(), io_size_hint_.load(std::memory_order_relaxed));
+}
+
+template <class K, class V, class D>
+void FasterKv<K, V, D>::SetValueSizeHint(uint32_t value_size) {
+  io_size_hint_.store(value_size == 0 ? 0 : record_t::size(sizeof(key_t), value_size));
+}
+
+template <class K, class V, class D>
+void FasterKv<K, V, D>::SetDenseIndex() {
+  dense_index_ = true;
+}
+
+template <class K, class V, class D>
+void FasterKv<K, V, D>::SetReadCache(uint64_t size, double second_chance_fraction) {
+  read_cache_.Initialize(size, second_chance_fraction);
+}
+
+template <class K, class V, class D>
+void FasterKv<K, V, D>::SetPromotion(uint64_t sketch_width, uint32_t threshold) {
+  if(threshold < 2) {
+    throw std::invalid_argument{ "Promotion threshold must be at least 2" };
+  }
+  sketch_.Initialize(sketch_width);
+  promote_threshold_ = threshold;
+}
+
+template <class K, class V, class D>
+PromotionStats FasterKv<K, V, D>::GetPromotionStats() const {
+  return PromotionStats{ read_only_promotions_.load(), disk_promotions_.load(),
+                         cold_records_.load(),
+                         sketch_.enabled() ? sketch_.Stats() : FrequencySketchStats{} };
+}
+
+template <class K, class V, class D>
+inline bool FasterKv<K, V, D>::PromoteRecord(const record_t* record, KeyHash hash,
+    AtomicHashBucketEntry* atomic_entry, HashBucketEntry expected_entry) {
+  Address new_address = BlockAllocate(record->size());
+  record_t* new_record = reinterpret_cast<record_t*>(hlog.Get(new_address));
+  std::memcpy(static_cast<void*>(new_record), record, record->disk_size());
+  new(new_record) record_t{
+    RecordInfo{
+      static_cast<uint16_t>(thread_ctx().version), true, false, false,
+      expected_entry.address() }
+  };
+  // Allocating a block may have the side effect of moving this thread into a checkpoint.
+  if(thread_ctx().phase != Phase::REST) {
+    new_record->header.invalid = true;
+    return false;
+  }
+
+  HashBucketEntry updated_entry{ new_address, hash.tag(), false };
+  if(atomic_entry->compare_exchange_strong(expected_entry, updated_entry)) {
+    return true;
+  } else {
+    // A newer record was added to the chain.
+    new_record->header.invalid = true;
+    return false;
+  }
+}
+
+template <class K, class V, class D>
+uint64_t FasterKv<K, V, D>::PromoteHotRecords(uint64_t max_bytes) {
+  if(!sketch_.enabled() || thread_ctx().phase != Phase::REST) {
+    return 0;
+  }
+  Address address = std::max(promote_cursor_.load(), hlog.head_address.load());
+  Address end = hlog.safe_read_only_address.load();
+  if(end > address && end.control() - address.control() > max_bytes) {
+    end = address + max_bytes;
+  }
+  uint64_t promoted = 0;
+  std::vector<uint8_t> copy;
+  while(address < end) {
+    Address head_address = hlog.head_address.load();
+    if(address < head_address) {
+      // Promoting records advanced the head address.
+      address = head_address;
+      continue;
+    }
+    const record_t* record = reinterpret_cast<const record_t*>(hlog.Get(address));
+    if(record->header.IsNull()) {
+      // The rest of the page is empty.
+      address = Address{ address.page() + 1, 0 };
+      continue;
+    }
+    Address next_address = address + record->size();
+    if(!record->header.invalid && !record->header.tombstone) {
+      KeyHash hash = record->key().GetHash();
+      if(sketch_.Estimate(hash) < promote_threshold_) {
+        ++cold_records_;
+      } else {
+        HashBucketEntry entry;
+        AtomicHashBucketEntry* atomic_entry = const_cast<AtomicHashBucketEntry*>(
+            FindEntry(hash, entry));
+        if(atomic_entry && entry.address() >= head_address) {
+          // Promote the record only if no newer record holds its key.
+          Address latest_address = TraceBackForKeyMatch(record->key(), entry.address(),
+                                                        address);
+          if(latest_address == address) {
+            copy.assign(reinterpret_cast<const uint8_t*>(record),
+                        reinterpret_cast<const uint8_t*>(record) + record->disk_size());
+            if(PromoteRecord(reinterpret_cast<const record_t*>(copy.data()), hash, atomic_entry,
+                             entry)) {
+              ++read_only_promotions_;
+              ++promoted;
+            }
+          }
+        }
+      }
+    }
+    address = next_address;
+  }
+  promote_cursor_.store(address);
+  return promoted;
+}
+
 template <class K, class V, class D>
 inline Status FasterKv<K, V, D>::IssueAsyncIoRequest(ExecutionContext& ctx,
     pending_context_t& pending_context, bool& async) {
+  ThrottleReads();
   // Issue asynchronous I/O request
   uint64_t io_id = thread_ctx().io_id++;
   thread_ctx().pending_ios.insert({ io_id, pending_context.get_key_hash() });
   async = true;
   AsyncIOContext io_request{ this, pending_context.address, &pending_context,
                              &thread_ctx().io_responses, io_id };
-  AsyncGetFromDisk(pending_context.address, MinIoRequestSize(), AsyncGetFromDiskCallback,
+  AsyncGetFromDisk(pending_context.address, FirstIoRequestSize(), AsyncGetFromDiskCallback,
                    io_request);
   return Status::Pending;
 }
@@ -1491,17 +1848,26 @@ inline Address FasterKv<K, V, D>::BlockAllocate(uint32_t record_size) {
 }
 
 template <class K, class V, class D>
-void FasterKv<K, V, D>::AsyncGetFromDisk(Address address, uint32_t num_records,
-    AsyncIOCallback callback, AsyncIOContext& context) {
-  if(epoch_.IsProtected()) {
-    /// Throttling. (Thread pool, unprotected threads are not throttled.)
-    while(num_pending_ios.load() > 120) {
-      disk.TryComplete();
-      std::this_thread::yield();
+void FasterKv<K, V, D>::ThrottleReads() {
+  if(epoch_.IsProtected() && io_queue_.Full()) {
+    /// Throttling. (Thread pool, unprotected threads are not throttled.) The thread reaps
+    /// completions itself, and parks while none are ready. Only new reads are throttled: the
+    /// completion callbacks that reaping runs issue the follow-up reads of a record without
+    /// waiting, since a callback that waited here could wait on itself.
+    uint64_t start = io_queue_.Throttled();
+    while(io_queue_.Full()) {
+      if(!disk.TryComplete()) {
+        io_queue_.Wait();
+      }
       epoch_.ProtectAndDrain();
     }
+    io_queue_.Resumed(start);
   }
-  ++num_pending_ios;
+}
+
+template <class K, class V, class D>
+void FasterKv<K, V, D>::AsyncGetFromDisk(Address address, uint32_t num_records,
+    AsyncIOCallback callback, AsyncIOContext& context) {
   hlog.AsyncGetFromDisk(address, num_records, callback, context);
 }
 
@@ -1513,8 +1879,6 @@ void FasterKv<K, V, D>::AsyncGetFromDiskCallback(IAsyncContext* ctxt, Status res
   /// Context stack is: AsyncIOContext, PendingContext.
   pending_context_t* pending_context = static_cast<pending_context_t*>(context->caller_context);
 
-  /// This I/O is finished.
-  --faster->num_pending_ios;
   /// Always "goes async": context is freed by the issuing thread, when processing thread I/O
   /// responses.
   context.async = true;
@@ -1546,7 +1910,7 @@ void FasterKv<K, V, D>::AsyncGetFromDiskCallback(IAsyncContext* ctxt, Status res
       //keys are not same. I/O is not complete
       context->address = record->header.previous_address();
       if(context->address >= faster->hlog.begin_address.load()) {
-        faster->AsyncGetFromDisk(context->address, faster->MinIoRequestSize(),
+        faster->AsyncGetFromDisk(context->address, faster->FirstIoRequestSize(),
                                  AsyncGetFromDiskCallback, *context.get());
         context.async = true;
       } else {
@@ -1564,11 +1928,34 @@ OperationStatus FasterKv<K, V, D>::InternalContinuePendingRead(ExecutionContext&
     async_pending_read_context_t* pending_context = static_cast<async_pending_read_context_t*>(
           io_context.caller_context);
     record_t* record = reinterpret_cast<record_t*>(io_context.record.GetValidPointer());
+    bool promoted = false;
+    uint32_t estimate = sketch_.enabled() ? sketch_.Estimate(pending_context->get_key_hash()) : 0;
+    if(sketch_.enabled() && !record->header.tombstone) {
+      if(estimate < promote_threshold_) {
+        ++cold_records_;
+      } else if(thread_ctx().phase == Phase::REST) {
+        // A hot record read during a checkpoint is left where it is, but not counted as cold.
+        KeyHash hash = pending_context->get_key_hash();
+        HashBucketEntry entry;
+        AtomicHashBucketEntry* atomic_entry = const_cast<AtomicHashBucketEntry*>(
+            FindEntry(hash, entry));
+        promoted = atomic_entry &&
+                   PromoteRecord(record, hash, atomic_entry, pending_context->entry);
+        if(promoted) {
+          ++disk_promotions_;
+        }
+      }
+    }
+    // Unless the key has not been read before (a one-hit wonder, as far as the sketch can tell).
+    if(read_cache_.enabled() && !promoted && (!sketch_.enabled() || estimate >= 2)) {
+      read_cache_.Admit(pending_context->address, io_context.address, record,
+                        record->disk_size());
+    }
     if(record->header.tombstone) {
       return (thread_ctx().version > context.version) ? OperationStatus::NOT_FOUND_UNMARK :
              OperationStatus::NOT_FOUND;
     }
-    pending_context->Get(record);
+    pending_context->Get(record, Address::kInvalidAddress);
     assert(!kCopyReadsToTail);
     return (thread_ctx().version > context.version) ? OperationStatus::SUCCESS_UNMARK :
            OperationStatus::SUCCESS;
@@ -1618,6 +2005,15 @@ OperationStatus FasterKv<K, V, D>::InternalContinuePendingRmw(ExecutionContext&
   }
   assert(address < hlog.begin_address.load() || address == pending_context->entry.address());
 
+  if((io_context.address < hlog.begin_address.load() ||
+      reinterpret_cast<const record_t*>(io_context.record.GetValidPointer())->header.tombstone) &&
+     !pending_context->RmwInitialAllowed()) {
+    // The context does not create missing records.
+    assert(thread_ctx().version >= context.version);
+    return (thread_ctx().version == context.version) ? OperationStatus::NOT_FOUND :
+           OperationStatus::NOT_FOUND_UNMARK;
+  }
+
   // We have to do copy-on-write/RCU and write the updated value to the tail of the log.
   Address new_address;
   record_t* new_record;
@@ -2824,6 +3220,8 @@ Status FasterKv<K, V, D>::Recover(const Guid& index_token, const Guid& hybrid_lo
     return Status::Aborted;
   }
   checkpoint_.InitializeRecover(index_token, hybrid_log_token);
+  // The recovered log may reuse the addresses of records that were not checkpointed.
+  read_cache_.Clear();
   Status status;
 #define BREAK_NOT_OK(s) \
     status = (s); \
@@ -2890,6 +3288,10 @@ bool FasterKv<K, V, D>::ShiftBeginAddress(Address address,
 
 template <class K, class V, class D>
 bool FasterKv<K, V, D>::GrowIndex(GrowState::callback_t caller_callback) {
+  if(dense_index_) {
+    // Each key ID owns a fixed entry; its position would change with the table size.
+    return false;
+  }
   SystemState expected = SystemState{ Action::None, Phase::REST, system_state_.load().version };
   if(!system_state_.compare_exchange_strong(expected,
       SystemState{ Action::GrowIndex, Phase::REST, expected.version })) {
@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "alloc.h"
+#include "constants.h"
+#include "key_hash.h"
+#include "thread.h"
+#include "utility.h"
+
+namespace FASTER {
+namespace core {
+
+/// Statistics of a FrequencySketch.
+struct FrequencySketchStats {
+  /// Reads counted since the counters were last halved.
+  uint64_t additions;
+  /// Times the counters were halved.
+  uint64_t resets;
+  /// Keys whose exact read counts are tracked, to measure the sketch's accuracy.
+  uint64_t sampled_keys;
+  /// Mean amount by which the sketch overestimated the read counts of the sampled keys.
+  double mean_overestimate;
+};
+
+/// Statistics of frequency-based promotion, as reported by FasterKv::GetPromotionStats().
+struct PromotionStats {
+  /// Hot records copied from the read-only region to the tail, by FasterKv::PromoteHotRecords().
+  uint64_t read_only_promotions;
+  /// Hot records copied to the tail after being read from disk.
+  uint64_t disk_promotions;
+  /// Records read from disk, or scanned in the read-only region, that were not hot enough.
+  uint64_t cold_records;
+  FrequencySketchStats sketch;
+};
+
+/// Count-min sketch of how often each key hash is read, for telling hot records from one-hit
+/// wonders. Each of kDepth rows of 8-bit counters is indexed by a different hash of the key;
+/// an increment raises only the smallest of the key's counters (conservative update), and the
+/// estimate is the smallest. After 10 reads per counter, every counter is halved, so the sketch
+/// follows a changing working set (as in TinyLFU).
+///
+/// Counters are updated with relaxed loads and stores, not read-modify-writes: a racing
+/// increment may be lost, which only makes the sketch a little less eager. Each thread counts its
+/// reads locally, and adds them to the shared count once per kAdditionBatch reads, so that a read
+/// writes no cache line that every thread writes; the counters may be halved a little late.
+class FrequencySketch {
+ public:
+  static constexpr uint32_t kDepth = 4;
+  static constexpr uint8_t kMaxCount = UINT8_MAX;
+  /// The counters are halved after this many reads per counter (of a row).
+  static constexpr uint64_t kResetMultiplier = 10;
+  /// Exact counts are kept for 1 of every kSampleRate key hashes, up to kMaxSampledKeys of them.
+  static constexpr uint64_t kSampleRate = 256;
+  static constexpr uint64_t kMaxSampledKeys = 4096;
+  static constexpr uint32_t kAdditionBatch = 64;
+
+  FrequencySketch()
+    : width_{ 0 }
+    , counters_{ nullptr }
+    , reset_threshold_{ 0 }
+    , additions_{ 0 }
+    , resets_{ 0 } {
+  }
+
+  ~FrequencySketch() {
+    Uninitialize();
+  }
+
+  /// Allocates "width" (a power of 2) counters per row. Must be called before any thread uses
+  /// the sketch.
+  void Initialize(uint64_t width) {
+    if(!Utility::IsPowerOfTwo(width)) {
+      throw std::invalid_argument{ "Sketch width must be a power of 2" };
+    }
+    Uninitialize();
+    width_ = width;
+    counters_ = reinterpret_cast<std::atomic<uint8_t>*>(aligned_alloc(
+                  Constants::kCacheLineBytes, kDepth * width));
+    std::memset(static_cast<void*>(counters_), 0, kDepth * width);
+    reset_threshold_ = kResetMultiplier * width;
+    additions_.store(0);
+    for(auto& local : local_additions_) {
+      local.count.store(0);
+    }
+  }
+
+  void Uninitialize() {
+    if(counters_) {
+      aligned_free(counters_);
+      counters_ = nullptr;
+    }
+    width_ = 0;
+  }
+
+  inline bool enabled() const {
+    return width_ > 0;
+  }
+
+  inline void Increment(KeyHash hash) {
+    uint64_t indexes[kDepth];
+    uint8_t count = Estimate(hash, indexes);
+    if(count == kMaxCount) {
+      return;
+    }
+    for(uint32_t row = 0; row < kDepth; ++row) {
+      std::atomic<uint8_t>& counter = counters_[indexes[row]];
+      if(counter.load(std::memory_order_relaxed) == count) {
+        counter.store(count + 1, std::memory_order_relaxed);
+      }
+    }
+    if(Sampled(hash)) {
+      std::lock_guard<std::mutex> lock{ samples_mutex_ };
+      auto sample = samples_.find(hash.control());
+      if(sample != samples_.end()) {
+        ++sample->second;
+      } else if(samples_.size() < kMaxSampledKeys) {
+        samples_.emplace(hash.control(), 1);
+      }
+    }
+    std::atomic<uint32_t>& local = local_additions_[Thread::id()].count;
+    uint32_t reads = local.load(std::memory_order_relaxed) + 1;
+    if(reads < kAdditionBatch) {
+      local.store(reads, std::memory_order_relaxed);
+      return;
+    }
+    local.store(0, std::memory_order_relaxed);
+    uint64_t additions = additions_.fetch_add(kAdditionBatch, std::memory_order_relaxed);
+    if(additions < reset_threshold_ && additions + kAdditionBatch >= reset_threshold_) {
+      Reset();
+    }
+  }
+
+  inline uint32_t Estimate(KeyHash hash) const {
+    uint64_t indexes[kDepth];
+    return Estimate(hash, indexes);
+  }
+
+  FrequencySketchStats Stats() const {
+    std::lock_guard<std::mutex> lock{ samples_mutex_ };
+    double overestimate = 0;
+    for(const auto& sample : samples_) {
+      overestimate += static_cast<double>(Estimate(KeyHash{ sample.first })) -
+                      std::min<uint32_t>(sample.second, kMaxCount);
+    }
+    uint64_t additions = additions_.load();
+    for(const auto& local : local_additions_) {
+      additions += local.count.load(std::memory_order_relaxed);
+    }
+    return FrequencySketchStats{ additions, resets_.load(), samples_.size(),
+                                 samples_.empty() ? 0 : overestimate / samples_.size() };
+  }
+
+ private:
+  inline uint8_t Estimate(KeyHash hash, uint64_t* indexes) const {
+    // Double hashing: the row's index is (h1 + row * h2) mod width.
+    uint64_t h1 = hash.control();
+    uint64_t h2 = Mix(h1) | 1;
+    uint8_t count = kMaxCount;
+    for(uint32_t row = 0; row < kDepth; ++row) {
+      indexes[row] = row * width_ + ((h1 + row * h2) & (width_ - 1));
+      count = std::min(count, counters_[indexes[row]].load(std::memory_order_relaxed));
+    }
+    return count;
+  }
+
+  inline bool Sampled(KeyHash hash) const {
+    // The top bits, which do not feed the counters' indexes.
+    return (Mix(hash.control()) >> 56) % kSampleRate == 0;
+  }
+
+  /// Rehashes a key hash (SplitMix64's finalizer), since the low bits of the key hash may be all
+  /// that were mixed well.
+  static inline uint64_t Mix(uint64_t h) {
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    return h ^ (h >> 31);
+  }
+
+  /// Halves every counter, and every sampled exact count.
+  void Reset() {
+    for(uint64_t idx = 0; idx < kDepth * width_; ++idx) {
+      counters_[idx].store(counters_[idx].load(std::memory_order_relaxed) / 2,
+                           std::memory_order_relaxed);
+    }
+    {
+      std::lock_guard<std::mutex> lock{ samples_mutex_ };
+      for(auto& sample : samples_) {
+        sample.second /= 2;
+      }
+    }
+    ++resets_;
+    additions_.fetch_sub(reset_threshold_ / 2);
+  }
+
+  uint64_t width_;
+  std::atomic<uint8_t>* counters_;
+  uint64_t reset_threshold_;
+  std::atomic<uint64_t> additions_;
+  std::atomic<uint64_t> resets_;
+
+  /// Each thread's reads not yet added to additions_.
+  struct alignas(Constants::kCacheLineBytes) LocalAdditions {
+    std::atomic<uint32_t> count{ 0 };
+  };
+  LocalAdditions local_additions_[Thread::kMaxNumThreads];
+
+  mutable std::mutex samples_mutex_;
+  std::unordered_map<uint64_t, uint32_t> samples_;
+};
+
+}
+} // namespace FASTER::core
@@ -12,6 +12,15 @@
 #include "constants.h"
 #include "malloc_fixed_page_size.h"
 
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+/// HashBucket::Probe() has an AVX2 path, taken on CPUs that support it.
+#define FASTER_SIMD_PROBE
+#endif
+
 namespace FASTER {
 namespace core {
 
@@ -64,6 +73,13 @@ struct HashBucketEntry {
     tentative_ = desired;
   }
 
+  /// Whether a lookup for "tag" stops at this entry: it is in use, holds the tag, and is final.
+  inline bool matches(uint16_t tag) const {
+    return !unused() && tag_ == tag && !tentative_;
+  }
+  /// The bits that matches() compares: the tag and the tentative bit.
+  static constexpr uint64_t kTagTentativeMask = 0xbfff000000000000ull;
+
   union {
       struct {
         uint64_t address_ : 48; // corresponds to logical address
@@ -184,11 +200,91 @@ class AtomicHashBucketOverflowEntry {
   std::atomic<uint64_t> control_;
 };
 
+#ifdef FASTER_SIMD_PROBE
+inline bool SimdProbeSupported() {
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+}
+#endif
+
 /// A bucket consisting of 7 hash bucket entries, plus one hash bucket overflow entry. Fits in
 /// a cache line.
 struct alignas(Constants::kCacheLineBytes) HashBucket {
   /// Number of entries per bucket (excluding overflow entry).
   static constexpr uint32_t kNumEntries = 7;
+
+  /// Examines the entries: sets bit i of "matches" if entries[i].matches(tag), and bit i of
+  /// "free" if entries[i] is unused. A chain holds at most one final entry per tag, so a probe
+  /// may stop at a match, leaving later entries out of both masks. The masks are a snapshot, so
+  /// a caller re-loads an entry before acting on it.
+  inline void Probe(uint16_t tag, uint32_t& matches, uint32_t& free) const {
+#ifdef FASTER_SIMD_PROBE
+    if(SimdProbeSupported()) {
+      ProbeAvx2(tag, matches, free);
+      return;
+    }
+#endif
+    ProbeScalar(tag, matches, free);
+  }
+
+  /// Index of the lowest entry in a non-empty Probe() mask.
+  static inline uint32_t FirstEntry(uint32_t mask) {
+    assert(mask != 0);
+#ifdef _WIN32
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<uint32_t>(index);
+#else
+    return static_cast<uint32_t>(__builtin_ctz(mask));
+#endif
+  }
+
+  inline void ProbeScalar(uint16_t tag, uint32_t& matches, uint32_t& free) const {
+    matches = 0;
+    free = 0;
+    for(uint32_t entry_idx = 0; entry_idx < kNumEntries; ++entry_idx) {
+      HashBucketEntry entry = entries[entry_idx].load();
+      if(entry.unused()) {
+        free |= 1u << entry_idx;
+      } else if(entry.matches(tag)) {
+        matches = 1u << entry_idx;
+        return;
+      }
+    }
+  }
+
+#ifdef FASTER_SIMD_PROBE
+  /// Compares four entries at a time, with no branch per entry; stops after the first four if
+  /// they hold a match.
+  __attribute__((target("avx2")))
+  inline void ProbeAvx2(uint16_t tag, uint32_t& matches, uint32_t& free) const {
+    const __m256i* halves = reinterpret_cast<const __m256i*>(this);
+    const __m256i mask = _mm256_set1_epi64x(
+                           static_cast<int64_t>(HashBucketEntry::kTagTentativeMask));
+    const __m256i target = _mm256_set1_epi64x(static_cast<int64_t>(uint64_t{ tag } << 48));
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i line = _mm256_load_si256(halves);
+    __m256i unused = _mm256_cmpeq_epi64(line, zero);
+    __m256i tagged = _mm256_cmpeq_epi64(_mm256_and_si256(line, mask), target);
+    matches = static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(
+                                      _mm256_andnot_si256(unused, tagged))));
+    free = static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(unused)));
+    if(matches != 0) {
+      return;
+    }
+    // The second half ends with the overflow entry, whose bit is dropped.
+    line = _mm256_load_si256(halves + 1);
+    unused = _mm256_cmpeq_epi64(line, zero);
+    tagged = _mm256_cmpeq_epi64(_mm256_and_si256(line, mask), target);
+    constexpr uint32_t kEntriesMask = (1u << kNumEntries) - 1;
+    matches = (static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(
+                                       _mm256_andnot_si256(unused, tagged)))) << 4) & kEntriesMask;
+    free |= (static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(unused))) << 4) &
+            kEntriesMask;
+  }
+#endif
+
   /// The entries.
   AtomicHashBucketEntry entries[kNumEntries];
   /// Overflow entry points to next overflow bucket, if any.
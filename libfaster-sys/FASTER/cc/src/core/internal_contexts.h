@@ -40,7 +40,8 @@ enum class OperationStatus : uint8_t {
   RECORD_ON_DISK,
   SUCCESS_UNMARK,
   NOT_FOUND_UNMARK,
-  CPR_SHIFT_DETECTED
+  CPR_SHIFT_DETECTED,
+  OUT_OF_MEMORY
 };
 
 /// Internal FASTER context.
@@ -139,6 +140,32 @@ struct write_deep_key_at_helper<false>
   }
 };
 
+// A helper class to tell a Read() context where the record it reads lives. A Read() context may
+// define Get(const value_t&, Address) and GetAtomic(const value_t&, Address), which get the
+// record's log address if the record is in the log's memory, else Address::kInvalidAddress (e.g.,
+// for a record read from disk, or from the read cache). Contexts without them get just the value.
+struct read_get_helper
+{
+  template<class C, class V>
+  static inline auto Get(C& context, const V& value, Address address, int)
+  -> decltype(context.Get(value, address)) {
+    return context.Get(value, address);
+  }
+  template<class C, class V>
+  static inline void Get(C& context, const V& value, Address address, long) {
+    context.Get(value);
+  }
+  template<class C, class V>
+  static inline auto GetAtomic(C& context, const V& value, Address address, int)
+  -> decltype(context.GetAtomic(value, address)) {
+    return context.GetAtomic(value, address);
+  }
+  template<class C, class V>
+  static inline void GetAtomic(C& context, const V& value, Address address, long) {
+    context.GetAtomic(value);
+  }
+};
+
 /// FASTER's internal Read() context.
 
 /// An internal Read() context that has gone async and lost its type information.
@@ -155,8 +182,9 @@ class AsyncPendingReadContext : public PendingContext<K> {
     : PendingContext<key_t>(other, caller_context) {
   }
  public:
-  virtual void Get(const void* rec) = 0;
-  virtual void GetAtomic(const void* rec) = 0;
+  /// "address" is the record's address, if it is in the log's memory; else invalid.
+  virtual void Get(const void* rec, Address address) = 0;
+  virtual void GetAtomic(const void* rec, Address address) = 0;
 };
 
 /// A synchronous Read() context preserves its type information.
@@ -206,13 +234,13 @@ class PendingReadContext : public AsyncPendingReadContext<typename RC::key_t> {
   inline bool is_key_equal(const key_t& other) const final {
     return read_context().key() == other;
   }
-  inline void Get(const void* rec) final {
+  inline void Get(const void* rec, Address address) final {
     const record_t* record = reinterpret_cast<const record_t*>(rec);
-    read_context().Get(record->value());
+    read_get_helper::Get(read_context(), record->value(), address, 0);
   }
-  inline void GetAtomic(const void* rec) final {
+  inline void GetAtomic(const void* rec, Address address) final {
     const record_t* record = reinterpret_cast<const record_t*>(rec);
-    read_context().GetAtomic(record->value());
+    read_get_helper::GetAtomic(read_context(), record->value(), address, 0);
   }
 };
 
@@ -298,6 +326,22 @@ class PendingUpsertContext : public AsyncPendingUpsertContext<typename UC::key_t
   }
 };
 
+// A helper class to ask an Rmw() context whether it creates missing records. An Rmw() context may
+// define "bool RmwInitialAllowed() const"; returning false makes Rmw() of a missing key (or one
+// whose latest record is a tombstone) return Status::NotFound instead of calling RmwInitial().
+// Contexts without it always create the record.
+struct rmw_initial_allowed_helper
+{
+  template<class C>
+  static inline auto execute(const C& context, int) -> decltype(context.RmwInitialAllowed()) {
+    return context.RmwInitialAllowed();
+  }
+  template<class C>
+  static inline bool execute(const C& context, long) {
+    return true;
+  }
+};
+
 /// FASTER's internal Rmw() context.
 /// An internal Rmw() context that has gone async and lost its type information.
 template <class K>
@@ -313,6 +357,8 @@ class AsyncPendingRmwContext : public PendingContext<K> {
     : PendingContext<key_t>(other, caller_context) {
   }
  public:
+  /// Whether a missing record may be created, with an initial value.
+  virtual bool RmwInitialAllowed() const = 0;
   /// Set initial value.
   virtual void RmwInitial(void* rec) = 0;
   /// RCU.
@@ -372,6 +418,10 @@ class PendingRmwContext : public AsyncPendingRmwContext<typename MC::key_t> {
   inline bool is_key_equal(const key_t& other) const final {
     return rmw_context().key() == other;
   }
+  /// Whether a missing record may be created, with an initial value.
+  inline bool RmwInitialAllowed() const final {
+    return rmw_initial_allowed_helper::execute(rmw_context(), 0);
+  }
   /// Set initial value.
   inline void RmwInitial(void* rec) final {
     record_t* record = reinterpret_cast<record_t*>(rec);
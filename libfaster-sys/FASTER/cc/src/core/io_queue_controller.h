@@ -0,0 +1,240 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+#include "thread.h"
+
+namespace FASTER {
+namespace core {
+
+/// Statistics of an IoQueueController, as reported by FasterKv::GetIoQueueStats().
+struct IoQueueStats {
+  /// Number of reads that may be in flight before issuing threads wait.
+  uint32_t depth;
+  /// Reads in flight.
+  uint64_t pending;
+  /// Mean completion latency of the reads of the last window, and the lowest window mean seen
+  /// recently (the device's latency when no queue builds up).
+  double latency_us;
+  double min_latency_us;
+  /// Reads completed per second, over the last window.
+  double iops;
+  /// Times a thread waited before issuing a read, and how long it waited in all.
+  uint64_t throttled;
+  uint64_t throttled_ns;
+};
+
+/// Limits the number of reads in flight, adapting the limit to the device: additive increase,
+/// multiplicative decrease, driven by completion latency. Once per kWindow completions, the
+/// mean latency of the window is compared with the lowest seen recently: well above it, reads
+/// are queueing in the device and adding nothing to its throughput, so the limit drops by a
+/// quarter; otherwise, if threads ran into the limit during the window, it grows by kIncrease.
+/// A fast NVMe device thus settles at a deep queue, and a device whose latency spikes at a
+/// shallow one.
+///
+/// A thread that finds the queue full reaps completions itself, and otherwise parks until a
+/// completion (on any thread) makes room, or for about half a read's latency, after which it
+/// reaps again. (It cannot park for longer: it may be the only thread reaping.)
+///
+/// The disk's I/O handler counts reads as it submits them to the device, rather than as they are
+/// issued, so that reads a handler holds back to submit in a batch neither count against the
+/// limit nor add to the latency. Since a batch is submitted whole, the limit never drops below a
+/// batch for each thread that submitted reads during the last window (see SetSubmitBatch()).
+class IoQueueController {
+ public:
+  static constexpr uint32_t kMinDepth = 8;
+  static constexpr uint32_t kMaxDepth = 1024;
+  /// The fixed limit this controller replaced.
+  static constexpr uint32_t kInitialDepth = 120;
+  static constexpr uint32_t kIncrease = 8;
+  /// The limit is adjusted once per this many completions.
+  static constexpr uint64_t kWindow = 256;
+  /// A window mean this many times the lowest one means the device is congested.
+  static constexpr double kCongestion = 2.0;
+  /// The lowest window mean creeps up by 1/kMinLatencyDrift per window, so that it follows a
+  /// device that got slower for good.
+  static constexpr uint64_t kMinLatencyDrift = 1024;
+  /// Bounds on how long a thread parks before it reaps again.
+  static constexpr uint64_t kMinParkNs = 10000;
+  static constexpr uint64_t kMaxParkNs = 1000000;
+
+  IoQueueController()
+    : depth_{ kInitialDepth }
+    , pending_{ 0 }
+    , saturated_{ false }
+    , window_count_{ 0 }
+    , window_latency_ns_{ 0 }
+    , window_start_ns_{ NowNs() }
+    , cooldown_{ false }
+    , latency_ns_{ 0 }
+    , min_latency_ns_{ 0 }
+    , iops_{ 0 }
+    , throttled_{ 0 }
+    , throttled_ns_{ 0 }
+    , waiters_{ 0 }
+    , submit_batch_{ 1 } {
+    for(auto& word : active_threads_) {
+      word.store(0);
+    }
+  }
+
+  inline bool Full() const {
+    return pending_.load() > depth_.load(std::memory_order_relaxed);
+  }
+
+  /// Called as "count" reads are submitted to the device. Returns their issue time, to be passed
+  /// to Complete().
+  inline uint64_t Issue(uint32_t count = 1) {
+    pending_ += count;
+    uint32_t id = Thread::id();
+    std::atomic<uint64_t>& word = active_threads_[id / 64];
+    uint64_t bit = uint64_t{ 1 } << (id % 64);
+    if((word.load(std::memory_order_relaxed) & bit) == 0) {
+      word.fetch_or(bit, std::memory_order_relaxed);
+    }
+    return NowNs();
+  }
+
+  /// Called for "count" reads passed to Issue() that the device did not take after all.
+  inline void Cancel(uint32_t count) {
+    pending_ -= count;
+  }
+
+  /// Called by an I/O handler that submits up to "reads" reads per thread at once.
+  inline void SetSubmitBatch(uint32_t reads) {
+    submit_batch_.store(reads);
+  }
+
+  /// Called as a read issued at "issue_ns" completes.
+  inline void Complete(uint64_t issue_ns) {
+    uint64_t now = NowNs();
+    --pending_;
+    window_latency_ns_.fetch_add(now - issue_ns, std::memory_order_relaxed);
+    if(window_count_.fetch_add(1, std::memory_order_relaxed) + 1 == kWindow) {
+      Adjust(now);
+    }
+    if(waiters_.load() > 0 && !Full()) {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      room_.notify_all();
+    }
+  }
+
+  /// Called when a thread finds the queue full, before it starts waiting. Returns the time it
+  /// started, to be passed to Resumed().
+  inline uint64_t Throttled() {
+    saturated_.store(true, std::memory_order_relaxed);
+    ++throttled_;
+    return NowNs();
+  }
+
+  /// Parks the calling thread until the queue has room, or for about half a read's latency.
+  void Wait() {
+    uint64_t park_ns = latency_ns_.load(std::memory_order_relaxed) / 2;
+    park_ns = park_ns < kMinParkNs ? kMinParkNs : park_ns > kMaxParkNs ? kMaxParkNs : park_ns;
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    ++waiters_;
+    room_.wait_for(lock, std::chrono::nanoseconds{ park_ns }, [this]() {
+      return !Full();
+    });
+    --waiters_;
+  }
+
+  inline void Resumed(uint64_t start_ns) {
+    throttled_ns_.fetch_add(NowNs() - start_ns, std::memory_order_relaxed);
+  }
+
+  IoQueueStats Stats() const {
+    return IoQueueStats{ depth_.load(), pending_.load(), latency_ns_.load() / 1000.0,
+                         min_latency_ns_.load() / 1000.0, iops_.load() / 1000.0,
+                         throttled_.load(), throttled_ns_.load() };
+  }
+
+ private:
+  static inline uint64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void Adjust(uint64_t now) {
+    std::lock_guard<std::mutex> lock{ adjust_mutex_ };
+    // Completions that land between here and the subtraction count toward the next window.
+    uint64_t latency = window_latency_ns_.exchange(0) / kWindow;
+    window_count_.fetch_sub(kWindow);
+    uint64_t elapsed = std::max<uint64_t>(now - window_start_ns_, 1);
+    window_start_ns_ = now;
+    latency_ns_.store(latency);
+    iops_.store(kWindow * 1000000000000ull / elapsed);
+
+    uint64_t min_latency = min_latency_ns_.load();
+    if(min_latency == 0 || latency < min_latency) {
+      min_latency = latency;
+    } else {
+      min_latency += std::max<uint64_t>(min_latency / kMinLatencyDrift, 1);
+    }
+    min_latency_ns_.store(min_latency);
+
+    // Room for a batch from each thread that submitted reads during the window.
+    uint32_t active = 0;
+    for(auto& word : active_threads_) {
+      for(uint64_t bits = word.exchange(0); bits != 0; bits &= bits - 1) {
+        ++active;
+      }
+    }
+    uint32_t min_depth = submit_batch_.load() * active;
+    min_depth = min_depth < kMinDepth ? kMinDepth : min_depth;
+
+    bool saturated = saturated_.exchange(false);
+    if(cooldown_) {
+      // Reads issued before the last decrease are still draining; judge the next window.
+      cooldown_ = false;
+      return;
+    }
+    uint32_t depth = depth_.load();
+    if(latency > kCongestion * min_latency) {
+      depth -= depth / 4;
+      cooldown_ = true;
+    } else if(saturated) {
+      depth += kIncrease;
+      depth = depth > kMaxDepth ? kMaxDepth : depth;
+    }
+    depth_.store(std::max(depth, min_depth));
+  }
+
+  std::atomic<uint32_t> depth_;
+  std::atomic<uint64_t> pending_;
+  /// Set if a thread found the queue full during the current window.
+  std::atomic<bool> saturated_;
+
+  std::atomic<uint64_t> window_count_;
+  std::atomic<uint64_t> window_latency_ns_;
+  /// Guarded by adjust_mutex_.
+  uint64_t window_start_ns_;
+  bool cooldown_;
+  std::mutex adjust_mutex_;
+
+  std::atomic<uint64_t> latency_ns_;
+  std::atomic<uint64_t> min_latency_ns_;
+  /// In thousandths of a read per second.
+  std::atomic<uint64_t> iops_;
+  std::atomic<uint64_t> throttled_;
+  std::atomic<uint64_t> throttled_ns_;
+
+  std::mutex mutex_;
+  std::condition_variable room_;
+  std::atomic<uint32_t> waiters_;
+
+  std::atomic<uint32_t> submit_batch_;
+  /// Threads that submitted reads during the current window, one bit per thread ID.
+  std::atomic<uint64_t> active_threads_[(Thread::kMaxNumThreads + 63) / 64];
+};
+
+}
+} // namespace FASTER::core
@@ -39,6 +39,11 @@ struct KeyHash {
     return static_cast<uint16_t>(tag_);
   }
 
+  /// The whole hash; with a dense index (FasterKv::SetDenseIndex()), the key's ID.
+  inline uint64_t control() const {
+    return control_;
+  }
+
  private:
   union {
       struct {
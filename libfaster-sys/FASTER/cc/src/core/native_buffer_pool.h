@@ -110,9 +110,19 @@ class NativeSectorAlignedBufferPool {
   static constexpr uint32_t kLevels = 32;
 
  public:
+  /// Invoked with each buffer the pool allocates. (The pool never frees a buffer.)
+  typedef void(*AllocateCallback)(void* context, uint8_t* buffer, uint32_t length);
+
   NativeSectorAlignedBufferPool(uint32_t recordSize, uint32_t sectorSize)
     : record_size_{ recordSize }
-    , sector_size_{ sectorSize } {
+    , sector_size_{ sectorSize }
+    , allocate_callback_{ nullptr }
+    , allocate_context_{ nullptr } {
+  }
+
+  void SetAllocateCallback(AllocateCallback callback, void* context) {
+    allocate_context_ = context;
+    allocate_callback_ = callback;
   }
 
   inline void Return(uint32_t level, uint8_t* buffer) {
@@ -139,6 +149,8 @@ class NativeSectorAlignedBufferPool {
   /// Level 0 caches memory allocations of size (sectorSize); level n+1 caches allocations of size
   /// (sectorSize) * 2^n.
   concurrent_queue<uint8_t*> queue_[kLevels];
+  AllocateCallback allocate_callback_;
+  void* allocate_context_;
 };
 
 /// Implementations.
@@ -180,6 +192,9 @@ inline SectorAlignedMemory NativeSectorAlignedBufferPool::Get(uint32_t numRecord
   } else {
     uint8_t* buffer = reinterpret_cast<uint8_t*>(aligned_alloc(sector_size_,
                       sector_size_ * (1 << level)));
+    if(allocate_callback_) {
+      allocate_callback_(allocate_context_, buffer, sector_size_ * (1 << level));
+    }
     return SectorAlignedMemory{ buffer, level, this };
   }
 }
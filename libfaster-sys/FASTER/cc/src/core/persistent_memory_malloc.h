@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <cstdint>
@@ -243,6 +244,11 @@ class PersistentMemoryMalloc {
   /// The first 4 HLOG pages should be below the head (i.e., being flushed to disk).
   static constexpr uint32_t kNumHeadPages = 4;
 
+  /// Pinned pages may hold the head address back by at least this many pages. Holding it back
+  /// further would leave no free page for NewPage() to open, unless the head is kept that much
+  /// closer to the tail to begin with (see ReservePinnedHeadPages()).
+  static constexpr uint32_t kMaxPinnedHeadPages = kNumHeadPages - 3;
+
   PersistentMemoryMalloc(bool has_no_backing_storage, uint64_t log_size, LightEpoch& epoch, disk_t& disk_, log_file_t& file_,
                          Address start_address, double log_mutable_fraction, bool pre_allocate_log)
     : sector_size{ static_cast<uint32_t>(file_.alignment()) }
@@ -261,7 +267,11 @@ class PersistentMemoryMalloc {
     , buffer_size_{ 0 }
     , pages_{ nullptr }
     , page_status_{ nullptr }
-    , pre_allocate_log_{ pre_allocate_log } {
+    , page_pins_{ nullptr }
+    , max_pinned_head_pages_{ kMaxPinnedHeadPages }
+    , pinned_pages_closed_{ 0 }
+    , pre_allocate_log_{ pre_allocate_log }
+    , has_no_backing_storage_{ has_no_backing_storage } {
     assert(start_address.page() <= Address::kMaxPage);
 
     if(log_size % kPageSize != 0) {
@@ -290,7 +300,15 @@ class PersistentMemoryMalloc {
       throw std::invalid_argument{ "Must have at least 'kNumHeadPages' immutable pages" };
     }
 
+    // Records are read from disk into these buffers, which the disk may register (as io_uring
+    // fixed buffers).
+    read_buffer_pool.SetAllocateCallback(RegisterReadBuffer, disk);
+
     page_status_ = new FullPageStatus[buffer_size_];
+    page_pins_ = new std::atomic<uint64_t>[buffer_size_];
+    for(uint32_t idx = 0; idx < buffer_size_; ++idx) {
+      page_pins_[idx].store(0);
+    }
 
     pages_ = new uint8_t* [buffer_size_];
     for(uint32_t idx = 0; idx < buffer_size_; ++idx) {
@@ -337,6 +355,9 @@ class PersistentMemoryMalloc {
     if(page_status_) {
       delete[] page_status_;
     }
+    if(page_pins_) {
+      delete[] page_pins_;
+    }
   }
 
   inline const uint8_t* Page(uint32_t page) const {
@@ -393,6 +414,87 @@ class PersistentMemoryMalloc {
   /// Used by applications to make the current state of the database immutable quickly
   Address ShiftReadOnlyToTail();
 
+  /// Pins the page holding "address": the head address stops at the first pinned page, so that
+  /// page and every page after it stay in memory, up to the max_pinned_head_pages() limit. Each
+  /// PinPage() must be matched by an UnpinPage() of the same address.
+  ///
+  /// Pins are counted per logical page: a buffer page's slot holds the page number with its pin
+  /// count. Pins left on a page that was closed anyway no longer count once a later page reuses
+  /// the slot, and their UnpinPage() leaves that page's pins alone.
+  inline void PinPage(Address address) {
+    std::atomic<uint64_t>& slot = page_pins_[address.page() % buffer_size_];
+    uint64_t pins = slot.load();
+    uint64_t new_pins;
+    do {
+      if(PinnedPage(pins) == address.page()) {
+        new_pins = pins + 1;
+      } else if(PinnedPage(pins) < address.page() || PinCount(pins) == 0) {
+        // The slot's pins are on a page that was closed (anyway).
+        new_pins = PagePins(address.page(), 1);
+      } else {
+        // The page itself was closed, and the slot reused; the pin would hold nothing in memory.
+        return;
+      }
+    } while(!slot.compare_exchange_weak(pins, new_pins));
+  }
+  inline void UnpinPage(Address address) {
+    std::atomic<uint64_t>& slot = page_pins_[address.page() % buffer_size_];
+    uint64_t pins = slot.load();
+    do {
+      if(PinnedPage(pins) != address.page() || PinCount(pins) == 0) {
+        return;
+      }
+    } while(!slot.compare_exchange_weak(pins, pins - 1));
+  }
+  inline bool IsPinned(uint32_t page) const {
+    uint64_t pins = page_pins_[page % buffer_size_].load();
+    return PinnedPage(pins) == page && PinCount(pins) > 0;
+  }
+  /// Lets pinned pages hold the head address back by up to "pages" pages, e.g., as many as the
+  /// rows a lookahead prefetches ahead of the trainer fill. To leave NewPage() a free page, the
+  /// head is kept that many pages (beyond kMaxPinnedHeadPages) closer to the tail, so fewer pages
+  /// stay in memory meanwhile. The limit is capped by the immutable region; returns the limit set.
+  inline uint32_t ReservePinnedHeadPages(uint32_t pages) {
+    uint32_t max_pages = buffer_size_ - num_mutable_pages_ > kNumHeadPages ?
+                         buffer_size_ - num_mutable_pages_ - (kNumHeadPages - kMaxPinnedHeadPages) :
+                         kMaxPinnedHeadPages;
+    pages = pages < kMaxPinnedHeadPages ? kMaxPinnedHeadPages : std::min(pages, max_pages);
+    max_pinned_head_pages_.store(pages);
+    return pages;
+  }
+  inline uint32_t max_pinned_head_pages() const {
+    return max_pinned_head_pages_.load();
+  }
+  /// True if the log has no backing storage, and is too full to allocate records: opening more
+  /// pages would advance the head address past the begin address, and drop records still live.
+  /// Leaves a page of slack for threads already allocating.
+  inline bool Exhausted() const {
+    if(!has_no_backing_storage_) {
+      return false;
+    }
+    uint32_t num_head_pages = kNumHeadPages + (max_pinned_head_pages_.load() - kMaxPinnedHeadPages);
+    return GetTailAddress().page() + 1 >=
+           begin_address.load().page() + (buffer_size_ - num_head_pages);
+  }
+  /// Maps a pointer into an in-memory page back to its logical address, so that a record handed
+  /// out by reference can be pinned. Returns Address::kInvalidAddress if no in-memory page holds
+  /// "ptr". The caller must hold epoch protection, so that the page cannot be closed meanwhile.
+  inline Address AddressOf(const void* ptr) const {
+    const uint8_t* byte = reinterpret_cast<const uint8_t*>(ptr);
+    uint32_t tail_page = GetTailAddress().page();
+    for(uint32_t page = safe_head_address.load().page(); page <= tail_page; ++page) {
+      const uint8_t* frame = Page(page);
+      if(frame != nullptr && byte >= frame && byte < frame + kPageSize) {
+        return Address{ page, static_cast<uint32_t>(byte - frame) };
+      }
+    }
+    return Address::kInvalidAddress;
+  }
+  /// Number of pinned pages closed anyway, because they held the head back too far.
+  inline uint64_t pinned_pages_closed() const {
+    return pinned_pages_closed_.load();
+  }
+
   void Truncate(GcState::truncate_callback_t callback);
 
   /// Action to be performed for when all threads have agreed that a page range is closed.
@@ -426,6 +528,10 @@ class PersistentMemoryMalloc {
 
   static void OnPagesClosed(IAsyncContext* ctxt);
 
+  static void RegisterReadBuffer(void* disk, uint8_t* buffer, uint32_t length) {
+    reinterpret_cast<disk_t*>(disk)->RegisterBuffer(buffer, length);
+  }
+
   /// Seal: make sure there are no longer any threads writing to the page
   /// Flush: send page to secondary store
   class OnPagesMarkedReadOnly_Context : public IAsyncContext {
@@ -516,6 +622,17 @@ class PersistentMemoryMalloc {
   inline void PageAlignedShiftHeadAddress(uint32_t tail_page);
   inline void PageAlignedShiftReadOnlyAddress(uint32_t tail_page);
 
+  /// A buffer page's pins: the logical page in the high 32 bits, its pin count in the low 32.
+  static inline uint64_t PagePins(uint32_t page, uint32_t count) {
+    return (static_cast<uint64_t>(page) << 32) | count;
+  }
+  static inline uint32_t PinnedPage(uint64_t pins) {
+    return static_cast<uint32_t>(pins >> 32);
+  }
+  static inline uint32_t PinCount(uint64_t pins) {
+    return static_cast<uint32_t>(pins);
+  }
+
   /// Every async flush callback tries to update the flushed until address to the latest value
   /// possible
   /// Is there a better way to do this with enabling fine-grained addresses (not necessarily at
@@ -571,6 +688,8 @@ class PersistentMemoryMalloc {
  private:
   uint32_t buffer_size_;
   bool pre_allocate_log_;
+  /// Pages dropped from the circular buffer are lost, not flushed; see Exhausted().
+  bool has_no_backing_storage_;
 
   /// -- the latest N pages should be mutable.
   uint32_t num_mutable_pages_;
@@ -581,6 +700,11 @@ class PersistentMemoryMalloc {
   // Array that indicates the status of each buffer page
   FullPageStatus* page_status_;
 
+  // Array of pins, one per buffer page: the (logical) page pinned, and its pin count
+  std::atomic<uint64_t>* page_pins_;
+  std::atomic<uint32_t> max_pinned_head_pages_;
+  std::atomic<uint64_t> pinned_pages_closed_;
+
   // Global address of the current tail (next element to be allocated from the circular buffer)
   AtomicPageOffset tail_page_offset_;
 
@@ -994,20 +1118,39 @@ inline void PersistentMemoryMalloc<D>::PageAlignedShiftHeadAddress(uint32_t tail
   //obtain local values of variables that can change
   Address current_head_address = head_address.load();
   Address current_flushed_until_address = flushed_until_address.load();
+  // Pages reserved for pins beyond kMaxPinnedHeadPages keep the head closer to the tail.
+  uint32_t max_pinned_pages = max_pinned_head_pages_.load();
+  uint32_t num_head_pages = kNumHeadPages + (max_pinned_pages - kMaxPinnedHeadPages);
 
-  if(tail_page <= (buffer_size_ - kNumHeadPages)) {
+  if(tail_page <= (buffer_size_ - num_head_pages)) {
     // Desired head address is <= 0.
     return;
   }
 
-  Address desired_head_address{ tail_page - (buffer_size_ - kNumHeadPages), 0 };
+  Address desired_head_address{ tail_page - (buffer_size_ - num_head_pages), 0 };
 
   if(current_flushed_until_address < desired_head_address) {
     desired_head_address = Address{ current_flushed_until_address.page(), 0 };
   }
 
+  // Stop at the first pinned page, unless that holds the head back too far.
+  uint32_t min_head_page = desired_head_address.page() > max_pinned_pages ?
+                           desired_head_address.page() - max_pinned_pages : 0;
+  for(uint32_t page = std::max(current_head_address.page(), min_head_page);
+      page < desired_head_address.page(); ++page) {
+    if(IsPinned(page)) {
+      desired_head_address = Address{ page, 0 };
+      break;
+    }
+  }
+
   Address old_head_address;
   if(MonotonicUpdate(head_address, desired_head_address, old_head_address)) {
+    for(uint32_t page = old_head_address.page(); page < desired_head_address.page(); ++page) {
+      if(IsPinned(page)) {
+        ++pinned_pages_closed_;
+      }
+    }
     OnPagesClosed_Context context{ this, desired_head_address, false };
     IAsyncContext* context_copy;
     Status result = context.DeepCopy(context_copy);
@@ -0,0 +1,365 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "address.h"
+#include "alloc.h"
+#include "async.h"
+#include "auto_ptr.h"
+#include "constants.h"
+#include "light_epoch.h"
+#include "utility.h"
+
+namespace FASTER {
+namespace core {
+
+/// Statistics of a ReadCache, as reported by FasterKv::GetReadCacheStats().
+struct ReadCacheStats {
+  /// Reads served from the cache, instead of from disk.
+  uint64_t hits;
+  /// Records copied into the cache after being read from disk.
+  uint64_t admissions;
+  /// Hits on records about to be evicted, that copied them back to the tail.
+  uint64_t second_chances;
+  /// Bytes of the cache's log that have been evicted.
+  uint64_t evicted_bytes;
+};
+
+/// Size-bounded, in-memory cache of records that were read from disk, so that hot records evicted
+/// from the hybrid log can be read again without I/O, and without being copied to the tail of the
+/// hybrid log (where they would push other records out, and be flushed again).
+///
+/// Records are appended to a circular log, and found through a set-associative index keyed by the
+/// hybrid-log address at which the read went to disk. A record below the head address never
+/// changes, so an entry never goes stale: once a newer record for the key exists, reads simply
+/// stop at it and no longer reach the cached address. Entries age out, oldest first, as the log
+/// wraps around. A hit on an entry in the oldest "second_chance_fraction" of the log copies it
+/// back to the tail, so hot records survive eviction.
+///
+/// Readers must be protected by the epoch: the log reuses space only after every thread that
+/// might still be reading it has refreshed.
+template <class R>
+class ReadCache {
+ public:
+  typedef R record_t;
+
+  /// Precedes each cached record.
+  struct EntryHeader {
+    /// The address at which the read went to disk: the first on-disk record in the key's hash
+    /// chain.
+    Address from;
+    /// The address of the cached record. Differs from "from" when the read skipped over records
+    /// of other keys that share the hash chain.
+    Address address;
+    /// Bytes of the record.
+    uint32_t size;
+
+    inline const record_t* record() const {
+      return reinterpret_cast<const record_t*>(reinterpret_cast<const uint8_t*>(this) +
+             kHeaderSize);
+    }
+  };
+
+  /// Index slots per bucket; a bucket fills one cache line.
+  static constexpr uint32_t kNumSlots = Constants::kCacheLineBytes / sizeof(uint64_t);
+  /// The index has one slot per this many bytes of log.
+  static constexpr uint64_t kBytesPerSlot = 64;
+  /// Space is reclaimed in chunks of 1/kNumEvictChunks of the log, to keep epoch actions rare.
+  static constexpr uint64_t kNumEvictChunks = 8;
+
+  ReadCache(LightEpoch& epoch)
+    : epoch_{ &epoch }
+    , capacity_{ 0 }
+    , second_chance_bytes_{ 0 }
+    , log_{ nullptr }
+    , buckets_{ nullptr }
+    , num_buckets_{ 0 }
+    , tail_{ 0 }
+    , head_{ 0 }
+    , safe_head_{ 0 }
+    , hits_{ 0 }
+    , admissions_{ 0 }
+    , second_chances_{ 0 } {
+  }
+
+  ~ReadCache() {
+    Uninitialize();
+  }
+
+  /// Allocates a cache of "size" bytes (a power of 2). Must be called before any thread uses it.
+  void Initialize(uint64_t size, double second_chance_fraction) {
+    if(!Utility::IsPowerOfTwo(size) || size < Constants::kCacheLineBytes * kNumEvictChunks) {
+      throw std::invalid_argument{ "Read cache size must be a power of 2, and at least 512 bytes" };
+    }
+    if(second_chance_fraction < 0 || second_chance_fraction >= 1) {
+      throw std::invalid_argument{ "Second-chance fraction must be in [0, 1)" };
+    }
+    Uninitialize();
+    capacity_ = size;
+    second_chance_bytes_ = static_cast<uint64_t>(second_chance_fraction * size);
+    log_ = reinterpret_cast<uint8_t*>(aligned_alloc(Constants::kCacheLineBytes, size));
+    num_buckets_ = std::max<uint64_t>(size / kBytesPerSlot / kNumSlots, 1);
+    buckets_ = reinterpret_cast<Bucket*>(aligned_alloc(Constants::kCacheLineBytes,
+                                         num_buckets_ * sizeof(Bucket)));
+    std::memset(static_cast<void*>(buckets_), 0, num_buckets_ * sizeof(Bucket));
+    tail_.store(0);
+    head_.store(0);
+    safe_head_.store(0);
+  }
+
+  void Uninitialize() {
+    if(log_) {
+      aligned_free(log_);
+      aligned_free(buckets_);
+      log_ = nullptr;
+      buckets_ = nullptr;
+    }
+    capacity_ = 0;
+  }
+
+  inline bool enabled() const {
+    return capacity_ > 0;
+  }
+
+  /// Drops every entry. Only for use while no thread is reading the cache (e.g., on recovery,
+  /// when new records may reuse the addresses of records that were not checkpointed).
+  void Clear() {
+    if(!enabled()) {
+      return;
+    }
+    std::memset(static_cast<void*>(buckets_), 0, num_buckets_ * sizeof(Bucket));
+    tail_.store(0);
+    head_.store(0);
+    safe_head_.store(0);
+  }
+
+  /// Looks up a read that goes to disk at "from", for the key that "is_key" matches. Returns the
+  /// live entry whose record has that key, if any. Otherwise, "at_from" is the live entry of the
+  /// record stored at "from", if any, whose previous address continues the hash chain.
+  template <class F>
+  inline const EntryHeader* Find(Address from, F is_key, const EntryHeader*& at_from) const {
+    at_from = nullptr;
+    const Bucket& bucket = buckets_[BucketIndex(from)];
+    for(uint32_t slot_idx = 0; slot_idx < kNumSlots; ++slot_idx) {
+      uint64_t slot = bucket.slots[slot_idx].load(std::memory_order_acquire);
+      if(slot == 0) {
+        continue;
+      }
+      uint64_t offset = slot - 1;
+      if(offset < head_.load()) {
+        // Evicted.
+        continue;
+      }
+      const EntryHeader* entry = At(offset);
+      if(entry->from != from) {
+        continue;
+      }
+      if(is_key(entry->record())) {
+        return entry;
+      }
+      if(entry->address == from) {
+        at_from = entry;
+      }
+    }
+    return nullptr;
+  }
+
+  /// Counts a hit on "entry", and gives it a second chance if it is about to be evicted.
+  inline void Touch(const EntryHeader* entry) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    uint64_t offset = OffsetOf(entry);
+    if(offset < head_.load() + second_chance_bytes_) {
+      if(Insert(entry->from, entry->address, entry->record(), entry->size)) {
+        second_chances_.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /// Copies "record" (of "size" bytes, stored at "address") into the cache, for reads that go to
+  /// disk at "from". Best effort: the record is dropped if the space it needs is still being
+  /// reclaimed.
+  inline void Admit(Address from, Address address, const record_t* record, uint32_t size) {
+    if(Insert(from, address, record, size)) {
+      admissions_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  /// Log offset of an entry returned by Find(); valid while the entry is live.
+  inline uint64_t OffsetOf(const EntryHeader* entry) const {
+    uint64_t tail = tail_.load();
+    uint64_t tail_position = tail & (capacity_ - 1);
+    uint64_t position = reinterpret_cast<const uint8_t*>(entry) - log_;
+    return position < tail_position ? tail - tail_position + position :
+           tail - tail_position - capacity_ + position;
+  }
+
+  /// Whether the entry at log offset "offset" is still live. An entry stays readable for as long
+  /// as this holds, even if the reader's epoch is refreshed in between.
+  inline bool Contains(uint64_t offset) const {
+    return offset >= head_.load();
+  }
+
+  ReadCacheStats Stats() const {
+    return ReadCacheStats{ hits_.load(), admissions_.load(), second_chances_.load(),
+                           head_.load() };
+  }
+
+ private:
+  struct alignas(Constants::kCacheLineBytes) Bucket {
+    /// (Log offset of the entry) + 1; 0 if unused.
+    std::atomic<uint64_t> slots[kNumSlots];
+  };
+  static_assert(sizeof(Bucket) == Constants::kCacheLineBytes,
+                "sizeof(Bucket) != Constants::kCacheLineBytes");
+
+  static constexpr uint32_t kAlignment = static_cast<uint32_t>(
+      std::max(alignof(record_t), alignof(EntryHeader)));
+  static constexpr uint32_t kHeaderSize = static_cast<uint32_t>(
+      pad_alignment(sizeof(EntryHeader), kAlignment));
+
+  /// Action to be performed when all threads have stopped reading the log below a new head.
+  class OnEvicted_Context : public IAsyncContext {
+   public:
+    OnEvicted_Context(ReadCache* cache_, uint64_t new_safe_head_)
+      : cache{ cache_ }
+      , new_safe_head{ new_safe_head_ } {
+    }
+
+    /// The deep-copy constructor.
+    OnEvicted_Context(const OnEvicted_Context& other)
+      : cache{ other.cache }
+      , new_safe_head{ other.new_safe_head } {
+    }
+
+   protected:
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) final {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   public:
+    ReadCache* cache;
+    uint64_t new_safe_head;
+  };
+
+  static void OnEvicted(IAsyncContext* ctxt) {
+    CallbackContext<OnEvicted_Context> context{ ctxt };
+    MonotonicUpdate(context->cache->safe_head_, context->new_safe_head);
+  }
+
+  static inline bool MonotonicUpdate(std::atomic<uint64_t>& variable, uint64_t new_value) {
+    uint64_t old_value = variable.load();
+    while(old_value < new_value) {
+      if(variable.compare_exchange_strong(old_value, new_value)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  inline uint64_t BucketIndex(Address address) const {
+    return Utility::GetHashCode(address.control()) % num_buckets_;
+  }
+
+  inline const EntryHeader* At(uint64_t offset) const {
+    return reinterpret_cast<const EntryHeader*>(log_ + (offset & (capacity_ - 1)));
+  }
+  inline EntryHeader* At(uint64_t offset) {
+    return reinterpret_cast<EntryHeader*>(log_ + (offset & (capacity_ - 1)));
+  }
+
+  /// Reserves "size" bytes at the tail. An entry never wraps around the end of the buffer.
+  /// Returns false, after starting to reclaim space, if the bytes are still in use.
+  inline bool Reserve(uint32_t size, uint64_t& offset) {
+    uint64_t tail = tail_.load();
+    do {
+      offset = tail;
+      uint64_t position = offset & (capacity_ - 1);
+      if(position + size > capacity_) {
+        // Skip the end of the buffer.
+        offset += capacity_ - position;
+      }
+      if(offset + size > safe_head_.load() + capacity_) {
+        Evict(offset + size);
+        return false;
+      }
+    } while(!tail_.compare_exchange_weak(tail, offset + size));
+    return true;
+  }
+
+  /// Evicts enough of the oldest entries to make room up to "until", plus a chunk more.
+  void Evict(uint64_t until) {
+    uint64_t new_head = until - capacity_ + capacity_ / kNumEvictChunks;
+    if(MonotonicUpdate(head_, new_head)) {
+      // The space can be reused once all threads have seen the new head.
+      OnEvicted_Context context{ this, new_head };
+      IAsyncContext* context_copy;
+      Status result = context.DeepCopy(context_copy);
+      assert(result == Status::Ok);
+      epoch_->BumpCurrentEpoch(OnEvicted, context_copy);
+    }
+  }
+
+  inline bool Insert(Address from, Address address, const record_t* record, uint32_t size) {
+    uint32_t entry_size = static_cast<uint32_t>(pad_alignment(kHeaderSize + size, kAlignment));
+    if(entry_size > capacity_ / kNumEvictChunks) {
+      return false;
+    }
+    uint64_t offset;
+    if(!Reserve(entry_size, offset)) {
+      return false;
+    }
+    EntryHeader* entry = At(offset);
+    entry->from = from;
+    entry->address = address;
+    entry->size = size;
+    std::memcpy(reinterpret_cast<uint8_t*>(entry) + kHeaderSize, record, size);
+
+    // Replace this record's older entry, or an evicted entry, or else the slot the record's
+    // address hashes to.
+    Bucket& bucket = buckets_[BucketIndex(from)];
+    uint64_t head = head_.load();
+    uint32_t victim = static_cast<uint32_t>(address.control() % kNumSlots);
+    for(uint32_t slot_idx = 0; slot_idx < kNumSlots; ++slot_idx) {
+      uint64_t slot = bucket.slots[slot_idx].load(std::memory_order_relaxed);
+      if(slot == 0 || slot - 1 < head) {
+        victim = slot_idx;
+      } else if(At(slot - 1)->from == from && At(slot - 1)->address == address) {
+        victim = slot_idx;
+        break;
+      }
+    }
+    bucket.slots[victim].store(offset + 1, std::memory_order_release);
+    return true;
+  }
+
+  LightEpoch* epoch_;
+
+  uint64_t capacity_;
+  /// Hits on entries below (head + second_chance_bytes_) copy them to the tail.
+  uint64_t second_chance_bytes_;
+  uint8_t* log_;
+  Bucket* buckets_;
+  uint64_t num_buckets_;
+
+  /// Log offsets only grow; an entry at offset "o" is stored at (o % capacity_).
+  std::atomic<uint64_t> tail_;
+  /// Entries below the head have been evicted.
+  std::atomic<uint64_t> head_;
+  /// No thread reads entries below the safe head, so their space can be reused.
+  std::atomic<uint64_t> safe_head_;
+
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> admissions_;
+  std::atomic<uint64_t> second_chances_;
+};
+
+}
+} // namespace FASTER::core
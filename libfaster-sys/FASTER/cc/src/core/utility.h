@@ -8,6 +8,10 @@
 #include <stdexcept>
 #include <string>
 
+#ifdef _WIN32
+#include <xmmintrin.h>
+#endif
+
 namespace FASTER {
 namespace core {
 
@@ -67,6 +71,15 @@ class Utility {
   static constexpr inline bool IsPowerOfTwo(uint64_t x) {
     return (x > 0) && ((x & (x - 1)) == 0);
   }
+
+  /// Hint the CPU to pull the cache line at the specified address into all cache levels.
+  static inline void Prefetch(const void* address) {
+#ifdef _WIN32
+    _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0);
+#else
+    __builtin_prefetch(address, 0, 3);
+#endif
+  }
 };
 
 }
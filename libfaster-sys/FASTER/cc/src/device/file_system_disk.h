@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <experimental/filesystem>
 #include <mutex>
+#include <stdexcept>
 #include <string>
 
 #include "../core/gc_state.h"
@@ -245,9 +246,13 @@ class FileSystemSegmentedFile {
   static constexpr uint64_t kSegmentSize = S;
   static_assert(core::Utility::IsPowerOfTwo(S), "template parameter S is not a power of two!");
 
+  /// S is only the default segment size; a log must be reopened with the segment size it was
+  /// written with.
   FileSystemSegmentedFile(const std::string& filename,
-                          const environment::FileOptions& file_options, core::LightEpoch* epoch)
-    : begin_segment_{ 0 }
+                          const environment::FileOptions& file_options, core::LightEpoch* epoch,
+                          uint64_t segment_size = S)
+    : segment_size_{ segment_size }
+    , begin_segment_{ 0 }
     , files_{ nullptr }
     , handler_{ nullptr }
     , filename_{ filename }
@@ -274,15 +279,15 @@ class FileSystemSegmentedFile {
     return (files_) ? files_->Delete() : core::Status::Ok;
   }
   void Truncate(uint64_t new_begin_offset, core::GcState::truncate_callback_t callback) {
-    uint64_t new_begin_segment = new_begin_offset / kSegmentSize;
+    uint64_t new_begin_segment = new_begin_offset / segment_size_;
     begin_segment_ = new_begin_segment;
     TruncateSegments(new_begin_segment, callback);
   }
 
   core::Status ReadAsync(uint64_t source, void* dest, uint32_t length, core::AsyncIOCallback callback,
                    core::IAsyncContext& context) const {
-    uint64_t segment = source / kSegmentSize;
-    assert(source % kSegmentSize + length <= kSegmentSize);
+    uint64_t segment = source / segment_size_;
+    assert(source % segment_size_ + length <= segment_size_);
 
     bundle_t* files = files_.load();
 
@@ -293,13 +298,13 @@ class FileSystemSegmentedFile {
       }
       files = files_.load();
     }
-    return files->file(segment).ReadAsync(source % kSegmentSize, dest, length, callback, context);
+    return files->file(segment).ReadAsync(source % segment_size_, dest, length, callback, context);
   }
 
   core::Status WriteAsync(const void* source, uint64_t dest, uint32_t length,
                     core::AsyncIOCallback callback, core::IAsyncContext& context) {
-    uint64_t segment = dest / kSegmentSize;
-    assert(dest % kSegmentSize + length <= kSegmentSize);
+    uint64_t segment = dest / segment_size_;
+    assert(dest % segment_size_ + length <= segment_size_);
 
     bundle_t* files = files_.load();
 
@@ -310,13 +315,17 @@ class FileSystemSegmentedFile {
       }
       files = files_.load();
     }
-    return files->file(segment).WriteAsync(source, dest % kSegmentSize, length, callback, context);
+    return files->file(segment).WriteAsync(source, dest % segment_size_, length, callback, context);
   }
 
   size_t alignment() const {
     return 512; // For now, assume all disks have 512-bytes alignment.
   }
 
+  uint64_t segment_size() const {
+    return segment_size_;
+  }
+
  private:
   core::Status OpenSegment(uint64_t segment) {
     class Context : public core::IAsyncContext {
@@ -387,16 +396,18 @@ class FileSystemSegmentedFile {
   void TruncateSegments(uint64_t new_begin_segment, core::GcState::truncate_callback_t caller_callback) {
     class Context : public core::IAsyncContext {
      public:
-      Context(bundle_t* files_, uint64_t new_begin_segment_,
+      Context(bundle_t* files_, uint64_t new_begin_segment_, uint64_t segment_size_,
               core::GcState::truncate_callback_t caller_callback_)
         : files{ files_ }
         , new_begin_segment{ new_begin_segment_ }
+        , segment_size{ segment_size_ }
         , caller_callback{ caller_callback_ } {
       }
       /// The deep-copy constructor.
       Context(const Context& other)
         : files{ other.files }
         , new_begin_segment{ other.new_begin_segment }
+        , segment_size{ other.segment_size }
         , caller_callback{ other.caller_callback } {
       }
      protected:
@@ -406,6 +417,7 @@ class FileSystemSegmentedFile {
      public:
       bundle_t* files;
       uint64_t new_begin_segment;
+      uint64_t segment_size;
       core::GcState::truncate_callback_t caller_callback;
     };
 
@@ -418,7 +430,7 @@ class FileSystemSegmentedFile {
       }
       std::free(context->files);
       if(context->caller_callback) {
-        context->caller_callback(context->new_begin_segment * kSegmentSize);
+        context->caller_callback(context->new_begin_segment * context->segment_size);
       }
     };
 
@@ -429,7 +441,7 @@ class FileSystemSegmentedFile {
     if(files->begin_segment >= new_begin_segment) {
       // Segments have already been truncated.
       if(caller_callback) {
-        caller_callback(files->begin_segment * kSegmentSize);
+        caller_callback(files->begin_segment * segment_size_);
       }
       return;
     }
@@ -440,7 +452,7 @@ class FileSystemSegmentedFile {
         *files };
     files_.store(new_files);
     // Delete the old list only after all threads have finished looking at it.
-    Context context{ files, new_begin_segment, caller_callback };
+    Context context{ files, new_begin_segment, segment_size_, caller_callback };
     core::IAsyncContext* context_copy;
     core::Status result = context.DeepCopy(context_copy);
     assert(result == core::Status::Ok);
@@ -452,6 +464,7 @@ class FileSystemSegmentedFile {
     epoch_->BumpCurrentEpoch(callback, context_copy);
   }
 
+  uint64_t segment_size_;
   std::atomic<uint64_t> begin_segment_;
   std::atomic<bundle_t*> files_;
   handler_t* handler_;
@@ -461,6 +474,10 @@ class FileSystemSegmentedFile {
   std::mutex mutex_;
 };
 
+/// "config" (passed through by FasterKv's constructor) is a list of "name=value" settings,
+/// separated by ';':
+///   segment_size: bytes per log file (a power of 2; S by default);
+///   io_threads: number of threads the I/O handler is sized for (16 by default).
 template <class H, uint64_t S>
 class FileSystemDisk {
  public:
@@ -468,6 +485,8 @@ class FileSystemDisk {
   typedef FileSystemFile<handler_t> file_t;
   typedef FileSystemSegmentedFile<handler_t, S> log_file_t;
 
+  static constexpr uint64_t kDefaultIoThreads = 16;
+
  private:
   static std::string NormalizePath(std::string root_path) {
     if(root_path.empty() || root_path.back() != FASTER::environment::kPathSeparator[0]) {
@@ -476,15 +495,45 @@ class FileSystemDisk {
     return root_path;
   }
 
+  /// The value of setting "name" in "config", or "default_value" if it is not set.
+  static uint64_t ConfigValue(const std::string& config, const std::string& name,
+                              uint64_t default_value) {
+    size_t begin = 0;
+    while(begin < config.size()) {
+      size_t end = config.find(';', begin);
+      if(end == std::string::npos) {
+        end = config.size();
+      }
+      size_t equals = config.find('=', begin);
+      if(equals < end && config.compare(begin, equals - begin, name) == 0) {
+        try {
+          return std::stoull(config.substr(equals + 1, end - equals - 1));
+        } catch(std::logic_error&) {
+          throw std::invalid_argument{ "Invalid value for disk setting " + name };
+        }
+      }
+      begin = end + 1;
+    }
+    return default_value;
+  }
+
+  static uint64_t SegmentSize(const std::string& config) {
+    uint64_t segment_size = ConfigValue(config, "segment_size", S);
+    if(!core::Utility::IsPowerOfTwo(segment_size)) {
+      throw std::invalid_argument{ "Segment size is not a power of 2" };
+    }
+    return segment_size;
+  }
+
  public:
   FileSystemDisk(const std::string& root_path, core::LightEpoch& epoch,
                  const std::string& config = "",
                  bool enablePrivileges = false, bool unbuffered = true,
                  bool delete_on_close = false)
     : root_path_{ NormalizePath(root_path) }
-    , handler_{ 16 /*max threads*/ }
+    , handler_{ ConfigValue(config, "io_threads", kDefaultIoThreads) }
     , default_file_options_{ unbuffered, delete_on_close }
-    , log_{ root_path_ + "log.log", default_file_options_, &epoch} {
+    , log_{ root_path_ + "log.log", default_file_options_, &epoch, SegmentSize(config) } {
     core::Status result = log_.Open(&handler_);
     assert(result == core::Status::Ok);
   }
@@ -558,6 +607,21 @@ class FileSystemDisk {
     return handler_.TryComplete();
   }
 
+  /// Submits the I/Os that the calling thread's handler has queued, if it batches them.
+  void Submit() {
+    handler_.Submit();
+  }
+
+  /// Lets the handler pre-register a buffer that stays allocated (see UringIoHandler).
+  void RegisterBuffer(uint8_t* buffer, uint32_t length) {
+    handler_.RegisterBuffer(buffer, length);
+  }
+
+  /// Has the handler count the reads it submits against "io_queue"'s limit.
+  void SetIoQueue(core::IoQueueController* io_queue) {
+    handler_.SetIoQueue(io_queue);
+  }
+
  private:
   std::string root_path_;
   handler_t handler_;
@@ -117,6 +117,16 @@ class NullDisk {
     return false;
   }
 
+  inline static void Submit() {
+  }
+
+  inline static void RegisterBuffer(uint8_t* buffer, uint32_t length) {
+  }
+
+  /// Reads complete as they are issued, so none are ever in flight.
+  inline static void SetIoQueue(core::IoQueueController* io_queue) {
+  }
+
  private:
   handler_t handler_;
   file_t log_;
@@ -1227,6 +1227,21 @@ class StorageDevice {
     return ioHandler.TryComplete();
   }
 
+  /// Submits the I/Os to local disk/SSD that the calling thread has queued.
+  void Submit() {
+    ioHandler.Submit();
+  }
+
+  /// Lets the local IO handler pre-register a buffer that stays allocated.
+  void RegisterBuffer(uint8_t* buffer, uint32_t length) {
+    ioHandler.RegisterBuffer(buffer, length);
+  }
+
+  /// Has the local IO handler count the reads it submits against "io_queue"'s limit.
+  void SetIoQueue(core::IoQueueController* io_queue) {
+    ioHandler.SetIoQueue(io_queue);
+  }
+
   /// Complete all pending IO operations. Useful for testing.
   void CompletePending() {
     task_t task;
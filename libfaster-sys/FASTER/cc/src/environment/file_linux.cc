@@ -109,6 +109,9 @@ void QueueIoHandler::IoCompletionCallback(io_context_t ctx, struct iocb* iocb, l
     long res2) {
   auto callback_context = core::make_context_unique_ptr<IoCallbackContext>(
                             reinterpret_cast<IoCallbackContext*>(iocb));
+  if(callback_context->io_queue) {
+    callback_context->io_queue->Complete(callback_context->issue_ns);
+  }
   size_t bytes_transferred;
   Status return_status;
   if(res < 0) {
@@ -121,18 +124,112 @@ void QueueIoHandler::IoCompletionCallback(io_context_t ctx, struct iocb* iocb, l
   callback_context->callback(callback_context->caller_context, return_status, bytes_transferred);
 }
 
+Status QueueIoHandler::Schedule(IoCallbackContext* context, bool is_read) {
+  struct iocb* iocb = &context->parent_iocb;
+  if(!is_read) {
+    int result = ::io_submit(io_object_, 1, &iocb);
+    return result == 1 ? Status::Ok : Status::IOError;
+  }
+  Staging& staging = staging_[Thread::id()];
+  if(staging.count.load(std::memory_order_relaxed) == kSubmitBatch) {
+    Submit(staging, true);
+  }
+  staging.lock.Acquire();
+  uint32_t count = staging.count.load(std::memory_order_relaxed);
+  if(count == kSubmitBatch) {
+    // The AIO context is full.
+    staging.lock.Release();
+    return Status::IOError;
+  }
+  staging.iocbs[count] = iocb;
+  staging.count.store(count + 1, std::memory_order_relaxed);
+  ++num_staged_;
+  staging.lock.Release();
+  if(count + 1 == kSubmitBatch) {
+    Submit(staging, true);
+  }
+  return Status::Ok;
+}
+
+void QueueIoHandler::Submit(Staging& staging, bool wait_for_lock) {
+  if(wait_for_lock) {
+    staging.lock.Acquire();
+  } else if(!staging.lock.TryAcquire()) {
+    return;
+  }
+  // Reads the kernel refused are failed once the lock is released, since their callbacks may
+  // stage more reads.
+  struct iocb* refused[kSubmitBatch];
+  long errors[kSubmitBatch];
+  uint32_t num_refused = 0;
+  uint32_t count = staging.count.load(std::memory_order_relaxed);
+  if(io_queue_ && count > 0) {
+    // The reads count against the queue's limit from here, before any can complete.
+    uint64_t issue_ns = io_queue_->Issue(count);
+    for(uint32_t idx = 0; idx < count; ++idx) {
+      IoCallbackContext* context = reinterpret_cast<IoCallbackContext*>(staging.iocbs[idx]);
+      context->io_queue = io_queue_;
+      context->issue_ns = issue_ns;
+    }
+  }
+  uint32_t submitted = 0;
+  while(submitted < count) {
+    int result = ::io_submit(io_object_, count - submitted, &staging.iocbs[submitted]);
+    if(result > 0) {
+      submitted += result;
+    } else if(result == -EAGAIN) {
+      // The AIO context is full; keep the rest for the next call.
+      break;
+    } else {
+      // The first remaining read failed; the kernel did not take any of them.
+      refused[num_refused] = staging.iocbs[submitted];
+      errors[num_refused++] = result < 0 ? result : -EIO;
+      ++submitted;
+    }
+  }
+  if(io_queue_ && submitted < count) {
+    // Still staged, so not yet in flight. (Those submitted may already have completed.)
+    io_queue_->Cancel(count - submitted);
+    for(uint32_t idx = submitted; idx < count; ++idx) {
+      reinterpret_cast<IoCallbackContext*>(staging.iocbs[idx])->io_queue = nullptr;
+    }
+  }
+  if(submitted > 0) {
+    std::memmove(&staging.iocbs[0], &staging.iocbs[submitted],
+                 (count - submitted) * sizeof(struct iocb*));
+    staging.count.store(count - submitted, std::memory_order_relaxed);
+    num_staged_ -= submitted;
+  }
+  staging.lock.Release();
+  for(uint32_t idx = 0; idx < num_refused; ++idx) {
+    IoCompletionCallback(io_object_, refused[idx], errors[idx], 0);
+  }
+}
+
 bool QueueIoHandler::TryComplete() {
+  Submit();
   struct timespec timeout;
   std::memset(&timeout, 0, sizeof(timeout));
-  struct io_event events[1];
-  int result = ::io_getevents(io_object_, 1, 1, events, &timeout);
-  if(result == 1) {
-    io_callback_t callback = reinterpret_cast<io_callback_t>(events[0].data);
-    callback(io_object_, events[0].obj, events[0].res, events[0].res2);
-    return true;
-  } else {
-    return false;
+  struct io_event events[kMaxEvents];
+  int result = ::io_getevents(io_object_, 1, kMaxEvents, events, &timeout);
+  for(int idx = 0; idx < result; ++idx) {
+    io_callback_t callback = reinterpret_cast<io_callback_t>(events[idx].data);
+    callback(io_object_, events[idx].obj, events[idx].res, events[idx].res2);
+  }
+  if(result > 0) {
+    // Reads that the callbacks issued (e.g., to follow a hash chain further back), which could
+    // otherwise wait for this thread's next call.
+    Submit();
+  } else if(num_staged_.load() > 0) {
+    // Nothing completes until the reads that other threads staged are submitted, and those
+    // threads may not call Submit() again for a while.
+    for(size_t idx = 0; idx < Thread::kMaxNumThreads; ++idx) {
+      if(staging_[idx].count.load(std::memory_order_relaxed) > 0) {
+        Submit(staging_[idx], false);
+      }
+    }
   }
+  return result > 0;
 }
 
 Status QueueFile::Open(FileCreateDisposition create_disposition, const FileOptions& options,
@@ -146,7 +243,7 @@ Status QueueFile::Open(FileCreateDisposition create_disposition, const FileOptio
     return Status::Ok;
   }
 
-  io_object_ = handler->io_object();
+  handler_ = handler;
   return Status::Ok;
 }
 
@@ -184,57 +281,323 @@ Status QueueFile::ScheduleOperation(FileOperationType operationType, uint8_t* bu
   new(io_context.get()) QueueIoHandler::IoCallbackContext(operationType, fd_, offset, length,
       buffer, caller_context_copy, callback);
 
-  struct iocb* iocbs[1];
-  iocbs[0] = reinterpret_cast<struct iocb*>(io_context.get());
-
-  int result = ::io_submit(io_object_, 1, iocbs);
-  if(result != 1) {
-    return Status::IOError;
-  }
-
+  RETURN_NOT_OK(handler_->Schedule(io_context.get(),
+                                   operationType == FileOperationType::Read));
   io_context.release();
   return Status::Ok;
 }
 
 #ifdef FASTER_URING
 
-bool UringIoHandler::TryComplete() {
-  struct io_uring_cqe* cqe = nullptr;
-  cq_lock_.Acquire();
-  int res = io_uring_peek_cqe(ring_, &cqe);
-  if(res == 0 && cqe) {
-    int io_res = cqe->res;
-    auto *context = reinterpret_cast<UringIoHandler::IoCallbackContext*>(io_uring_cqe_get_data(cqe));
-    io_uring_cqe_seen(ring_, cqe);
-    cq_lock_.Release();
-    Status return_status;
-    size_t byte_transferred;
-    if (io_res < 0) {
-      // Retry if it is failed.....
-      sq_lock_.Acquire();
-      struct io_uring_sqe *sqe = io_uring_get_sqe(ring_);
-      assert(sqe != 0);
-      if (context->is_read_) {
-        io_uring_prep_readv(sqe, context->fd_, &context->vec_, 1, context->offset_);
-      } else {
-        io_uring_prep_writev(sqe, context->fd_, &context->vec_, 1, context->offset_);
+void UringIoHandler::Initialize() {
+  for(size_t idx = 0; idx < kNumRings; ++idx) {
+    rings_[idx].store(nullptr);
+  }
+  for(uint32_t idx = 0; idx < kMaxRegisteredFiles; ++idx) {
+    files_[idx] = -1;
+  }
+  for(uint32_t idx = 0; idx < kBufferTableSize; ++idx) {
+    buffer_table_[idx].buffer.store(nullptr);
+  }
+}
+
+UringIoHandler::Ring* UringIoHandler::GetRing(bool io_poll) {
+  std::atomic<Ring*>& slot = rings_[2 * Thread::id() + (io_poll ? 1 : 0)];
+  Ring* ring = slot.load(std::memory_order_acquire);
+  if(ring) {
+    return ring;
+  }
+  ring = new(aligned_alloc(alignof(Ring), sizeof(Ring))) Ring{};
+
+  std::lock_guard<std::mutex> lock{ registry_mutex_ };
+  // If the kernel does not allow a polling mode here (e.g., SQPOLL without privileges), drop
+  // SQPOLL first, and IOPOLL only if that does not help.
+  const bool modes[][2] = { { config_.sq_poll, io_poll }, { false, io_poll }, { false, false } };
+  int ret = -1;
+  for(const auto& mode : modes) {
+    ring->sq_poll = mode[0];
+    ring->io_poll = mode[1];
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    if(ring->io_poll) {
+      params.flags |= IORING_SETUP_IOPOLL;
+    }
+    if(ring->sq_poll) {
+      params.flags |= IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = config_.sq_poll_idle_ms;
+      if(config_.sq_poll_cpu >= 0) {
+        params.flags |= IORING_SETUP_SQ_AFF;
+        params.sq_thread_cpu = static_cast<uint32_t>(config_.sq_poll_cpu);
+      }
+      if(sq_poll_fd_ != -1) {
+        params.flags |= IORING_SETUP_ATTACH_WQ;
+        params.wq_fd = static_cast<uint32_t>(sq_poll_fd_);
+      }
+    }
+    ret = io_uring_queue_init_params(kMaxEvents, &ring->ring, &params);
+    if(ret == 0) {
+      break;
+    }
+  }
+  assert(ret == 0);
+  if(ring->sq_poll && sq_poll_fd_ == -1) {
+    sq_poll_fd_ = ring->ring.ring_fd;
+  }
+  // Files opened and buffers allocated so far; later ones are registered by RegisterFile() and
+  // RegisterBuffer().
+  ring->fixed_files = io_uring_register_files(&ring->ring, files_, kMaxRegisteredFiles) == 0;
+  ret = io_uring_register_buffers_sparse(&ring->ring, kMaxRegisteredBuffers);
+  ring->fixed_buffers = ret == 0 && (num_buffers_ == 0 ||
+                        io_uring_register_buffers_update_tag(&ring->ring, 0, buffers_, nullptr,
+                            num_buffers_) == static_cast<int>(num_buffers_));
+  slot.store(ring, std::memory_order_release);
+  return ring;
+}
+
+int UringIoHandler::RegisterFile(int fd) {
+  std::lock_guard<std::mutex> lock{ registry_mutex_ };
+  for(uint32_t idx = 0; idx < kMaxRegisteredFiles; ++idx) {
+    if(files_[idx] == -1) {
+      files_[idx] = fd;
+      for(size_t ring_idx = 0; ring_idx < kNumRings; ++ring_idx) {
+        Ring* ring = rings_[ring_idx].load();
+        if(ring && ring->fixed_files.load() &&
+            io_uring_register_files_update(&ring->ring, idx, &files_[idx], 1) != 1) {
+          ring->fixed_files = false;
+        }
       }
-      io_uring_sqe_set_data(sqe, context);
-      int retry_res = io_uring_submit(ring_);
-      assert(retry_res == 1);
-      sq_lock_.Release();
-      return false;
+      return static_cast<int>(idx);
+    }
+  }
+  return -1;
+}
+
+void UringIoHandler::UnregisterFile(int file_index) {
+  std::lock_guard<std::mutex> lock{ registry_mutex_ };
+  files_[file_index] = -1;
+  for(size_t idx = 0; idx < kNumRings; ++idx) {
+    Ring* ring = rings_[idx].load();
+    if(ring && ring->fixed_files.load() &&
+        io_uring_register_files_update(&ring->ring, file_index, &files_[file_index], 1) != 1) {
+      ring->fixed_files = false;
+    }
+  }
+}
+
+void UringIoHandler::RegisterBuffer(uint8_t* buffer, uint32_t length) {
+  std::lock_guard<std::mutex> lock{ registry_mutex_ };
+  if(num_buffers_ == kMaxRegisteredBuffers) {
+    return;
+  }
+  uint32_t index = num_buffers_++;
+  buffers_[index] = iovec{ buffer, length };
+  for(size_t idx = 0; idx < kNumRings; ++idx) {
+    Ring* ring = rings_[idx].load();
+    if(ring && ring->fixed_buffers.load() &&
+        io_uring_register_buffers_update_tag(&ring->ring, index, &buffers_[index], nullptr,
+                                             1) != 1) {
+      ring->fixed_buffers = false;
+    }
+  }
+  // Publish the buffer only once every ring has it.
+  uint32_t slot = (reinterpret_cast<uintptr_t>(buffer) >> 9) % kBufferTableSize;
+  while(buffer_table_[slot].buffer.load() != nullptr) {
+    slot = (slot + 1) % kBufferTableSize;
+  }
+  buffer_table_[slot].index = index;
+  buffer_table_[slot].length = length;
+  buffer_table_[slot].buffer.store(buffer, std::memory_order_release);
+}
+
+int UringIoHandler::FindBuffer(const uint8_t* buffer, size_t length) const {
+  uint32_t slot = (reinterpret_cast<uintptr_t>(buffer) >> 9) % kBufferTableSize;
+  for(uint8_t* entry; (entry = buffer_table_[slot].buffer.load(std::memory_order_acquire));
+      slot = (slot + 1) % kBufferTableSize) {
+    if(entry == buffer) {
+      return length <= buffer_table_[slot].length ?
+             static_cast<int>(buffer_table_[slot].index) : -1;
+    }
+  }
+  return -1;
+}
+
+void UringIoHandler::Prepare(Ring* ring, IoCallbackContext* context) {
+  struct io_uring_sqe* sqe = io_uring_get_sqe(&ring->ring);
+  if(!sqe) {
+    // The submission queue is full.
+    SubmitRing(ring);
+    sqe = io_uring_get_sqe(&ring->ring);
+  }
+  assert(sqe != 0);
+
+  bool fixed_file = context->file_index_ != -1 && !context->retried_ &&
+                    ring->fixed_files.load(std::memory_order_relaxed);
+  int fd = fixed_file ? context->file_index_ : context->fd_;
+  int buffer_index = -1;
+  if(ring->fixed_buffers.load(std::memory_order_relaxed) && !context->retried_) {
+    buffer_index = FindBuffer(reinterpret_cast<uint8_t*>(context->vec_.iov_base),
+                              context->vec_.iov_len);
+  }
+  if(buffer_index != -1) {
+    if(context->is_read_) {
+      io_uring_prep_read_fixed(sqe, fd, context->vec_.iov_base, context->vec_.iov_len,
+                               context->offset_, buffer_index);
     } else {
-      return_status = Status::Ok;
-      byte_transferred = io_res;
+      io_uring_prep_write_fixed(sqe, fd, context->vec_.iov_base, context->vec_.iov_len,
+                                context->offset_, buffer_index);
     }
-    context->callback(context->caller_context, return_status, byte_transferred);
-    lss_allocator.Free(context);
-    return true;
+  } else if(context->is_read_) {
+    io_uring_prep_readv(sqe, fd, &context->vec_, 1, context->offset_);
   } else {
-    cq_lock_.Release();
+    io_uring_prep_writev(sqe, fd, &context->vec_, 1, context->offset_);
+  }
+  if(fixed_file) {
+    sqe->flags |= IOSQE_FIXED_FILE;
+  }
+  io_uring_sqe_set_data(sqe, context);
+  ++ring->in_flight;
+  ring->queued[ring->num_queued++] = context;
+}
+
+int UringIoHandler::SubmitRing(Ring* ring) {
+  // The reads count against the queue's limit from here, before any can complete. (A retried
+  // read still counts from its first submission.)
+  bool counted[kMaxEvents];
+  uint32_t num_counted = 0;
+  for(unsigned idx = 0; idx < ring->num_queued; ++idx) {
+    IoCallbackContext* context = ring->queued[idx];
+    counted[idx] = io_queue_ && context->is_read_ && !context->io_queue;
+    num_counted += counted[idx] ? 1 : 0;
+  }
+  if(num_counted > 0) {
+    uint64_t issue_ns = io_queue_->Issue(num_counted);
+    for(unsigned idx = 0; idx < ring->num_queued; ++idx) {
+      if(counted[idx]) {
+        ring->queued[idx]->io_queue = io_queue_;
+        ring->queued[idx]->issue_ns = issue_ns;
+      }
+    }
+  }
+  int res = io_uring_submit(&ring->ring);
+  unsigned submitted = res > 0 ? std::min(static_cast<unsigned>(res), ring->num_queued) : 0;
+  // Still queued, so not yet in flight. (Those submitted may already have completed.)
+  for(unsigned idx = submitted; idx < ring->num_queued; ++idx) {
+    if(counted[idx]) {
+      io_queue_->Cancel(1);
+      ring->queued[idx]->io_queue = nullptr;
+    }
+  }
+  ring->num_queued -= submitted;
+  std::memmove(&ring->queued[0], &ring->queued[submitted],
+               ring->num_queued * sizeof(IoCallbackContext*));
+  return res;
+}
+
+Status UringIoHandler::Schedule(IoCallbackContext* context) {
+  Ring* ring = GetRing(context);
+  Prepare(ring, context);
+  if(!context->is_read_ || io_uring_sq_ready(&ring->ring) >= kSubmitBatch) {
+    int res = SubmitRing(ring);
+    if(res < 0 && res != -EAGAIN && res != -EBUSY) {
+      return Status::IOError;
+    }
+  }
+  return Status::Ok;
+}
+
+void UringIoHandler::Submit() {
+  for(size_t idx = 2 * Thread::id(); idx < 2 * Thread::id() + 2; ++idx) {
+    Ring* ring = rings_[idx].load(std::memory_order_acquire);
+    if(ring && io_uring_sq_ready(&ring->ring) > 0) {
+      // On EAGAIN or EBUSY, the I/Os stay queued, for the next call.
+      SubmitRing(ring);
+    }
+  }
+}
+
+bool UringIoHandler::Reap(Ring* ring, bool wait_for_lock) {
+  // Without a poll thread to do it, completions of polled I/Os appear only when the reaper asks
+  // the kernel to poll for them. So do completions that overflowed the completion queue (more
+  // I/Os in flight than it has entries), once it is drained.
+  bool get_events = (ring->io_poll && !ring->sq_poll &&
+                     ring->in_flight.load(std::memory_order_relaxed) > 0) ||
+                    (__atomic_load_n(ring->ring.sq.kflags, __ATOMIC_ACQUIRE) &
+                     IORING_SQ_CQ_OVERFLOW) != 0;
+  if(!get_events && io_uring_cq_ready(&ring->ring) == 0) {
+    return false;
+  }
+  if(wait_for_lock) {
+    ring->cq_lock.Acquire();
+  } else if(!ring->cq_lock.TryAcquire()) {
     return false;
   }
+  if(get_events) {
+    io_uring_get_events(&ring->ring);
+  }
+  struct io_uring_cqe* cqes[kMaxEvents];
+  unsigned count = io_uring_peek_batch_cqe(&ring->ring, cqes, kMaxEvents);
+  int results[kMaxEvents];
+  IoCallbackContext* contexts[kMaxEvents];
+  for(unsigned idx = 0; idx < count; ++idx) {
+    results[idx] = cqes[idx]->res;
+    contexts[idx] = reinterpret_cast<IoCallbackContext*>(io_uring_cqe_get_data(cqes[idx]));
+  }
+  io_uring_cq_advance(&ring->ring, count);
+  ring->in_flight -= count;
+  ring->cq_lock.Release();
+
+  bool completed = false;
+  for(unsigned idx = 0; idx < count; ++idx) {
+    IoCallbackContext* context = contexts[idx];
+    if(results[idx] < 0) {
+      if(results[idx] == -EOPNOTSUPP && ring->io_poll) {
+        // The file system cannot poll for completions.
+        io_poll_ = false;
+      }
+      // Retry if it is failed..... (without the fixed file and buffer, in case that is why.)
+      context->retried_ = true;
+      Ring* own_ring = GetRing(context);
+      Prepare(own_ring, context);
+      int retry_res = SubmitRing(own_ring);
+      assert(retry_res >= 1);
+      continue;
+    }
+    if(context->io_queue) {
+      context->io_queue->Complete(context->issue_ns);
+    }
+    context->callback(context->caller_context, Status::Ok, results[idx]);
+    lss_allocator.Free(context);
+    completed = true;
+  }
+  if(completed) {
+    // Reads that the callbacks issued (e.g., to follow a hash chain further back), which could
+    // otherwise wait for this thread's next call.
+    Submit();
+  }
+  return completed;
+}
+
+bool UringIoHandler::TryComplete() {
+  Submit();
+  size_t own_idx = 2 * Thread::id();
+  bool completed = false;
+  for(size_t idx = own_idx; idx < own_idx + 2; ++idx) {
+    Ring* ring = rings_[idx].load(std::memory_order_acquire);
+    if(ring && Reap(ring, true)) {
+      completed = true;
+    }
+  }
+  if(completed) {
+    return true;
+  }
+  // I/Os issued by threads that are not polling now, such as page flushes.
+  for(size_t idx = 0; idx < kNumRings; ++idx) {
+    Ring* ring = rings_[idx].load(std::memory_order_acquire);
+    if(ring && (idx < own_idx || idx >= own_idx + 2) && Reap(ring, false)) {
+      completed = true;
+    }
+  }
+  return completed;
 }
 
 Status UringFile::Open(FileCreateDisposition create_disposition, const FileOptions& options,
@@ -248,8 +611,9 @@ Status UringFile::Open(FileCreateDisposition create_disposition, const FileOptio
     return Status::Ok;
   }
 
-  ring_ = handler->io_uring();
-  sq_lock_ = handler->sq_lock();
+  handler_ = handler;
+  file_index_ = handler->RegisterFile(fd_);
+  direct_ = options.unbuffered;
   return Status::Ok;
 }
 
@@ -284,27 +648,10 @@ Status UringFile::ScheduleOperation(FileOperationType operationType, uint8_t* bu
   RETURN_NOT_OK(context.DeepCopy(caller_context_copy));
 
   bool is_read = operationType == FileOperationType::Read;
-  new(io_context.get()) UringIoHandler::IoCallbackContext(is_read, fd_, buffer, length, offset, caller_context_copy, callback);
+  new(io_context.get()) UringIoHandler::IoCallbackContext(is_read, fd_, file_index_, direct_,
+      buffer, length, offset, caller_context_copy, callback);
 
-  sq_lock_->Acquire();
-  struct io_uring_sqe *sqe = io_uring_get_sqe(ring_);
-  assert(sqe != 0);
-
-  if (is_read) {
-    io_uring_prep_readv(sqe, fd_, &io_context->vec_, 1, offset);
-    //io_uring_prep_read(sqe, fd_, buffer, length, offset);
-  } else {
-    io_uring_prep_writev(sqe, fd_, &io_context->vec_, 1, offset);
-    //io_uring_prep_write(sqe, fd_, buffer, length, offset);
-  }
-  io_uring_sqe_set_data(sqe, io_context.get());
-
-  int res = io_uring_submit(ring_);
-  sq_lock_->Release();
-  if (res != 1) {
-    return Status::IOError;
-  }
-  
+  RETURN_NOT_OK(handler_->Schedule(io_context.get()));
   io_context.release();
   return Status::Ok;
 }
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <string>
@@ -12,11 +13,17 @@
 #include <unistd.h>
 
 #ifdef FASTER_URING
+#include <cstring>
+#include <mutex>
 #include <liburing.h>
 #endif
 
+#include "../core/alloc.h"
 #include "../core/async.h"
+#include "../core/constants.h"
+#include "../core/io_queue_controller.h"
 #include "../core/status.h"
+#include "../core/thread.h"
 #include "file_common.h"
 
 namespace FASTER {
@@ -147,29 +154,83 @@ class File {
 
 class QueueFile;
 
+class alignas(64) SpinLock {
+public:
+    SpinLock(): locked_(false) {}
+
+    void Acquire() noexcept {
+        for (;;) {
+            if (!locked_.exchange(true, std::memory_order_acquire)) {
+                return;
+            }
+
+            while (locked_.load(std::memory_order_relaxed)) {
+                __builtin_ia32_pause();
+            }
+        }
+    }
+
+    bool TryAcquire() noexcept {
+        return !locked_.load(std::memory_order_relaxed) &&
+               !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    void Release() noexcept {
+        locked_.store(false, std::memory_order_release);
+    }
+private:
+    std::atomic_bool locked_;
+};
+
 /// The QueueIoHandler class encapsulates completions for async file I/O, where the completions
 /// are put on the AIO completion queue.
+///
+/// Each thread stages its reads, and submits them with one io_submit() call when it calls
+/// Submit() or TryComplete() (i.e., from FasterKv::Refresh() and FasterKv::CompletePending()), or
+/// once kSubmitBatch are staged. (Writes, which are issued by whichever thread flushes a page,
+/// are submitted at once.) TryComplete() reaps up to kMaxEvents completions per call; a call that
+/// finds none submits the reads other threads have staged, so that the reads of a thread that has
+/// gone idle still complete. Reads count against the IoQueueController's limit from the time they
+/// are submitted, not staged.
 class QueueIoHandler {
  public:
   typedef QueueFile async_file_t;
 
  private:
   constexpr static int kMaxEvents = 128;
+  constexpr static uint32_t kSubmitBatch = 32;
+
+  /// One thread's staged reads. The thread stages and submits them; another thread submits them
+  /// if it finds nothing else to complete (e.g., because this thread has gone idle).
+  struct Staging {
+    /// Held by whichever thread is staging or submitting these reads.
+    SpinLock lock;
+    std::atomic<uint32_t> count;
+    struct iocb* iocbs[kSubmitBatch];
+  };
 
  public:
   QueueIoHandler()
-    : io_object_{ 0 } {
+    : io_object_{ 0 }
+    , io_queue_{ nullptr } {
+    InitializeStaging();
   }
+  /// The kernel queue has room for a full batch of reads from each of "max_threads" threads.
   QueueIoHandler(size_t max_threads)
-    : io_object_{ 0 } {
-    int result = ::io_setup(kMaxEvents, &io_object_);
+    : io_object_{ 0 }
+    , io_queue_{ nullptr } {
+    int result = ::io_setup(std::max(kMaxEvents, static_cast<int>(kSubmitBatch * max_threads)),
+                            &io_object_);
     assert(result >= 0);
+    InitializeStaging();
   }
 
   /// Move constructor
   QueueIoHandler(QueueIoHandler&& other) {
     io_object_ = other.io_object_;
     other.io_object_ = 0;
+    io_queue_ = other.io_queue_;
+    InitializeStaging();
   }
 
   ~QueueIoHandler() {
@@ -184,7 +245,9 @@ class QueueIoHandler {
     IoCallbackContext(FileOperationType operation, int fd, size_t offset, uint32_t length,
                       uint8_t* buffer, core::IAsyncContext* context_, core::AsyncIOCallback callback_)
       : caller_context{ context_ }
-      , callback{ callback_ } {
+      , callback{ callback_ }
+      , io_queue{ nullptr }
+      , issue_ns{ 0 } {
       if(FileOperationType::Read == operation) {
         ::io_prep_pread(&this->parent_iocb, fd, buffer, length, offset);
       } else {
@@ -204,18 +267,56 @@ class QueueIoHandler {
 
     /// The caller's asynchronous callback function
     core::AsyncIOCallback callback;
+
+    /// Set while a read counts against the queue's limit, i.e., from its submission on.
+    core::IoQueueController* io_queue;
+    uint64_t issue_ns;
   };
 
   inline io_context_t io_object() const {
     return io_object_;
   }
 
-  /// Try to execute the next IO completion on the queue, if any.
+  /// Stages a read for the calling thread, or submits a write.
+  core::Status Schedule(IoCallbackContext* context, bool is_read);
+
+  /// Submits the calling thread's staged reads.
+  void Submit() {
+    Submit(staging_[core::Thread::id()], true);
+  }
+
+  /// Fixed buffers are an io_uring feature.
+  inline void RegisterBuffer(uint8_t* buffer, uint32_t length) {
+  }
+
+  /// Counts the reads this handler submits against "io_queue"'s limit.
+  void SetIoQueue(core::IoQueueController* io_queue) {
+    io_queue_ = io_queue;
+    io_queue_->SetSubmitBatch(kSubmitBatch);
+  }
+
+  /// Try to execute the next IO completions on the queue, if any. If there are none, submits the
+  /// reads other threads have staged.
   bool TryComplete();
 
  private:
+  void InitializeStaging() {
+    for(size_t idx = 0; idx < core::Thread::kMaxNumThreads; ++idx) {
+      staging_[idx].count = 0;
+    }
+    num_staged_ = 0;
+  }
+
+  /// Submits the staged reads of "staging" (unless another thread holds its lock, if not
+  /// "wait_for_lock"); fails the reads the kernel refuses.
+  void Submit(Staging& staging, bool wait_for_lock);
+
   /// The Linux AIO context used for IO completions.
   io_context_t io_object_;
+  core::IoQueueController* io_queue_;
+  Staging staging_[core::Thread::kMaxNumThreads];
+  /// Reads staged by all threads.
+  std::atomic<uint32_t> num_staged_;
 };
 
 /// The QueueFile class encapsulates asynchronous reads and writes, using the specified AIO
@@ -224,21 +325,21 @@ class QueueFile : public File {
  public:
   QueueFile()
     : File()
-    , io_object_{ nullptr } {
+    , handler_{ nullptr } {
   }
   QueueFile(const std::string& filename)
     : File(filename)
-    , io_object_{ nullptr } {
+    , handler_{ nullptr } {
   }
   /// Move constructor
   QueueFile(QueueFile&& other)
     : File(std::move(other))
-    , io_object_{ other.io_object_ } {
+    , handler_{ other.handler_ } {
   }
   /// Move assignment operator.
   QueueFile& operator=(QueueFile&& other) {
     File::operator=(std::move(other));
-    io_object_ = other.io_object_;
+    handler_ = other.handler_;
     return *this;
   }
 
@@ -254,142 +355,286 @@ class QueueFile : public File {
   core::Status ScheduleOperation(FileOperationType operationType, uint8_t* buffer, size_t offset,
                            uint32_t length, core::IAsyncContext& context, core::AsyncIOCallback callback);
 
-  io_context_t io_object_;
+  QueueIoHandler* handler_;
 };
 
 #ifdef FASTER_URING
 
-class alignas(64) SpinLock {
-public:
-    SpinLock(): locked_(false) {}
-
-    void Acquire() noexcept {
-        for (;;) {
-            if (!locked_.exchange(true, std::memory_order_acquire)) {
-                return;
-            }
+class UringFile;
 
-            while (locked_.load(std::memory_order_relaxed)) {
-                __builtin_ia32_pause();
-            }
-        }
-    }
+/// Optional polling modes of a UringIoHandler.
+struct UringConfig {
+  UringConfig()
+    : sq_poll{ false }
+    , sq_poll_idle_ms{ 1000 }
+    , sq_poll_cpu{ -1 }
+    , io_poll{ false } {
+  }
 
-    void Release() noexcept {
-        locked_.store(false, std::memory_order_release);
-    }
-private:
-    std::atomic_bool locked_;
+  /// A kernel thread, shared by all the rings, polls their submission queues
+  /// (IORING_SETUP_SQPOLL), so that submitting I/Os takes no system call while it is awake. Where
+  /// the kernel does not allow it (e.g., without privileges), rings are set up without it, but
+  /// still with IOPOLL if that is set.
+  bool sq_poll;
+  /// How long the poll thread spins without work, before it sleeps until the next submission.
+  uint32_t sq_poll_idle_ms;
+  /// The CPU to pin the poll thread to, or -1.
+  int sq_poll_cpu;
+  /// Poll the device for completions of I/Os to O_DIRECT files (IORING_SETUP_IOPOLL), instead of
+  /// waiting for interrupts. If the file system does not support it, the handler falls back to
+  /// interrupts after the first failed I/O.
+  bool io_poll;
 };
 
-class UringFile;
-
-/// The QueueIoHandler class encapsulates completions for async file I/O, where the completions
-/// are put on the AIO completion queue.
+/// The UringIoHandler class encapsulates completions for async file I/O, using one io_uring per
+/// thread: a thread prepares its I/Os on its own ring without taking a lock, and submits its
+/// reads in batches, when it calls Submit() or TryComplete() (i.e., from FasterKv::Refresh() and
+/// FasterKv::CompletePending()) or when its submission queue fills. (Writes, which are issued
+/// by whichever thread flushes a page, are submitted at once.) Any thread may reap any ring's
+/// completions, so that an I/O completes even if the thread that issued it stops polling. Reads
+/// count against the IoQueueController's limit from the time they are submitted, not queued.
+///
+/// Open files and the read buffer pool's buffers are registered with every ring (as fixed files
+/// and fixed buffers), which saves the kernel from looking up the file and pinning the buffer's
+/// pages on every I/O. An I/O whose file or buffer could not be registered is issued as usual, and
+/// so is the retry of a failed I/O.
+///
+/// See UringConfig for the polling modes. With IOPOLL, each thread has a second ring for I/Os to
+/// buffered files, which cannot be polled.
 class UringIoHandler {
  public:
   typedef UringFile async_file_t;
+  struct IoCallbackContext;
 
  private:
   constexpr static int kMaxEvents = 128;
+  /// A ring's reads are submitted once this many are queued.
+  constexpr static unsigned kSubmitBatch = 32;
+  /// Registration table sizes, shared by all rings.
+  constexpr static uint32_t kMaxRegisteredFiles = 1024;
+  constexpr static uint32_t kMaxRegisteredBuffers = 1024;
+  constexpr static uint32_t kBufferTableSize = 2 * kMaxRegisteredBuffers;
+  /// Two rings per thread: the second polls for completions (UringConfig::io_poll).
+  constexpr static size_t kNumRings = 2 * core::Thread::kMaxNumThreads;
+
+  /// One of a thread's rings.
+  struct Ring {
+    struct io_uring ring;
+    /// Held by whichever thread is reaping this ring's completions.
+    SpinLock cq_lock;
+    /// False if registering fixed files with this ring failed; its I/Os then use the raw fd.
+    std::atomic<bool> fixed_files;
+    /// False if registering fixed buffers with this ring failed (e.g., over RLIMIT_MEMLOCK).
+    std::atomic<bool> fixed_buffers;
+    /// Set up with IORING_SETUP_IOPOLL.
+    bool io_poll;
+    /// Set up with IORING_SETUP_SQPOLL.
+    bool sq_poll;
+    /// I/Os submitted and not yet reaped (needed only to know when to poll).
+    std::atomic<uint32_t> in_flight;
+    /// I/Os prepared and not yet submitted, in order. (Only the owning thread prepares and
+    /// submits I/Os on a ring.)
+    IoCallbackContext* queued[kMaxEvents];
+    unsigned num_queued;
+  };
+
+  /// Maps a registered buffer's address to its index in the fixed buffer table.
+  struct BufferEntry {
+    std::atomic<uint8_t*> buffer;
+    uint32_t index;
+    uint32_t length;
+  };
 
  public:
-  UringIoHandler() {
-    ring_ = new struct io_uring();
-    int ret = io_uring_queue_init(kMaxEvents, ring_, 0);
-    assert(ret == 0);
+  UringIoHandler()
+    : config_{}
+    , io_poll_{ false }
+    , io_queue_{ nullptr }
+    , sq_poll_fd_{ -1 }
+    , num_buffers_{ 0 } {
+    Initialize();
   }
 
-  UringIoHandler(size_t max_threads) {
-    ring_ = new struct io_uring();
-    int ret = io_uring_queue_init(kMaxEvents, ring_, 0);
-    assert(ret == 0);
+  UringIoHandler(size_t max_threads, const UringConfig& config = UringConfig{})
+    : config_{ config }
+    , io_poll_{ config.io_poll }
+    , io_queue_{ nullptr }
+    , sq_poll_fd_{ -1 }
+    , num_buffers_{ 0 } {
+    Initialize();
   }
 
   /// Move constructor
-  UringIoHandler(UringIoHandler&& other) {
-    ring_ = other.ring_;
-    other.ring_ = 0;
+  UringIoHandler(UringIoHandler&& other)
+    : config_{ other.config_ }
+    , io_poll_{ other.io_poll_.load() }
+    , io_queue_{ other.io_queue_ }
+    , sq_poll_fd_{ other.sq_poll_fd_ }
+    , num_buffers_{ other.num_buffers_ } {
+    for(size_t idx = 0; idx < kNumRings; ++idx) {
+      rings_[idx].store(other.rings_[idx].exchange(nullptr));
+    }
+    std::memcpy(files_, other.files_, sizeof(files_));
+    std::memcpy(buffers_, other.buffers_, sizeof(buffers_));
+    for(uint32_t idx = 0; idx < kBufferTableSize; ++idx) {
+      buffer_table_[idx].buffer.store(other.buffer_table_[idx].buffer.load());
+      buffer_table_[idx].index = other.buffer_table_[idx].index;
+      buffer_table_[idx].length = other.buffer_table_[idx].length;
+    }
   }
 
   ~UringIoHandler() {
-    if (ring_ != 0) {
-      io_uring_queue_exit(ring_);
-      delete ring_;
+    for(size_t idx = 0; idx < kNumRings; ++idx) {
+      Ring* ring = rings_[idx].load();
+      if(ring) {
+        io_uring_queue_exit(&ring->ring);
+        ring->~Ring();
+        core::aligned_free(ring);
+      }
     }
   }
 
-  /*
-  /// Invoked whenever a Linux AIO completes.
-  static void IoCompletionCallback(io_context_t ctx, struct iocb* iocb, long res, long res2);
-  */
   struct IoCallbackContext {
-    IoCallbackContext(bool is_read, int fd, uint8_t* buffer, size_t length, size_t offset, core::IAsyncContext* context_, core::AsyncIOCallback callback_)
+    IoCallbackContext(bool is_read, int fd, int file_index, bool direct, uint8_t* buffer,
+                      size_t length, size_t offset, core::IAsyncContext* context_,
+                      core::AsyncIOCallback callback_)
       : is_read_(is_read)
       , fd_(fd)
+      , file_index_(file_index)
+      , direct_(direct)
       , vec_{buffer, length}
       , offset_(offset)
+      , retried_(false)
       , caller_context{ context_ }
-      , callback{ callback_ } {}
+      , callback{ callback_ }
+      , io_queue{ nullptr }
+      , issue_ns{ 0 } {}
 
     bool is_read_;
 
     int fd_;
+    /// The file's index in the fixed file table, or -1.
+    int file_index_;
+    /// The file was opened with O_DIRECT.
+    bool direct_;
     struct iovec vec_;
     size_t offset_;
+    bool retried_;
 
     /// Caller callback context.
     core::IAsyncContext* caller_context;
 
     /// The caller's asynchronous callback function
     core::AsyncIOCallback callback;
+
+    /// Set while a read counts against the queue's limit, i.e., from its submission on (and
+    /// through any retry).
+    core::IoQueueController* io_queue;
+    uint64_t issue_ns;
   };
 
-  inline struct io_uring* io_uring() const {
-    return ring_;
-  }
+  /// Queues an I/O on one of the calling thread's rings.
+  core::Status Schedule(IoCallbackContext* context);
 
-  inline SpinLock* sq_lock() {
-    return &sq_lock_;
-  }
+  /// Submits the I/Os queued on the calling thread's rings.
+  void Submit();
 
-  /// Try to execute the next IO completion on the queue, if any.
+  /// Try to execute the next IO completions on the queues, if any.
   bool TryComplete();
 
+  /// Registers an open file with every ring. Returns its index in the fixed file table, or -1 if
+  /// the table is full.
+  int RegisterFile(int fd);
+  void UnregisterFile(int file_index);
+
+  /// Registers a buffer that stays allocated for the handler's lifetime with every ring.
+  void RegisterBuffer(uint8_t* buffer, uint32_t length);
+
+  /// Counts the reads this handler submits against "io_queue"'s limit.
+  void SetIoQueue(core::IoQueueController* io_queue) {
+    io_queue_ = io_queue;
+    io_queue_->SetSubmitBatch(kSubmitBatch);
+  }
+
  private:
-  /// The io_uring for all the I/Os
-  struct io_uring* ring_;
-  SpinLock sq_lock_, cq_lock_;
+  void Initialize();
+  /// The calling thread's ring (polled or not), created on first use.
+  Ring* GetRing(bool io_poll);
+  Ring* GetRing(const IoCallbackContext* context) {
+    return GetRing(context->direct_ && io_poll_.load(std::memory_order_relaxed));
+  }
+  /// Returns the fixed buffer index of "buffer", or -1.
+  int FindBuffer(const uint8_t* buffer, size_t length) const;
+  void Prepare(Ring* ring, IoCallbackContext* context);
+  /// Submits the I/Os queued on "ring", counting its reads against the queue's limit. Returns
+  /// io_uring_submit()'s result.
+  int SubmitRing(Ring* ring);
+  /// Reaps up to kMaxEvents completions from "ring". Returns true if any I/O completed.
+  bool Reap(Ring* ring, bool wait_for_lock);
+
+  UringConfig config_;
+  /// Cleared if the file system does not support IOPOLL.
+  std::atomic<bool> io_poll_;
+  core::IoQueueController* io_queue_;
+
+  /// Thread "t"'s rings are 2 * t and, with IOPOLL, 2 * t + 1.
+  std::atomic<Ring*> rings_[kNumRings];
+
+  /// Guards the registration tables, and the set of rings they are registered with.
+  std::mutex registry_mutex_;
+  /// The first SQPOLL ring, whose poll thread the others share (IORING_SETUP_ATTACH_WQ).
+  int sq_poll_fd_;
+  int files_[kMaxRegisteredFiles];
+  struct iovec buffers_[kMaxRegisteredBuffers];
+  uint32_t num_buffers_;
+  /// Open addressing, keyed by buffer address; read without the lock.
+  BufferEntry buffer_table_[kBufferTableSize];
 };
 
 /// The UringFile class encapsulates asynchronous reads and writes, using the specified
-/// io_uring
+/// io_uring handler.
 class UringFile : public File {
  public:
   UringFile()
     : File()
-    , ring_{ nullptr } {
+    , handler_{ nullptr }
+    , file_index_{ -1 }
+    , direct_{ false } {
   }
   UringFile(const std::string& filename)
     : File(filename)
-    , ring_{ nullptr } {
+    , handler_{ nullptr }
+    , file_index_{ -1 }
+    , direct_{ false } {
   }
   /// Move constructor
   UringFile(UringFile&& other)
     : File(std::move(other))
-    , ring_{ other.ring_ }
-    , sq_lock_{ other.sq_lock_ } {
+    , handler_{ other.handler_ }
+    , file_index_{ other.file_index_ }
+    , direct_{ other.direct_ } {
+    other.file_index_ = -1;
   }
   /// Move assignment operator.
   UringFile& operator=(UringFile&& other) {
     File::operator=(std::move(other));
-    ring_ = other.ring_;
-    sq_lock_ = other.sq_lock_;
+    handler_ = other.handler_;
+    file_index_ = other.file_index_;
+    direct_ = other.direct_;
+    other.file_index_ = -1;
     return *this;
   }
 
+  ~UringFile() {
+    Unregister();
+  }
+
   core::Status Open(FileCreateDisposition create_disposition, const FileOptions& options,
               UringIoHandler* handler, bool* exists = nullptr);
+  core::Status Close() {
+    Unregister();
+    return File::Close();
+  }
 
   core::Status Read(size_t offset, uint32_t length, uint8_t* buffer,
               core::IAsyncContext& context, core::AsyncIOCallback callback) const;
@@ -400,8 +645,17 @@ class UringFile : public File {
   core::Status ScheduleOperation(FileOperationType operationType, uint8_t* buffer, size_t offset,
                                  uint32_t length, core::IAsyncContext& context, core::AsyncIOCallback callback);
 
-  struct io_uring* ring_;
-  SpinLock* sq_lock_;
+  /// Removes the file from the rings' fixed file tables, before it is closed.
+  void Unregister() {
+    if(file_index_ != -1) {
+      handler_->UnregisterFile(file_index_);
+      file_index_ = -1;
+    }
+  }
+
+  UringIoHandler* handler_;
+  int file_index_;
+  bool direct_;
 };
 
 #endif
@@ -14,6 +14,7 @@
 #include <string>
 
 #include "../core/async.h"
+#include "../core/io_queue_controller.h"
 #include "../core/status.h"
 #include "file_common.h"
 
@@ -226,16 +227,19 @@ class ThreadPoolIoHandler {
   typedef ThreadPoolFile async_file_t;
 
   ThreadPoolIoHandler()
-    : threadpool_{} {
+    : threadpool_{}
+    , io_queue_{ nullptr } {
   }
 
   ThreadPoolIoHandler(size_t max_threads)
-    : threadpool_{ max_threads } {
+    : threadpool_{ max_threads }
+    , io_queue_{ nullptr } {
   }
 
   /// Move constructor.
   ThreadPoolIoHandler(ThreadPoolIoHandler&& other)
-    : threadpool_{ std::move(other.threadpool_) } {
+    : threadpool_{ std::move(other.threadpool_) }
+    , io_queue_{ other.io_queue_ } {
   }
 
   /// Invoked whenever an asynchronous IO completes; needed because Windows asynchronous IOs are
@@ -252,7 +256,9 @@ class ThreadPoolIoHandler {
   struct IoCallbackContext {
     IoCallbackContext(size_t offset, core::IAsyncContext* context_, core::AsyncIOCallback callback_)
       : caller_context{ context_ }
-      , callback{ callback_ } {
+      , callback{ callback_ }
+      , io_queue{ nullptr }
+      , issue_ns{ 0 } {
       ::memset(&parent_overlapped, 0, sizeof(parent_overlapped));
       parent_overlapped.Offset = offset & 0xffffffffllu;
       parent_overlapped.OffsetHigh = offset >> 32;
@@ -267,15 +273,33 @@ class ThreadPoolIoHandler {
     core::IAsyncContext* caller_context;
     /// The caller's asynchronous callback function
     core::AsyncIOCallback callback;
+    /// Set while a read counts against the queue's limit, i.e., from its submission on.
+    core::IoQueueController* io_queue;
+    uint64_t issue_ns;
   };
 
   inline static constexpr bool TryComplete() {
     return false;
   }
 
+  inline static void Submit() {
+  }
+
+  inline static void RegisterBuffer(uint8_t* buffer, uint32_t length) {
+  }
+
+  /// Counts the reads this handler submits against "io_queue"'s limit.
+  inline void SetIoQueue(core::IoQueueController* io_queue) {
+    io_queue_ = io_queue;
+  }
+  inline core::IoQueueController* io_queue() const {
+    return io_queue_;
+  }
+
  private:
   /// The parent threadpool.
   WindowsPtpThreadPool threadpool_;
+  core::IoQueueController* io_queue_;
 };
 
 /// The QueueIoHandler class encapsulates completions for async file I/O, where the completions
@@ -285,17 +309,20 @@ class QueueIoHandler {
   typedef QueueFile async_file_t;
 
   QueueIoHandler()
-    : io_completion_port_{ INVALID_HANDLE_VALUE } {
+    : io_completion_port_{ INVALID_HANDLE_VALUE }
+    , io_queue_{ nullptr } {
   }
   QueueIoHandler(size_t max_threads)
-    : io_completion_port_{ 0 } {
+    : io_completion_port_{ 0 }
+    , io_queue_{ nullptr } {
     io_completion_port_ = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0,
                           (DWORD)core::Thread::kMaxNumThreads);
   }
 
   /// Move constructor
   QueueIoHandler(QueueIoHandler&& other)
-    : io_completion_port_{ other.io_completion_port_ } {
+    : io_completion_port_{ other.io_completion_port_ }
+    , io_queue_{ other.io_queue_ } {
     other.io_completion_port_ = INVALID_HANDLE_VALUE;
   }
 
@@ -314,7 +341,9 @@ class QueueIoHandler {
   struct IoCallbackContext {
     IoCallbackContext(size_t offset, core::IAsyncContext* context_, core::AsyncIOCallback callback_)
       : caller_context{ context_ }
-      , callback{ callback_ } {
+      , callback{ callback_ }
+      , io_queue{ nullptr }
+      , issue_ns{ 0 } {
       ::memset(&parent_overlapped, 0, sizeof(parent_overlapped));
       parent_overlapped.Offset = offset & 0xffffffffllu;
       parent_overlapped.OffsetHigh = offset >> 32;
@@ -329,13 +358,32 @@ class QueueIoHandler {
     core::IAsyncContext* caller_context;
     /// The caller's asynchronous callback function
     core::AsyncIOCallback callback;
+    /// Set while a read counts against the queue's limit, i.e., from its submission on.
+    core::IoQueueController* io_queue;
+    uint64_t issue_ns;
   };
 
   bool TryComplete();
 
+  /// I/Os are submitted as they are scheduled.
+  inline void Submit() {
+  }
+
+  inline void RegisterBuffer(uint8_t* buffer, uint32_t length) {
+  }
+
+  /// Counts the reads this handler submits against "io_queue"'s limit.
+  inline void SetIoQueue(core::IoQueueController* io_queue) {
+    io_queue_ = io_queue;
+  }
+  inline core::IoQueueController* io_queue() const {
+    return io_queue_;
+  }
+
  private:
   /// The completion port to whose queue completions are added.
   HANDLE io_completion_port_;
+  core::IoQueueController* io_queue_;
 };
 
 /// The ThreadPoolFile class encapsulates asynchronous reads and writes, where the OS schedules the
@@ -344,24 +392,28 @@ class ThreadPoolFile : public File {
  public:
   ThreadPoolFile()
     : File()
-    , io_object_{ nullptr } {
+    , io_object_{ nullptr }
+    , handler_{ nullptr } {
   }
 
   ThreadPoolFile(const std::string& filename)
     : File(filename)
-    , io_object_{ nullptr } {
+    , io_object_{ nullptr }
+    , handler_{ nullptr } {
   }
 
   /// Move constructor
   ThreadPoolFile(ThreadPoolFile&& other)
     : File(std::move(other))
-    , io_object_{ other.io_object_} {
+    , io_object_{ other.io_object_}
+    , handler_{ other.handler_ } {
   }
 
   /// Move assignment operator.
   ThreadPoolFile& operator=(ThreadPoolFile&& other) {
     File::operator=(std::move(other));
     io_object_ = other.io_object_;
+    handler_ = other.handler_;
     return *this;
   }
 
@@ -378,6 +430,7 @@ class ThreadPoolFile : public File {
                            uint32_t length, core::IAsyncContext& context, core::AsyncIOCallback callback);
 
   PTP_IO io_object_;
+  ThreadPoolIoHandler* handler_;
 };
 
 /// The QueueFile class encapsulates asynchronous reads and writes, where the IO completions are
@@ -385,19 +438,23 @@ class ThreadPoolFile : public File {
 class QueueFile : public File {
  public:
   QueueFile()
-    : File() {
+    : File()
+    , handler_{ nullptr } {
   }
   QueueFile(const std::string& filename)
-    : File(filename) {
+    : File(filename)
+    , handler_{ nullptr } {
   }
   /// Move constructor
   QueueFile(QueueFile&& other)
-    : File(std::move(other)) {
+    : File(std::move(other))
+    , handler_{ other.handler_ } {
   }
 
   /// Move assignment operator.
   QueueFile& operator=(QueueFile&& other) {
     File::operator=(std::move(other));
+    handler_ = other.handler_;
     return *this;
   }
 
@@ -412,6 +469,8 @@ class QueueFile : public File {
  private:
   core::Status ScheduleOperation(FileOperationType operationType, uint8_t* buffer, size_t offset,
                            uint32_t length, core::IAsyncContext& context, core::AsyncIOCallback callback);
+
+  QueueIoHandler* handler_;
 };
 
 }
@@ -0,0 +1,138 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <cstdint>
+#include <cstring>
+#include <experimental/filesystem>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "faster_c.h"
+#include "core/status.h"
+
+using FASTER::core::Status;
+
+static constexpr uint64_t kTableSize = 1 << 14;
+static constexpr uint64_t kMB = 1 << 20;
+static constexpr uint64_t kRowLength = 1024;
+/// Leaves a store on disk the four immutable pages it needs, with the default mutable fraction.
+static constexpr uint64_t kLogSize = 512 * kMB;
+
+/// Fills a row with values that depend on its key.
+static void fill_row(uint64_t key, std::vector<uint8_t>& row) {
+  for(uint64_t idx = 0; idx < row.size(); ++idx) {
+    row[idx] = static_cast<uint8_t>(key * 31 + idx);
+  }
+}
+
+/// Reads a row back, waiting for it if it is on disk.
+static uint8_t read_row(faster_t* store, uint64_t key, std::vector<uint8_t>& row) {
+  uint8_t result = mlkv_read(store, key, row.data(), row.size());
+  if(result == static_cast<uint8_t>(Status::Pending)) {
+    faster_complete_pending(store, true);
+    result = static_cast<uint8_t>(Status::Ok);
+  }
+  return result;
+}
+
+TEST(FasterC, OpenExInvalid) {
+  std::experimental::filesystem::remove_all("logs");
+  faster_options options{};
+
+  options.io_backend = 7;
+  ASSERT_EQ(nullptr, faster_open_ex(kTableSize, kLogSize, "logs", &options, nullptr));
+
+  options = faster_options{};
+  options.segment_size = 48 * kMB;
+  ASSERT_EQ(nullptr, faster_open_ex(kTableSize, kLogSize, "logs", &options, nullptr));
+
+  // Rejected by the store's constructor, rather than by the options.
+  options = faster_options{};
+  ASSERT_EQ(nullptr, faster_open_ex(kTableSize, 100 * kMB, "logs", &options, nullptr));
+  options.mutable_fraction = 0.1;
+  ASSERT_EQ(nullptr, faster_open_ex(kTableSize, kLogSize, "logs", &options, nullptr));
+
+  options = faster_options{};
+  options.io_backend = FASTER_IO_NULL;
+  ASSERT_EQ(nullptr, faster_recover_ex(kTableSize, kLogSize, "logs",
+                                       "00000000-0000-0000-0000-000000000000", &options));
+  options.io_backend = FASTER_IO_LIBAIO;
+  ASSERT_EQ(nullptr, faster_recover_ex(kTableSize, kLogSize, "logs",
+                                       "00000000-0000-0000-0000-000000000000", &options));
+}
+
+TEST(FasterC, NullBackendFull) {
+  faster_options options{};
+  options.io_backend = FASTER_IO_NULL;
+  faster_t* store = faster_open_ex(kTableSize, 256 * kMB, "", &options, nullptr);
+  ASSERT_NE(nullptr, store);
+
+  faster_start_session(store);
+  std::vector<uint8_t> row(kRowLength);
+  uint64_t num_rows = 0;
+  uint8_t result;
+  // The log holds at most 256 MB of rows.
+  for(; num_rows < 256 * kMB / kRowLength; ++num_rows) {
+    fill_row(num_rows, row);
+    result = mlkv_upsert(store, num_rows, row.data(), row.size());
+    if(result != static_cast<uint8_t>(Status::Ok)) {
+      break;
+    }
+  }
+  ASSERT_EQ(static_cast<uint8_t>(Status::OutOfMemory), result);
+  ASSERT_GT(num_rows, 0);
+
+  // Every row written is still in memory, rather than read back from the null disk.
+  std::vector<uint8_t> expected(kRowLength);
+  for(uint64_t key = 0; key < num_rows; ++key) {
+    fill_row(key, expected);
+    ASSERT_EQ(static_cast<uint8_t>(Status::Ok), read_row(store, key, row));
+    ASSERT_EQ(expected, row);
+  }
+  faster_stop_session(store);
+  faster_destroy(store);
+}
+
+TEST(FasterC, RecoverExSegmentSize) {
+  std::experimental::filesystem::remove_all("logs");
+  faster_options options{};
+  options.segment_size = 32 * kMB;
+  faster_t* store = faster_open_ex(kTableSize, kLogSize, "logs", &options, nullptr);
+  ASSERT_NE(nullptr, store);
+
+  // Enough rows to span a few segments.
+  static constexpr uint64_t kNumRows = 80 * kMB / kRowLength;
+  std::vector<uint8_t> row(kRowLength);
+  faster_start_session(store);
+  for(uint64_t key = 0; key < kNumRows; ++key) {
+    fill_row(key, row);
+    ASSERT_EQ(static_cast<uint8_t>(Status::Ok), mlkv_upsert(store, key, row.data(), row.size()));
+  }
+  faster_stop_session(store);
+  ASSERT_TRUE(faster_checkpoint(store));
+  faster_destroy(store);
+  ASSERT_TRUE(std::experimental::filesystem::exists("logs/log.log2"));
+
+  std::string token;
+  for(auto& entry : std::experimental::filesystem::directory_iterator("logs/cpr-checkpoints")) {
+    token = entry.path().filename().string();
+  }
+  store = faster_recover_ex(kTableSize, kLogSize, "logs", token.c_str(), &options);
+  ASSERT_NE(nullptr, store);
+
+  std::vector<uint8_t> expected(kRowLength);
+  faster_start_session(store);
+  for(uint64_t key = 0; key < kNumRows; key += 97) {
+    fill_row(key, expected);
+    ASSERT_EQ(static_cast<uint8_t>(Status::Ok), read_row(store, key, row));
+    ASSERT_EQ(expected, row);
+  }
+  faster_stop_session(store);
+  faster_destroy(store);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -909,6 +909,141 @@ TEST(InMemFaster, Rmw) {
   store.StopSession();
 }
 
+TEST(InMemFaster, Rmw_NoInitial) {
+  using Key = FixedSizeKey<uint64_t>;
+  using Value = SimpleAtomicValue<uint32_t>;
+
+  class RmwContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    RmwContext(uint64_t key, int32_t incr, bool create)
+      : key_{ key }
+      , incr_{ incr }
+      , create_{ create } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    RmwContext(const RmwContext& other)
+      : key_{ other.key_ }
+      , incr_{ other.incr_ }
+      , create_{ other.create_ } {
+    }
+
+    /// The implicit and explicit interfaces require a key() accessor.
+    inline const Key& key() const {
+      return key_;
+    }
+    inline static constexpr uint32_t value_size() {
+      return sizeof(value_t);
+    }
+    inline static constexpr uint32_t value_size(const Value& old_value) {
+      return sizeof(value_t);
+    }
+    inline bool RmwInitialAllowed() const {
+      return create_;
+    }
+    inline void RmwInitial(Value& value) {
+      ASSERT_TRUE(create_);
+      value.value = incr_;
+    }
+    inline void RmwCopy(const Value& old_value, Value& value) {
+      value.value = old_value.value + incr_;
+    }
+    inline bool RmwAtomic(Value& value) {
+      value.atomic_value.fetch_add(incr_);
+      return true;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    int32_t incr_;
+    bool create_;
+  };
+
+  class ReadContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    ReadContext(uint64_t key)
+      : key_{ key } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    ReadContext(const ReadContext& other)
+      : key_{ other.key_ } {
+    }
+
+    /// The implicit and explicit interfaces require a key() accessor.
+    inline const Key& key() const {
+      return key_;
+    }
+
+    inline void Get(const Value& value) {
+      // All reads should be atomic (from the mutable tail).
+      ASSERT_TRUE(false);
+    }
+    inline void GetAtomic(const Value& value) {
+      output = value.atomic_value.load();
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+   public:
+    int32_t output;
+  };
+
+  FasterKv<Key, Value, FASTER::device::NullDisk> store{ 256, 1073741824, "" };
+
+  store.StartSession();
+
+  auto callback = [](IAsyncContext* ctxt, Status result) {
+    // In-memory test.
+    ASSERT_TRUE(false);
+  };
+  // A context that does not create records finds nothing to update.
+  for(size_t idx = 0; idx < 512; ++idx) {
+    RmwContext context{ idx, 1, false };
+    ASSERT_EQ(Status::NotFound, store.Rmw(context, callback, 1));
+  }
+  // Create the even keys.
+  for(size_t idx = 0; idx < 512; idx += 2) {
+    RmwContext context{ idx, 1, true };
+    ASSERT_EQ(Status::Ok, store.Rmw(context, callback, 1));
+  }
+  // Now it updates those, and still finds nothing for the odd keys.
+  for(size_t idx = 0; idx < 512; ++idx) {
+    RmwContext context{ idx, 1, false };
+    ASSERT_EQ(idx % 2 == 0 ? Status::Ok : Status::NotFound, store.Rmw(context, callback, 1));
+  }
+  for(size_t idx = 0; idx < 512; ++idx) {
+    ReadContext context{ idx };
+    Status result = store.Read(context, callback, 1);
+    if(idx % 2 == 0) {
+      ASSERT_EQ(Status::Ok, result);
+      ASSERT_EQ(2, context.output);
+    } else {
+      ASSERT_EQ(Status::NotFound, result);
+    }
+  }
+
+  store.StopSession();
+}
+
 TEST(InMemFaster, Rmw_Concurrent) {
   using Key = FixedSizeKey<uint64_t>;
   using Value = SimpleAtomicValue<int64_t>;
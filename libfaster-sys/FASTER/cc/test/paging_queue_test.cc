@@ -2,6 +2,7 @@
 // Licensed under the MIT license.
 
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <deque>
@@ -12,6 +13,9 @@
 #include "device/file_system_disk.h"
 
 using namespace FASTER::core;
+using FASTER::environment::FileCreateDisposition;
+using FASTER::environment::FileOptions;
+using FASTER::environment::QueueFile;
 
 typedef FASTER::environment::QueueIoHandler handler_t;
 
@@ -21,6 +25,85 @@ typedef FASTER::environment::QueueIoHandler handler_t;
 
 #undef CLASS
 
+/// A thread stages fewer reads than a batch and goes idle, without submitting them; another
+/// thread's TryComplete() still completes them.
+TEST(QueueIoHandler, IdleThreadStagedReads) {
+  class ReadContext : public IAsyncContext {
+   public:
+    ReadContext(std::atomic<uint32_t>* completed_)
+      : completed{ completed_ } {
+    }
+
+    /// The deep-copy constructor.
+    ReadContext(const ReadContext& other)
+      : completed{ other.completed } {
+    }
+
+   protected:
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) final {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   public:
+    std::atomic<uint32_t>* completed;
+  };
+
+  constexpr uint32_t kReadSize = 4096;
+  constexpr uint32_t kNumReads = 8;
+
+  std::experimental::filesystem::create_directories("logs");
+  handler_t handler{ 4 };
+  QueueFile file{ "logs/idle_thread_staged_reads.dat" };
+  ASSERT_EQ(Status::Ok, file.Open(FileCreateDisposition::CreateOrTruncate,
+                                  FileOptions{ true, false }, &handler));
+
+  std::atomic<uint32_t> completed{ 0 };
+  auto callback = [](IAsyncContext* ctxt, Status result, size_t bytes_transferred) {
+    CallbackContext<ReadContext> context{ ctxt };
+    ASSERT_EQ(Status::Ok, result);
+    ++*context->completed;
+  };
+  ReadContext context{ &completed };
+
+  uint8_t* buffer = reinterpret_cast<uint8_t*>(
+                      FASTER::core::aligned_alloc(kReadSize, kNumReads * kReadSize));
+  std::memset(buffer, 1, kNumReads * kReadSize);
+  ASSERT_EQ(Status::Ok, file.Write(0, kNumReads * kReadSize, buffer, context, callback));
+  while(completed.load() < 1) {
+    handler.TryComplete();
+  }
+  completed = 0;
+
+  std::atomic<bool> staged{ false };
+  std::atomic<bool> done{ false };
+  std::thread idle{ [&]() {
+    for(uint32_t idx = 0; idx < kNumReads; ++idx) {
+      ASSERT_EQ(Status::Ok, file.Read(idx * kReadSize, kReadSize, buffer + idx * kReadSize,
+                                      context, callback));
+    }
+    staged = true;
+    // Idle: no Submit() or TryComplete() from this thread.
+    while(!done) {
+      std::this_thread::sleep_for(std::chrono::milliseconds{ 1 });
+    }
+  } };
+  while(!staged) {
+    std::this_thread::yield();
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{ 10 };
+  while(completed.load() < kNumReads && std::chrono::steady_clock::now() < deadline) {
+    handler.TryComplete();
+  }
+  done = true;
+  idle.join();
+  ASSERT_EQ(kNumReads, completed.load());
+
+  FASTER::core::aligned_free(buffer);
+  ASSERT_EQ(Status::Ok, file.Close());
+  ASSERT_EQ(Status::Ok, file.Delete());
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -779,6 +779,934 @@ TEST(CLASS, Rmw) {
   store.StopSession();
 }
 
+TEST(CLASS, Rmw_ValueSizeHint) {
+  class Key {
+   public:
+    Key(uint64_t key)
+      : key_{ key } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Key));
+    }
+    inline KeyHash GetHash() const {
+      return KeyHash{ Utility::GetHashCode(key_) };
+    }
+
+    /// Comparison operators.
+    inline bool operator==(const Key& other) const {
+      return key_ == other.key_;
+    }
+    inline bool operator!=(const Key& other) const {
+      return key_ != other.key_;
+    }
+
+   private:
+    uint64_t key_;
+  };
+
+  class RmwContext;
+
+  class Value {
+   public:
+    Value()
+      : counter_{ 0 }
+      , junk_{ 1 } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Value));
+    }
+
+    friend class RmwContext;
+
+   private:
+    std::atomic<uint64_t> counter_;
+    uint8_t junk_[1016];
+  };
+  static_assert(sizeof(Value) == 1024, "sizeof(Value) != 1024");
+  static_assert(alignof(Value) == 8, "alignof(Value) != 8");
+
+  class RmwContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    RmwContext(Key key, uint64_t incr)
+      : key_{ key }
+      , incr_{ incr }
+      , val_{ 0 } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    RmwContext(const RmwContext& other)
+      : key_{ other.key_ }
+      , incr_{ other.incr_ }
+      , val_{ other.val_ } {
+    }
+
+    inline const Key& key() const {
+      return key_;
+    }
+    inline static constexpr uint32_t value_size() {
+      return sizeof(value_t);
+    }
+    inline static constexpr uint32_t value_size(const Value& old_value) {
+      return sizeof(value_t);
+    }
+    inline void RmwInitial(Value& value) {
+      value.counter_ = incr_;
+      val_ = value.counter_;
+    }
+    inline void RmwCopy(const Value& old_value, Value& value) {
+      value.counter_ = old_value.counter_ + incr_;
+      val_ = value.counter_;
+    }
+    inline bool RmwAtomic(Value& value) {
+      val_ = value.counter_.fetch_add(incr_) + incr_;
+      return true;
+    }
+
+    inline uint64_t val() const {
+      return val_;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t incr_;
+
+    uint64_t val_;
+  };
+
+  std::experimental::filesystem::create_directories("logs");
+
+  // 8 pages!
+  FasterKv<Key, Value, disk_t> store{ 262144, 268435456, "logs", 0.5 };
+
+  // The first read of a record from disk fetches the whole record.
+  store.SetValueSizeHint(Value::size());
+
+  Guid session_id = store.StartSession();
+
+  constexpr size_t kNumRecords = 200000;
+
+  // Initial RMW.
+  static std::atomic<uint64_t> records_touched{ 0 };
+  for(size_t idx = 0; idx < kNumRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<RmwContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+      ASSERT_EQ(3, context->val());
+      ++records_touched;
+    };
+
+    if(idx % 256 == 0) {
+      store.Refresh();
+    }
+
+    RmwContext context{ Key{ idx }, 3 };
+    Status result = store.Rmw(context, callback, 1);
+    if(result == Status::Ok) {
+      ASSERT_EQ(3, context.val());
+      ++records_touched;
+    } else {
+      ASSERT_EQ(Status::Pending, result);
+    }
+  }
+
+  bool result = store.CompletePending(true);
+  ASSERT_TRUE(result);
+  ASSERT_EQ(kNumRecords, records_touched.load());
+
+  // Second RMW.
+  records_touched = 0;
+  for(size_t idx = kNumRecords; idx > 0; --idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<RmwContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+      ASSERT_EQ(8, context->val());
+      ++records_touched;
+    };
+
+    if(idx % 256 == 0) {
+      store.Refresh();
+    }
+
+    RmwContext context{ Key{ idx - 1 }, 5 };
+    Status result = store.Rmw(context, callback, 1);
+    if(result == Status::Ok) {
+      ASSERT_EQ(8, context.val()) << idx - 1;
+      ++records_touched;
+    } else {
+      ASSERT_EQ(Status::Pending, result);
+    }
+  }
+
+  ASSERT_LT(records_touched.load(), kNumRecords);
+  result = store.CompletePending(true);
+  ASSERT_TRUE(result);
+  ASSERT_EQ(kNumRecords, records_touched.load());
+
+  // A hint smaller than the records falls back to reading the rest of each record.
+  store.SetValueSizeHint(Value::size() / 2);
+
+  // Third RMW.
+  records_touched = 0;
+  for(size_t idx = 0; idx < kNumRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<RmwContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+      ASSERT_EQ(15, context->val());
+      ++records_touched;
+    };
+
+    if(idx % 256 == 0) {
+      store.Refresh();
+    }
+
+    RmwContext context{ Key{ idx }, 7 };
+    Status result = store.Rmw(context, callback, 1);
+    if(result == Status::Ok) {
+      ASSERT_EQ(15, context.val()) << idx;
+      ++records_touched;
+    } else {
+      ASSERT_EQ(Status::Pending, result);
+    }
+  }
+
+  ASSERT_LT(records_touched.load(), kNumRecords);
+  result = store.CompletePending(true);
+  ASSERT_TRUE(result);
+  ASSERT_EQ(kNumRecords, records_touched.load());
+
+  store.StopSession();
+}
+
+TEST(CLASS, Rmw_ReadCache) {
+  class Key {
+   public:
+    Key(uint64_t key)
+      : key_{ key } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Key));
+    }
+    inline KeyHash GetHash() const {
+      return KeyHash{ Utility::GetHashCode(key_) };
+    }
+
+    /// Comparison operators.
+    inline bool operator==(const Key& other) const {
+      return key_ == other.key_;
+    }
+    inline bool operator!=(const Key& other) const {
+      return key_ != other.key_;
+    }
+
+   private:
+    uint64_t key_;
+  };
+
+  class RmwContext;
+  class ReadContext;
+
+  class Value {
+   public:
+    Value()
+      : counter_{ 0 }
+      , junk_{ 1 } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Value));
+    }
+
+    friend class RmwContext;
+    friend class ReadContext;
+
+   private:
+    std::atomic<uint64_t> counter_;
+    uint8_t junk_[1016];
+  };
+  static_assert(sizeof(Value) == 1024, "sizeof(Value) != 1024");
+  static_assert(alignof(Value) == 8, "alignof(Value) != 8");
+
+  class RmwContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    RmwContext(Key key, uint64_t incr)
+      : key_{ key }
+      , incr_{ incr }
+      , val_{ 0 } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    RmwContext(const RmwContext& other)
+      : key_{ other.key_ }
+      , incr_{ other.incr_ }
+      , val_{ other.val_ } {
+    }
+
+    inline const Key& key() const {
+      return key_;
+    }
+    inline static constexpr uint32_t value_size() {
+      return sizeof(value_t);
+    }
+    inline static constexpr uint32_t value_size(const Value& old_value) {
+      return sizeof(value_t);
+    }
+    inline void RmwInitial(Value& value) {
+      value.counter_ = incr_;
+      val_ = value.counter_;
+    }
+    inline void RmwCopy(const Value& old_value, Value& value) {
+      value.counter_ = old_value.counter_ + incr_;
+      val_ = value.counter_;
+    }
+    inline bool RmwAtomic(Value& value) {
+      val_ = value.counter_.fetch_add(incr_) + incr_;
+      return true;
+    }
+
+    inline uint64_t val() const {
+      return val_;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t incr_;
+
+    uint64_t val_;
+  };
+
+  class ReadContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    ReadContext(Key key)
+      : key_{ key }
+      , val_{ 0 } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    ReadContext(const ReadContext& other)
+      : key_{ other.key_ }
+      , val_{ other.val_ } {
+    }
+
+    inline const Key& key() const {
+      return key_;
+    }
+    inline void Get(const Value& value) {
+      val_ = value.counter_;
+    }
+    inline void GetAtomic(const Value& value) {
+      val_ = value.counter_.load();
+    }
+
+    inline uint64_t val() const {
+      return val_;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t val_;
+  };
+
+  std::experimental::filesystem::create_directories("logs");
+
+  // 8 pages!
+  FasterKv<Key, Value, disk_t> store{ 262144, 268435456, "logs", 0.5 };
+
+  // 4 MB: room for the hot records, but not for all of them.
+  store.SetReadCache(1 << 22);
+
+  Guid session_id = store.StartSession();
+
+  constexpr size_t kNumRecords = 300000;
+  constexpr size_t kNumHotRecords = 1000;
+
+  // Initial RMW: the oldest records, which include the hot ones, get evicted to disk.
+  static std::atomic<uint64_t> records_touched{ 0 };
+  for(size_t idx = 0; idx < kNumRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<RmwContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+      ASSERT_EQ(3, context->val());
+      ++records_touched;
+    };
+
+    if(idx % 256 == 0) {
+      store.Refresh();
+    }
+
+    RmwContext context{ Key{ idx }, 3 };
+    Status result = store.Rmw(context, callback, 1);
+    if(result == Status::Ok) {
+      ASSERT_EQ(3, context.val());
+      ++records_touched;
+    } else {
+      ASSERT_EQ(Status::Pending, result);
+    }
+  }
+
+  bool result = store.CompletePending(true);
+  ASSERT_TRUE(result);
+  ASSERT_EQ(kNumRecords, records_touched.load());
+
+  // The first read of a hot record goes to disk, and admits it into the read cache.
+  records_touched = 0;
+  for(size_t idx = 0; idx < kNumHotRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<ReadContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+      ASSERT_EQ(3, context->val());
+      ++records_touched;
+    };
+
+    ReadContext context{ Key{ idx } };
+    Status result = store.Read(context, callback, 1);
+    ASSERT_EQ(Status::Pending, result) << idx;
+  }
+  result = store.CompletePending(true);
+  ASSERT_TRUE(result);
+  ASSERT_EQ(kNumHotRecords, records_touched.load());
+  ASSERT_EQ(kNumHotRecords, store.GetReadCacheStats().admissions);
+
+  // Later reads are served from the cache, without I/O.
+  for(size_t idx = 0; idx < kNumHotRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      ASSERT_TRUE(false);
+    };
+
+    ReadContext context{ Key{ idx } };
+    Status result = store.Read(context, callback, 1);
+    ASSERT_EQ(Status::Ok, result) << idx;
+    ASSERT_EQ(3, context.val());
+  }
+  ASSERT_EQ(kNumHotRecords, store.GetReadCacheStats().hits);
+
+  // So are RMWs' reads of the old value; the new value goes to the tail of the log.
+  for(size_t idx = 0; idx < kNumHotRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      ASSERT_TRUE(false);
+    };
+
+    RmwContext context{ Key{ idx }, 5 };
+    Status result = store.Rmw(context, callback, 1);
+    ASSERT_EQ(Status::Ok, result) << idx;
+    ASSERT_EQ(8, context.val());
+  }
+
+  // Reads now find the new value, not the cached one.
+  for(size_t idx = 0; idx < kNumHotRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      ASSERT_TRUE(false);
+    };
+
+    ReadContext context{ Key{ idx } };
+    Status result = store.Read(context, callback, 1);
+    ASSERT_EQ(Status::Ok, result) << idx;
+    ASSERT_EQ(8, context.val());
+  }
+
+  // Reading every cold record cycles the cache, without losing any values.
+  records_touched = 0;
+  for(size_t idx = kNumHotRecords; idx < kNumRecords; ++idx) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<ReadContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+      ASSERT_EQ(3, context->val());
+      ++records_touched;
+    };
+
+    if(idx % 256 == 0) {
+      store.Refresh();
+      store.CompletePending(false);
+    }
+
+    ReadContext context{ Key{ idx } };
+    Status result = store.Read(context, callback, 1);
+    if(result == Status::Ok) {
+      ASSERT_EQ(3, context.val());
+      ++records_touched;
+    } else {
+      ASSERT_EQ(Status::Pending, result);
+    }
+  }
+  result = store.CompletePending(true);
+  ASSERT_TRUE(result);
+  ASSERT_EQ(kNumRecords - kNumHotRecords, records_touched.load());
+  ASSERT_GT(store.GetReadCacheStats().evicted_bytes, 0);
+
+  store.StopSession();
+}
+
+TEST(CLASS, Read_Promotion) {
+  class Key {
+   public:
+    Key(uint64_t key)
+      : key_{ key } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Key));
+    }
+    inline KeyHash GetHash() const {
+      return KeyHash{ Utility::GetHashCode(key_) };
+    }
+
+    /// Comparison operators.
+    inline bool operator==(const Key& other) const {
+      return key_ == other.key_;
+    }
+    inline bool operator!=(const Key& other) const {
+      return key_ != other.key_;
+    }
+
+   private:
+    uint64_t key_;
+  };
+
+  class RmwContext;
+  class ReadContext;
+
+  class Value {
+   public:
+    Value()
+      : counter_{ 0 }
+      , junk_{ 1 } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Value));
+    }
+
+    friend class RmwContext;
+    friend class ReadContext;
+
+   private:
+    std::atomic<uint64_t> counter_;
+    uint8_t junk_[1016];
+  };
+  static_assert(sizeof(Value) == 1024, "sizeof(Value) != 1024");
+  static_assert(alignof(Value) == 8, "alignof(Value) != 8");
+
+  class RmwContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    RmwContext(Key key, uint64_t incr)
+      : key_{ key }
+      , incr_{ incr }
+      , val_{ 0 } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    RmwContext(const RmwContext& other)
+      : key_{ other.key_ }
+      , incr_{ other.incr_ }
+      , val_{ other.val_ } {
+    }
+
+    inline const Key& key() const {
+      return key_;
+    }
+    inline static constexpr uint32_t value_size() {
+      return sizeof(value_t);
+    }
+    inline static constexpr uint32_t value_size(const Value& old_value) {
+      return sizeof(value_t);
+    }
+    inline void RmwInitial(Value& value) {
+      value.counter_ = incr_;
+      val_ = value.counter_;
+    }
+    inline void RmwCopy(const Value& old_value, Value& value) {
+      value.counter_ = old_value.counter_ + incr_;
+      val_ = value.counter_;
+    }
+    inline bool RmwAtomic(Value& value) {
+      val_ = value.counter_.fetch_add(incr_) + incr_;
+      return true;
+    }
+
+    inline uint64_t val() const {
+      return val_;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t incr_;
+
+    uint64_t val_;
+  };
+
+  class ReadContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    ReadContext(Key key)
+      : key_{ key }
+      , val_{ 0 } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    ReadContext(const ReadContext& other)
+      : key_{ other.key_ }
+      , val_{ other.val_ } {
+    }
+
+    inline const Key& key() const {
+      return key_;
+    }
+    inline void Get(const Value& value) {
+      val_ = value.counter_;
+    }
+    inline void GetAtomic(const Value& value) {
+      val_ = value.counter_.load();
+    }
+
+    inline uint64_t val() const {
+      return val_;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t val_;
+  };
+
+  std::experimental::filesystem::create_directories("logs");
+
+  // 8 pages, of which 2 are mutable: the read-only region holds up to 2 pages.
+  FasterKv<Key, Value, disk_t> store{ 262144, 268435456, "logs", 0.25 };
+
+  // Promote a record on its key's third read.
+  store.SetPromotion(1 << 16, 3);
+
+  Guid session_id = store.StartSession();
+
+  constexpr size_t kNumRecords = 300000;
+  constexpr size_t kNumHotRecords = 1000;
+
+  // Initial RMW: the oldest records, which include the hot ones, get evicted to disk.
+  static std::atomic<uint64_t> records_touched{ 0 };
+  auto rmw_new = [&](size_t begin, size_t end) {
+    records_touched = 0;
+    for(size_t idx = begin; idx < end; ++idx) {
+      auto callback = [](IAsyncContext* ctxt, Status result) {
+        CallbackContext<RmwContext> context{ ctxt };
+        ASSERT_EQ(Status::Ok, result);
+        ASSERT_EQ(3, context->val());
+        ++records_touched;
+      };
+
+      if(idx % 256 == 0) {
+        store.Refresh();
+      }
+
+      RmwContext context{ Key{ idx }, 3 };
+      Status result = store.Rmw(context, callback, 1);
+      if(result == Status::Ok) {
+        ASSERT_EQ(3, context.val());
+        ++records_touched;
+      } else {
+        ASSERT_EQ(Status::Pending, result);
+      }
+    }
+    bool result = store.CompletePending(true);
+    ASSERT_TRUE(result);
+    ASSERT_EQ(end - begin, records_touched.load());
+  };
+  rmw_new(0, kNumRecords);
+
+  auto read_hot = [&](Status expected) {
+    records_touched = 0;
+    for(size_t idx = 0; idx < kNumHotRecords; ++idx) {
+      auto callback = [](IAsyncContext* ctxt, Status result) {
+        CallbackContext<ReadContext> context{ ctxt };
+        ASSERT_EQ(Status::Ok, result);
+        ASSERT_EQ(3, context->val());
+        ++records_touched;
+      };
+
+      ReadContext context{ Key{ idx } };
+      Status result = store.Read(context, callback, 1);
+      ASSERT_EQ(expected, result) << idx;
+      if(result == Status::Ok) {
+        ASSERT_EQ(3, context.val());
+        ++records_touched;
+      }
+    }
+    bool result = store.CompletePending(true);
+    ASSERT_TRUE(result);
+    ASSERT_EQ(kNumHotRecords, records_touched.load());
+  };
+
+  // The first two reads of a hot record go to disk, and leave it there.
+  read_hot(Status::Pending);
+  read_hot(Status::Pending);
+  PromotionStats stats = store.GetPromotionStats();
+  ASSERT_EQ(2 * kNumHotRecords, stats.cold_records);
+  ASSERT_EQ(0, stats.disk_promotions);
+
+  // The third read promotes it to the tail of the log, so the fourth finds it in memory.
+  read_hot(Status::Pending);
+  ASSERT_EQ(kNumHotRecords, store.GetPromotionStats().disk_promotions);
+  read_hot(Status::Ok);
+
+  // Push the hot records into the read-only region.
+  rmw_new(kNumRecords, kNumRecords + 100000);
+  read_hot(Status::Ok);
+
+  // A maintenance pass promotes them again, and skips the cold records around them.
+  uint64_t promoted = store.PromoteHotRecords(UINT64_MAX);
+  ASSERT_EQ(kNumHotRecords, promoted);
+  stats = store.GetPromotionStats();
+  ASSERT_EQ(kNumHotRecords, stats.read_only_promotions);
+  ASSERT_GT(stats.cold_records, 2 * kNumHotRecords);
+  ASSERT_EQ(5 * kNumHotRecords, stats.sketch.additions);
+  ASSERT_GT(stats.sketch.sampled_keys, 0);
+  ASSERT_GE(stats.sketch.mean_overestimate, 0);
+
+  // The next pass starts where this one stopped.
+  ASSERT_EQ(0, store.PromoteHotRecords(UINT64_MAX));
+  read_hot(Status::Ok);
+
+  store.StopSession();
+}
+
+TEST(CLASS, Rmw_PinPage) {
+  class Key {
+   public:
+    Key(uint64_t key)
+      : key_{ key } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Key));
+    }
+    inline KeyHash GetHash() const {
+      return KeyHash{ Utility::GetHashCode(key_) };
+    }
+
+    /// Comparison operators.
+    inline bool operator==(const Key& other) const {
+      return key_ == other.key_;
+    }
+    inline bool operator!=(const Key& other) const {
+      return key_ != other.key_;
+    }
+
+   private:
+    uint64_t key_;
+  };
+
+  class RmwContext;
+
+  class Value {
+   public:
+    Value()
+      : counter_{ 0 }
+      , junk_{ 1 } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Value));
+    }
+
+    friend class RmwContext;
+
+   private:
+    std::atomic<uint64_t> counter_;
+    uint8_t junk_[1016];
+  };
+  static_assert(sizeof(Value) == 1024, "sizeof(Value) != 1024");
+  static_assert(alignof(Value) == 8, "alignof(Value) != 8");
+
+  class RmwContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    RmwContext(Key key, uint64_t incr)
+      : key_{ key }
+      , incr_{ incr } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    RmwContext(const RmwContext& other)
+      : key_{ other.key_ }
+      , incr_{ other.incr_ } {
+    }
+
+    inline const Key& key() const {
+      return key_;
+    }
+    inline static constexpr uint32_t value_size() {
+      return sizeof(value_t);
+    }
+    inline static constexpr uint32_t value_size(const Value& old_value) {
+      return sizeof(value_t);
+    }
+    inline void RmwInitial(Value& value) {
+      value.counter_ = incr_;
+    }
+    inline void RmwCopy(const Value& old_value, Value& value) {
+      value.counter_ = old_value.counter_ + incr_;
+    }
+    inline bool RmwAtomic(Value& value) {
+      value.counter_.fetch_add(incr_);
+      return true;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t incr_;
+  };
+
+  std::experimental::filesystem::create_directories("logs");
+
+  // 8 pages!
+  typedef FasterKv<Key, Value, disk_t> faster_t;
+  faster_t store{ 262144, 268435456, "logs", 0.25 };
+
+  Guid session_id = store.StartSession();
+
+  // Inserts new records until the tail reaches "page".
+  uint64_t next_key = 0;
+  auto insert_until = [&](uint32_t page) {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<RmwContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+    };
+    while(store.hlog.GetTailAddress().page() < page) {
+      if(next_key % 256 == 0) {
+        store.Refresh();
+      }
+      RmwContext context{ Key{ next_key++ }, 1 };
+      Status result = store.Rmw(context, callback, 1);
+      ASSERT_TRUE(result == Status::Ok || result == Status::Pending);
+    }
+    ASSERT_TRUE(store.CompletePending(true));
+    // The head cannot pass pages still being flushed; let the flushes catch up.
+    while(store.hlog.flushed_until_address.load() < store.hlog.read_only_address.load()) {
+      store.CompletePending(false);
+    }
+  };
+
+  insert_until(10);
+  Address pinned = store.hlog.GetTailAddress();
+  uint64_t first_pinned_key = next_key;
+  store.hlog.PinPage(pinned);
+
+  // Without the pin, the head would pass the pinned page by kMaxPinnedHeadPages pages.
+  uint32_t head_lag = store.hlog.buffer_size() - faster_t::hlog_t::kNumHeadPages;
+  insert_until(pinned.page() + head_lag);
+  insert_until(pinned.page() + head_lag + faster_t::hlog_t::kMaxPinnedHeadPages);
+  ASSERT_LE(store.hlog.head_address.load().page(), pinned.page());
+  ASSERT_EQ(0, store.hlog.pinned_pages_closed());
+
+  // The first record on the pinned page is still in memory.
+  {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      ASSERT_TRUE(false);
+    };
+    RmwContext context{ Key{ first_pinned_key }, 1 };
+    ASSERT_EQ(Status::Ok, store.Rmw(context, callback, 1));
+  }
+
+  // But the pin cannot hold the head back by more than kMaxPinnedHeadPages.
+  for(uint32_t page = 1; page <= 3; ++page) {
+    insert_until(pinned.page() + head_lag + faster_t::hlog_t::kMaxPinnedHeadPages + page);
+  }
+  ASSERT_GT(store.hlog.head_address.load().page(), pinned.page());
+  ASSERT_EQ(1, store.hlog.pinned_pages_closed());
+
+  // Pins are counted per logical page: the page that reuses the closed page's buffer slot is not
+  // pinned, and unpinning the closed page leaves the new page's pins alone.
+  insert_until(pinned.page() + store.hlog.buffer_size());
+  Address reused = store.hlog.GetTailAddress();
+  ASSERT_EQ(pinned.page() + store.hlog.buffer_size(), reused.page());
+  ASSERT_FALSE(store.hlog.IsPinned(reused.page()));
+  store.hlog.PinPage(reused);
+  store.hlog.UnpinPage(pinned);
+  ASSERT_TRUE(store.hlog.IsPinned(reused.page()));
+  store.hlog.UnpinPage(reused);
+  ASSERT_FALSE(store.hlog.IsPinned(reused.page()));
+
+  // Reserving pinned pages lets a pin hold the head back further, up to the immutable region.
+  // (2 of the 8 pages are mutable.)
+  uint32_t num_pinned_pages = store.hlog.buffer_size() - 2 -
+                              (faster_t::hlog_t::kNumHeadPages -
+                               faster_t::hlog_t::kMaxPinnedHeadPages);
+  ASSERT_EQ(num_pinned_pages, store.hlog.ReservePinnedHeadPages(1000));
+  pinned = store.hlog.GetTailAddress();
+  first_pinned_key = next_key;
+  store.hlog.PinPage(pinned);
+  head_lag = store.hlog.buffer_size() - faster_t::hlog_t::kNumHeadPages -
+             (num_pinned_pages - faster_t::hlog_t::kMaxPinnedHeadPages);
+  insert_until(pinned.page() + head_lag + num_pinned_pages);
+  ASSERT_LE(store.hlog.head_address.load().page(), pinned.page());
+  ASSERT_EQ(1, store.hlog.pinned_pages_closed());
+  {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      ASSERT_TRUE(false);
+    };
+    RmwContext context{ Key{ first_pinned_key }, 1 };
+    ASSERT_EQ(Status::Ok, store.Rmw(context, callback, 1));
+  }
+  store.hlog.UnpinPage(pinned);
+  ASSERT_EQ(store.hlog.max_pinned_head_pages(), num_pinned_pages);
+  store.hlog.ReservePinnedHeadPages(0);
+  ASSERT_EQ(1, store.hlog.max_pinned_head_pages());
+
+  store.StopSession();
+}
+
 TEST(CLASS, Rmw_Large) {
   class Key {
    public:
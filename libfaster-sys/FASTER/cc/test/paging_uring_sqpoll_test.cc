@@ -0,0 +1,169 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <random>
+#include <thread>
+#include <sys/resource.h>
+#include "gtest/gtest.h"
+#include "core/faster.h"
+#include "device/file_system_disk.h"
+
+using namespace FASTER::core;
+using FASTER::environment::FileCreateDisposition;
+using FASTER::environment::FileOptions;
+using FASTER::environment::UringConfig;
+using FASTER::environment::UringFile;
+using FASTER::environment::UringIoHandler;
+
+/// Runs the paging tests with a kernel thread polling the submission queues, and with polled
+/// completions.
+class SqPollIoHandler : public UringIoHandler {
+ public:
+  SqPollIoHandler(size_t max_threads)
+    : UringIoHandler{ max_threads, Config() } {
+  }
+
+ private:
+  static UringConfig Config() {
+    UringConfig config;
+    config.sq_poll = true;
+    config.sq_poll_idle_ms = 100;
+    config.io_poll = true;
+    return config;
+  }
+};
+
+typedef SqPollIoHandler handler_t;
+
+#define CLASS PagingTest_UringSqPoll
+
+#include "paging_test.h"
+
+#undef CLASS
+
+/// Compares the polling modes on random 4 KB reads of a file: the time that issuing a read takes
+/// the caller (including its share of the batch's submission), and the CPU time used by the
+/// caller and by the whole process (which includes the poll thread's).
+TEST(UringPollBenchmark, RandomReads) {
+  class ReadContext : public IAsyncContext {
+   public:
+    ReadContext(std::atomic<uint64_t>* completed_)
+      : completed{ completed_ } {
+    }
+
+    /// The deep-copy constructor.
+    ReadContext(const ReadContext& other)
+      : completed{ other.completed } {
+    }
+
+   protected:
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) final {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   public:
+    std::atomic<uint64_t>* completed;
+  };
+
+  constexpr uint64_t kFileSize = 64 << 20;
+  constexpr uint32_t kWriteSize = 1 << 20;
+  constexpr uint32_t kReadSize = 4096;
+  constexpr uint64_t kNumReads = 1 << 17;
+  constexpr uint64_t kQueueDepth = 64;
+
+  auto cpu_ms = [](int who) {
+    struct rusage usage;
+    getrusage(who, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+  };
+
+  auto run = [&](const char* mode, const UringConfig& config) {
+    std::experimental::filesystem::create_directories("logs");
+    UringIoHandler handler{ 16, config };
+    UringFile file{ "logs/uring_poll_benchmark.dat" };
+    ASSERT_EQ(Status::Ok, file.Open(FileCreateDisposition::CreateOrTruncate,
+                                    FileOptions{ true, false }, &handler));
+
+    std::atomic<uint64_t> completed{ 0 };
+    auto callback = [](IAsyncContext* ctxt, Status result, size_t bytes_transferred) {
+      CallbackContext<ReadContext> context{ ctxt };
+      ASSERT_EQ(Status::Ok, result);
+      ++*context->completed;
+    };
+    ReadContext context{ &completed };
+
+    uint8_t* buffer = reinterpret_cast<uint8_t*>(
+                        FASTER::core::aligned_alloc(kReadSize, kWriteSize));
+    std::memset(buffer, 1, kWriteSize);
+    for(uint64_t offset = 0; offset < kFileSize; offset += kWriteSize) {
+      ASSERT_EQ(Status::Ok, file.Write(offset, kWriteSize, buffer, context, callback));
+    }
+    while(completed.load() < kFileSize / kWriteSize) {
+      handler.TryComplete();
+    }
+
+    // Reads share buffers; their contents do not matter.
+    completed = 0;
+    std::mt19937_64 rng{ 42 };
+    std::uniform_int_distribution<uint64_t> block{ 0, kFileSize / kReadSize - 1 };
+    std::chrono::nanoseconds issue_time{ 0 };
+    double thread_cpu_start = cpu_ms(RUSAGE_THREAD);
+    double process_cpu_start = cpu_ms(RUSAGE_SELF);
+    auto start = std::chrono::high_resolution_clock::now();
+    uint64_t issued = 0;
+    while(completed.load() < kNumReads) {
+      auto issue_start = std::chrono::high_resolution_clock::now();
+      for(; issued < kNumReads && issued - completed.load() < kQueueDepth; ++issued) {
+        uint8_t* read_buffer = buffer + (issued % (kWriteSize / kReadSize)) * kReadSize;
+        ASSERT_EQ(Status::Ok, file.Read(block(rng) * kReadSize, kReadSize, read_buffer, context,
+                                        callback));
+      }
+      handler.Submit();
+      issue_time += std::chrono::high_resolution_clock::now() - issue_start;
+      handler.TryComplete();
+    }
+    auto wall = std::chrono::high_resolution_clock::now() - start;
+    double thread_cpu = cpu_ms(RUSAGE_THREAD) - thread_cpu_start;
+    double process_cpu = cpu_ms(RUSAGE_SELF) - process_cpu_start;
+
+    printf("%-16s %10.0f %12.1f %12.0f %14.1f %15.1f\n", mode,
+           static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                 issue_time).count()) / kNumReads,
+           std::chrono::duration_cast<std::chrono::microseconds>(wall).count() / 1000.0,
+           kNumReads / (std::chrono::duration_cast<std::chrono::microseconds>(wall).count() /
+                        1000000.0),
+           thread_cpu, process_cpu);
+
+    FASTER::core::aligned_free(buffer);
+    ASSERT_EQ(Status::Ok, file.Close());
+    ASSERT_EQ(Status::Ok, file.Delete());
+  };
+
+  printf("%-16s %10s %12s %12s %14s %15s\n", "mode", "issue (ns)", "wall (ms)", "IOPS",
+         "caller CPU (ms)", "process CPU (ms)");
+  UringConfig config;
+  run("default", config);
+  config.io_poll = true;
+  run("iopoll", config);
+  config.io_poll = false;
+  config.sq_poll = true;
+  run("sqpoll", config);
+  config.io_poll = true;
+  run("sqpoll+iopoll", config);
+  config.io_poll = false;
+  config.sq_poll_cpu = 0;
+  run("sqpoll, cpu 0", config);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
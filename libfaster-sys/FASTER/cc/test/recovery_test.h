@@ -1156,6 +1156,228 @@ TEST(CLASS, Serial_VariableLengthKey) {
   new_store.StopSession();
 }
 
+TEST(CLASS, Serial_DenseIndex) {
+  // Keys are dense IDs, hashed to themselves.
+  class Key {
+   public:
+    Key(uint32_t key)
+      : key_{ key } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Key));
+    }
+    inline KeyHash GetHash() const {
+      return KeyHash{ key_ };
+    }
+
+    /// Comparison operators.
+    inline bool operator==(const Key& other) const {
+      return key_ == other.key_;
+    }
+    inline bool operator!=(const Key& other) const {
+      return key_ != other.key_;
+    }
+
+   private:
+    uint32_t key_;
+  };
+
+  class UpsertContext;
+  class ReadContext;
+
+  class Value {
+   public:
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(Value));
+    }
+
+    friend class UpsertContext;
+    friend class ReadContext;
+
+   private:
+    std::atomic<uint64_t> value_;
+  };
+
+  class UpsertContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    UpsertContext(uint32_t key, uint64_t val)
+      : key_{ key }
+      , val_{ val } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    UpsertContext(const UpsertContext& other)
+      : key_{ other.key_ }
+      , val_{ other.val_ } {
+    }
+
+    /// The implicit and explicit interfaces require a key() accessor.
+    inline const Key& key() const {
+      return key_;
+    }
+    inline static constexpr uint32_t value_size() {
+      return sizeof(value_t);
+    }
+    /// Non-atomic and atomic Put() methods.
+    inline void Put(Value& value) {
+      value.value_.store(val_);
+    }
+    inline bool PutAtomic(Value& value) {
+      value.value_.store(val_);
+      return true;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t val_;
+  };
+
+  class ReadContext : public IAsyncContext {
+   public:
+    typedef Key key_t;
+    typedef Value value_t;
+
+    ReadContext(uint32_t key)
+      : key_{ key }
+      , val_{ 0 } {
+    }
+
+    /// Copy (and deep-copy) constructor.
+    ReadContext(const ReadContext& other)
+      : key_{ other.key_ }
+      , val_{ other.val_ } {
+    }
+
+    /// The implicit and explicit interfaces require a key() accessor.
+    inline const Key& key() const {
+      return key_;
+    }
+
+    inline void Get(const Value& value) {
+      val_ = value.value_.load();
+    }
+    inline void GetAtomic(const Value& value) {
+      val_ = value.value_.load();
+    }
+
+    uint64_t val() const {
+      return val_;
+    }
+
+   protected:
+    /// The explicit interface requires a DeepCopy_Internal() implementation.
+    Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+      return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+    }
+
+   private:
+    Key key_;
+    uint64_t val_;
+  };
+
+  typedef FasterKv<Key, Value, disk_t> store_t;
+
+  auto upsert_callback = [](IAsyncContext* context, Status result) {
+    // Upserts don't go to disk.
+    ASSERT_TRUE(false);
+  };
+  static std::atomic<uint64_t> records_read;
+  auto read_callback = [](IAsyncContext* ctxt, Status result) {
+    CallbackContext<ReadContext> context{ ctxt };
+    ASSERT_EQ(Status::Ok, result);
+    ++records_read;
+    ASSERT_EQ(*reinterpret_cast<const uint32_t*>(&context->key()) * 3, context->val());
+  };
+  // Reads every key back.
+  auto verify = [&](store_t& store, uint32_t num_records) {
+    records_read = 0;
+    for(uint32_t idx = 0; idx < num_records; ++idx) {
+      if(idx % 256 == 0) {
+        store.Refresh();
+        store.CompletePending(false);
+      }
+      ReadContext context{ idx };
+      Status result = store.Read(context, read_callback, 1);
+      if(result == Status::Ok) {
+        ++records_read;
+        ASSERT_EQ(uint64_t{ idx } * 3, context.val());
+      } else {
+        ASSERT_EQ(Status::Pending, result);
+      }
+    }
+    store.CompletePending(true);
+    ASSERT_EQ(num_records, records_read.load());
+  };
+
+  std::experimental::filesystem::create_directories("storage");
+
+  // 4096 buckets of 7 entries: the index is full.
+  static constexpr uint32_t kNumRecords = 4096 * HashBucket::kNumEntries;
+  Guid session_id;
+  Guid token;
+
+  {
+    store_t store{ 4096, 201326592, "storage", 0.4 };
+    store.SetDenseIndex();
+    ASSERT_EQ(kNumRecords, store.DenseCapacity());
+    ASSERT_FALSE(store.GrowIndex(nullptr));
+
+    session_id = store.StartSession();
+    // Each entry ends up at the head of a chain of two versions of its key.
+    for(uint64_t round = 0; round < 2; ++round) {
+      for(uint32_t idx = 0; idx < kNumRecords; ++idx) {
+        UpsertContext context{ idx, uint64_t{ idx } * 3 };
+        Status result = store.Upsert(context, upsert_callback, 1);
+        ASSERT_EQ(Status::Ok, result);
+      }
+    }
+    verify(store, kNumRecords);
+
+    static std::atomic<bool> index_persisted;
+    index_persisted = false;
+    static std::atomic<bool> log_persisted;
+    log_persisted = false;
+    auto index_persistence_callback = [](Status result) {
+      ASSERT_EQ(Status::Ok, result);
+      index_persisted = true;
+    };
+    auto hybrid_log_persistence_callback = [](Status result, uint64_t persistent_serial_num) {
+      ASSERT_EQ(Status::Ok, result);
+      log_persisted = true;
+    };
+    ASSERT_TRUE(store.Checkpoint(index_persistence_callback, hybrid_log_persistence_callback,
+                                 token));
+    while(!index_persisted || !log_persisted) {
+      store.CompletePending(false);
+    }
+    store.CompletePending(true);
+    store.StopSession();
+  }
+
+  // Recover into a store with the same dense index.
+  store_t new_store{ 4096, 201326592, "storage", 0.4 };
+  new_store.SetDenseIndex();
+
+  uint32_t version;
+  std::vector<Guid> session_ids;
+  Status status = new_store.Recover(token, token, version, session_ids);
+  ASSERT_EQ(Status::Ok, status);
+  ASSERT_EQ(1, session_ids.size());
+  new_store.ContinueSession(session_ids[0]);
+  verify(new_store, kNumRecords);
+  new_store.StopSession();
+}
+
 TEST(CLASS, Concurrent_Insert_Small) {
   using Key = FixedSizeKey<uint32_t>;
   using Value = SimpleAtomicValue<uint32_t>;
@@ -1,10 +1,17 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT license.
 
+#include <cmath>
 #include <cstdint>
+#include <random>
+#include <vector>
 #include "gtest/gtest.h"
 
 #include "core/auto_ptr.h"
+#include "core/hash_bucket.h"
+#include "core/io_queue_controller.h"
+#include "mlkv_optimizer.h"
+#include "mlkv_quantize.h"
 
 using namespace FASTER::core;
 
@@ -19,6 +26,310 @@ TEST(UtilityTest, NextPowerOfTwo) {
   EXPECT_EQ(8, next_power_of_two(8));
 }
 
+TEST(UtilityTest, HashBucketProbe) {
+  std::mt19937_64 rng{ 7 };
+  HashBucket bucket;
+  for(uint32_t iteration = 0; iteration < 10000; ++iteration) {
+    // Few distinct tags, so that buckets hold matches, tentative matches and unused entries.
+    uint16_t tag = static_cast<uint16_t>(rng() % 4);
+    for(uint32_t entry_idx = 0; entry_idx < HashBucket::kNumEntries; ++entry_idx) {
+      uint64_t kind = rng() % 4;
+      uint16_t entry_tag = static_cast<uint16_t>(rng() % 4);
+      bucket.entries[entry_idx].store(kind == 0 ? HashBucketEntry{} :
+                                      HashBucketEntry{ Address{ rng() % 2 }, entry_tag, kind == 1 });
+    }
+    bucket.overflow_entry.store(HashBucketOverflowEntry{ rng() });
+
+    uint32_t expected_matches = 0, expected_free = 0;
+    for(uint32_t entry_idx = 0; entry_idx < HashBucket::kNumEntries; ++entry_idx) {
+      HashBucketEntry entry = bucket.entries[entry_idx].load();
+      if(entry.unused()) {
+        expected_free |= 1u << entry_idx;
+      } else if(entry.tag() == tag && !entry.tentative()) {
+        expected_matches |= 1u << entry_idx;
+      }
+    }
+    // A probe may stop at its first match, ignoring the entries after it.
+    auto check = [&](uint32_t matches, uint32_t free) {
+      EXPECT_EQ(0, matches & ~expected_matches);
+      EXPECT_EQ(0, free & ~expected_free);
+      if(expected_matches == 0) {
+        EXPECT_EQ(0, matches);
+        EXPECT_EQ(expected_free, free);
+      } else {
+        uint32_t first = expected_matches & (0 - expected_matches);
+        EXPECT_NE(0, matches & first);
+        EXPECT_EQ(expected_free & (first - 1), free & (first - 1));
+      }
+    };
+    uint32_t matches, free;
+    bucket.ProbeScalar(tag, matches, free);
+    check(matches, free);
+    bucket.Probe(tag, matches, free);
+    check(matches, free);
+  }
+}
+
+TEST(UtilityTest, IoQueueController) {
+  IoQueueController queue;
+  constexpr uint32_t kInitialDepth = IoQueueController::kInitialDepth;
+  constexpr uint32_t kIncrease = IoQueueController::kIncrease;
+  constexpr uint32_t kMinDepth = IoQueueController::kMinDepth;
+  constexpr uint32_t kMaxDepth = IoQueueController::kMaxDepth;
+  // Completes a window of reads that each took "latency_ns", after the queue filled up if
+  // "saturated".
+  auto window = [&](uint64_t latency_ns, bool saturated) {
+    if(saturated) {
+      queue.Resumed(queue.Throttled());
+    }
+    for(uint64_t idx = 0; idx < IoQueueController::kWindow; ++idx) {
+      queue.Complete(queue.Issue() - latency_ns);
+    }
+  };
+  ASSERT_EQ(kInitialDepth, queue.Stats().depth);
+
+  // Fast, steady reads grow the limit while threads run into it.
+  window(20000, true);
+  ASSERT_EQ(kInitialDepth + kIncrease, queue.Stats().depth);
+  window(20000, false);
+  ASSERT_EQ(kInitialDepth + kIncrease, queue.Stats().depth);
+  for(uint32_t idx = 0; idx < 200; ++idx) {
+    window(20000, true);
+  }
+  ASSERT_EQ(kMaxDepth, queue.Stats().depth);
+
+  // A latency spike cuts it by a quarter; the window after that is not judged.
+  window(100000, true);
+  uint32_t depth = kMaxDepth - kMaxDepth / 4;
+  ASSERT_EQ(depth, queue.Stats().depth);
+  window(100000, true);
+  ASSERT_EQ(depth, queue.Stats().depth);
+  window(100000, true);
+  ASSERT_EQ(depth - depth / 4, queue.Stats().depth);
+  for(uint32_t idx = 0; idx < 100; ++idx) {
+    window(100000, true);
+  }
+  ASSERT_EQ(kMinDepth, queue.Stats().depth);
+
+  IoQueueStats stats = queue.Stats();
+  ASSERT_EQ(0, stats.pending);
+  ASSERT_NEAR(100.0, stats.latency_us, 1.0);
+  ASSERT_GE(stats.min_latency_us, 20.0);
+  ASSERT_LT(stats.min_latency_us, 50.0);
+  ASSERT_EQ(304, stats.throttled);
+  ASSERT_GT(stats.iops, 0.0);
+
+  // Reads the device did not take no longer count.
+  queue.Issue(4);
+  queue.Cancel(4);
+  ASSERT_EQ(0, queue.Stats().pending);
+
+  // The limit keeps room for a batch from the one thread that submitted reads.
+  queue.SetSubmitBatch(32);
+  window(100000, true);
+  window(100000, true);
+  ASSERT_EQ(32, queue.Stats().depth);
+}
+
+TEST(UtilityTest, OptimizerKernels) {
+  // Dimensions that exercise the vector loops, their scalar tails, and both at once.
+  constexpr size_t kDims[] = { 1, 7, 8, 15, 16, 17, 33, 100 };
+  constexpr uint32_t kSteps = 5;
+  std::mt19937_64 rng{ 11 };
+  std::uniform_real_distribution<float> dist{ -1.0f, 1.0f };
+  auto random_vector = [&](size_t dim) {
+    std::vector<float> vector(dim);
+    for(float& value : vector) {
+      value = dist(rng);
+    }
+    return vector;
+  };
+  // FMA and vector division round differently from the scalar loops.
+  auto expect_near = [](const std::vector<float>& expected, const std::vector<float>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for(size_t idx = 0; idx < expected.size(); ++idx) {
+      EXPECT_NEAR(expected[idx], actual[idx], 1e-5f * (1.0f + std::fabs(expected[idx])));
+    }
+  };
+
+  struct Kernels {
+    mlkv::SgdKernel sgd;
+    mlkv::AdagradKernel adagrad;
+    mlkv::AdamKernel adam;
+  };
+  std::vector<Kernels> candidates;
+#ifdef MLKV_X86_DISPATCH
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    candidates.push_back({ mlkv::kernels::SgdAvx2, mlkv::kernels::AdagradAvx2,
+                           mlkv::kernels::AdamAvx2 });
+  }
+  if(__builtin_cpu_supports("avx512f")) {
+    candidates.push_back({ mlkv::kernels::SgdAvx512, mlkv::kernels::AdagradAvx512,
+                           mlkv::kernels::AdamAvx512 });
+  }
+#endif
+  // The dispatched kernels, whichever this CPU gets.
+  const mlkv::OptimizerKernels& dispatched = mlkv::OptimizerKernels::Get();
+  candidates.push_back({ dispatched.sgd, dispatched.adagrad, dispatched.adam });
+
+  for(const Kernels& kernels : candidates) {
+    for(size_t dim : kDims) {
+      std::vector<float> weights = random_vector(dim);
+      std::vector<float> accum(dim, 0.1f);
+      std::vector<float> moment1(dim, 0.0f);
+      std::vector<float> moment2(dim, 0.0f);
+      std::vector<float> expected_weights[3] = { weights, weights, weights };
+      std::vector<float> expected_accum = accum;
+      std::vector<float> expected_moment1 = moment1;
+      std::vector<float> expected_moment2 = moment2;
+      std::vector<float> actual_weights[3] = { weights, weights, weights };
+      std::vector<float> actual_accum = accum;
+      std::vector<float> actual_moment1 = moment1;
+      std::vector<float> actual_moment2 = moment2;
+      for(uint32_t step = 0; step < kSteps; ++step) {
+        std::vector<float> grad = random_vector(dim);
+        mlkv::kernels::SgdScalar(expected_weights[0].data(), grad.data(), dim, 0.1f);
+        kernels.sgd(actual_weights[0].data(), grad.data(), dim, 0.1f);
+        mlkv::kernels::AdagradScalar(expected_weights[1].data(), expected_accum.data(),
+                                     grad.data(), dim, 0.1f, 1e-8f);
+        kernels.adagrad(actual_weights[1].data(), actual_accum.data(), grad.data(), dim, 0.1f,
+                        1e-8f);
+        mlkv::kernels::AdamScalar(expected_weights[2].data(), expected_moment1.data(),
+                                  expected_moment2.data(), grad.data(), dim, 0.01f, 0.9f, 0.999f,
+                                  1e-8f);
+        kernels.adam(actual_weights[2].data(), actual_moment1.data(), actual_moment2.data(),
+                     grad.data(), dim, 0.01f, 0.9f, 0.999f, 1e-8f);
+      }
+      for(uint32_t idx = 0; idx < 3; ++idx) {
+        expect_near(expected_weights[idx], actual_weights[idx]);
+      }
+      expect_near(expected_accum, actual_accum);
+      expect_near(expected_moment1, actual_moment1);
+      expect_near(expected_moment2, actual_moment2);
+    }
+  }
+}
+
+TEST(UtilityTest, QuantizeRoundTrip) {
+  constexpr size_t kDims[] = { 1, 2, 3, 7, 8, 9, 31, 32, 33, 100 };
+  constexpr mlkv::Format kFormats[] = { mlkv::Format::Fp32, mlkv::Format::Fp16,
+                                        mlkv::Format::Bf16, mlkv::Format::Int8 };
+  constexpr uint8_t kCanary = 0xA5;
+  std::mt19937_64 rng{ 13 };
+  std::uniform_real_distribution<float> dist{ -2.0f, 2.0f };
+
+  for(mlkv::Format format : kFormats) {
+    for(size_t dim : kDims) {
+      std::vector<float> weights(dim);
+      float max_abs = 0.0f;
+      for(float& value : weights) {
+        value = dist(rng);
+        max_abs = std::max(max_abs, std::fabs(value));
+      }
+      // Anything stored after the weights (e.g., optimizer state) stays float-aligned.
+      size_t stored_length = mlkv::StoredLength(format, dim);
+      ASSERT_EQ(0, stored_length % alignof(float));
+      ASSERT_GE(mlkv::StoredDim(format, stored_length), dim);
+
+      // Encode() writes only its StoredLength() bytes.
+      std::vector<uint8_t> stored(stored_length + 16, kCanary);
+      mlkv::Encode(format, weights.data(), dim, stored.data());
+      for(size_t idx = stored_length; idx < stored.size(); ++idx) {
+        ASSERT_EQ(kCanary, stored[idx]);
+      }
+
+      std::vector<float> decoded(dim);
+      mlkv::Decode(format, stored.data(), dim, decoded.data());
+      for(size_t idx = 0; idx < dim; ++idx) {
+        float tolerance;
+        switch(format) {
+        case mlkv::Format::Fp16:
+          // 11 significant bits.
+          tolerance = std::fabs(weights[idx]) / 2048.0f + 1e-7f;
+          break;
+        case mlkv::Format::Bf16:
+          // 8 significant bits.
+          tolerance = std::fabs(weights[idx]) / 256.0f;
+          break;
+        case mlkv::Format::Int8:
+          // Half a step of the row's scale.
+          tolerance = max_abs / 127.0f / 2.0f * 1.001f;
+          break;
+        default:
+          tolerance = 0.0f;
+          break;
+        }
+        EXPECT_NEAR(weights[idx], decoded[idx], tolerance) << static_cast<int>(format) << " "
+            << dim << " " << idx;
+      }
+    }
+  }
+
+  // An all-zero int8 row has a zero scale, and decodes to zeros.
+  std::vector<float> zeros(9, 0.0f);
+  std::vector<uint8_t> stored(mlkv::StoredLength(mlkv::Format::Int8, zeros.size()));
+  mlkv::Encode(mlkv::Format::Int8, zeros.data(), zeros.size(), stored.data());
+  std::vector<float> decoded(zeros.size(), 1.0f);
+  mlkv::Decode(mlkv::Format::Int8, stored.data(), zeros.size(), decoded.data());
+  EXPECT_EQ(zeros, decoded);
+}
+
+TEST(UtilityTest, QuantizeKernels) {
+#ifdef MLKV_X86_DISPATCH
+  __builtin_cpu_init();
+  if(!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("f16c")) {
+    return;
+  }
+  constexpr size_t kDims[] = { 1, 7, 8, 9, 31, 32, 33, 64, 100 };
+  struct Kernels {
+    mlkv::EncodeKernel encode;
+    mlkv::DecodeKernel decode;
+    mlkv::EncodeKernel encode_avx2;
+    mlkv::DecodeKernel decode_avx2;
+    mlkv::Format format;
+  };
+  const Kernels kKernels[] = {
+    { mlkv::kernels::EncodeFp16Scalar, mlkv::kernels::DecodeFp16Scalar,
+      mlkv::kernels::EncodeFp16Avx2, mlkv::kernels::DecodeFp16Avx2, mlkv::Format::Fp16 },
+    { mlkv::kernels::EncodeBf16Scalar, mlkv::kernels::DecodeBf16Scalar,
+      mlkv::kernels::EncodeBf16Avx2, mlkv::kernels::DecodeBf16Avx2, mlkv::Format::Bf16 },
+    { mlkv::kernels::EncodeInt8Scalar, mlkv::kernels::DecodeInt8Scalar,
+      mlkv::kernels::EncodeInt8Avx2, mlkv::kernels::DecodeInt8Avx2, mlkv::Format::Int8 },
+  };
+  std::mt19937_64 rng{ 17 };
+  std::uniform_real_distribution<float> dist{ -3.0f, 3.0f };
+
+  for(const Kernels& kernels : kKernels) {
+    for(size_t dim : kDims) {
+      std::vector<float> weights(dim);
+      for(float& value : weights) {
+        value = dist(rng);
+      }
+      // Include a zero, and a value too small for fp16.
+      weights[0] = 0.0f;
+      if(dim > 1) {
+        weights[dim / 2] = 1e-30f;
+      }
+      // Both round to nearest even, so they agree bit for bit.
+      size_t stored_length = mlkv::StoredLength(kernels.format, dim);
+      std::vector<uint8_t> expected(stored_length, 0);
+      std::vector<uint8_t> actual(stored_length, 0);
+      kernels.encode(weights.data(), dim, expected.data());
+      kernels.encode_avx2(weights.data(), dim, actual.data());
+      ASSERT_EQ(expected, actual) << static_cast<int>(kernels.format) << " " << dim;
+
+      std::vector<float> expected_weights(dim);
+      std::vector<float> actual_weights(dim);
+      kernels.decode(expected.data(), dim, expected_weights.data());
+      kernels.decode_avx2(expected.data(), dim, actual_weights.data());
+      ASSERT_EQ(expected_weights, actual_weights) << static_cast<int>(kernels.format) << " "
+          << dim;
+    }
+  }
+#endif
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -22,8 +22,11 @@ fn faster_bindgen() {
 fn main() {
     faster_bindgen();
 
+    // With the "uring" feature, stores can choose io_uring at runtime (see faster_open_ex()).
+    let uring = env::var("CARGO_FEATURE_URING").is_ok();
     let dst = Config::new("FASTER/cc")
         .cflag("--std=c++14")
+        .define("USE_URING", if uring { "ON" } else { "OFF" })
         .build();
 
     println!("cargo:rustc-link-search=native={}/{}", dst.display(), "build");
@@ -34,6 +37,9 @@ fn main() {
     println!("cargo:rustc-link-lib=tbb");
     println!("cargo:rustc-link-lib=gcc");
     println!("cargo:rustc-link-lib=aio");
+    if uring {
+        println!("cargo:rustc-link-lib=uring");
+    }
     println!("cargo:rustc-link-lib=m");
     println!("cargo:rustc-link-lib=stdc++");
     println!("cargo:rustc-link-lib=pthread");
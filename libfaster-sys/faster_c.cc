@@ -1,8 +1,21 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the MIT license.
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 #include "faster_c.h"
+#include "mlkv_initializer.h"
+#include "mlkv_optimizer.h"
+#include "mlkv_quantize.h"
 #include "core/faster.h"
 #include "device/file_system_disk.h"
 #include "device/null_disk.h"
@@ -24,6 +37,12 @@ class Key {
     inline FASTER::core::KeyHash GetHash() const {
       return FASTER::core::KeyHash{ FASTER::core::Utility::GetHashCode(key_) };
     }
+    /// Whether the store's index is dense; see DenseKey.
+    static constexpr bool kDense = false;
+    /// The raw key, e.g., to seed a new row's initial value.
+    inline uint64_t value() const {
+      return key_;
+    }
 
     /// Comparison operators.
     inline bool operator==(const Key& other) const {
@@ -37,6 +56,20 @@ class Key {
     uint64_t key_;
 };
 
+/// The key of a store opened with a dense index (see faster_open_dense()): its hash is the key
+/// itself, which the index uses directly as the row's slot.
+class DenseKey : public Key {
+  public:
+    DenseKey(uint64_t key)
+      : Key{ key } {
+    }
+
+    inline FASTER::core::KeyHash GetHash() const {
+      return FASTER::core::KeyHash{ value() };
+    }
+    static constexpr bool kDense = true;
+};
+
 class GenLock {
   public:
     GenLock()
@@ -78,7 +111,13 @@ class AtomicGenLock {
     }
 
     inline bool try_lock(bool& replaced, int32_t staleness_incr, int32_t staleness_bound) {
+      bool at_bound;
+      return try_lock(replaced, at_bound, staleness_incr, staleness_bound);
+    }
+    inline bool try_lock(bool& replaced, bool& at_bound, int32_t staleness_incr,
+                         int32_t staleness_bound) {
       replaced = false;
+      at_bound = false;
       GenLock expected{ control_.load() };
       expected.locked = 0;
       expected.replaced = 0;
@@ -87,6 +126,7 @@ class AtomicGenLock {
       desired.staleness = expected.staleness + staleness_incr;
 
       if (desired.staleness > staleness_bound) {
+        at_bound = true;
         return false;
       }
 
@@ -114,6 +154,637 @@ class AtomicGenLock {
     std::atomic<uint64_t> control_;
 };
 
+/// Per-store staleness bookkeeping.
+///
+/// Staleness that reads of immutable (read-only or on-disk) records add to a row is kept here, off
+/// the log, so that such reads need not copy the row to the tail. A row's staleness is its latest
+/// record's plus its delta here; the next lock of its mutable record folds the delta in.
+///
+/// Readers that find a row at its staleness bound park here, on a condition variable striped by
+/// key hash, until a writer lowers the row's staleness.
+class StalenessTable {
+  public:
+    StalenessTable(uint64_t num_slots)
+      : mask_{ num_slots - 1 }
+      , shift_{ static_cast<uint32_t>(__builtin_ctzll(num_slots)) }
+      , slots_{ new std::atomic<uint64_t>[num_slots] }
+      , overflows_{ 0 }
+      , blocked_{ 0 }
+      , blocked_ns_{ 0 }
+      , store_{ nullptr }
+      , refresh_{ nullptr }
+      , id_{ next_id().fetch_add(1) } {
+      assert(Utility::IsPowerOfTwo(num_slots));
+      for(uint64_t idx = 0; idx < num_slots; ++idx) {
+        slots_[idx].store(0);
+      }
+      std::lock_guard<std::mutex> lock{ live().mutex };
+      live().ids.insert(id_);
+    }
+    ~StalenessTable() {
+      {
+        std::lock_guard<std::mutex> lock{ live().mutex };
+        live().ids.erase(id_);
+      }
+      delete[] slots_;
+    }
+
+    /// Unique for the life of the process, unlike the table's address.
+    inline uint64_t id() const {
+      return id_;
+    }
+    /// Runs "f" if the table "id" has not been destroyed; it is not destroyed until "f" returns.
+    static void if_live(uint64_t id, const std::function<void()>& f) {
+      std::lock_guard<std::mutex> lock{ live().mutex };
+      if(live().ids.count(id) != 0) {
+        f();
+      }
+    }
+
+    /// A row's staleness delta.
+    inline int32_t delta(KeyHash hash) const {
+      uint64_t tag = tag_of(hash);
+      int32_t sum = 0;
+      for(uint64_t probe = 0; probe < kMaxProbes; ++probe) {
+        uint64_t slot = slots_[(hash.idx(mask_ + 1) + probe) & mask_].load();
+        if((slot >> 32) == tag) {
+          sum += static_cast<int32_t>(static_cast<uint32_t>(slot));
+        }
+      }
+      return sum;
+    }
+
+    /// Adds to a row's staleness delta. Fails if the row has no slot and none is free nearby.
+    inline bool add(KeyHash hash, int32_t incr) {
+      if(incr == 0) {
+        return true;
+      }
+      uint64_t tag = tag_of(hash);
+      for(uint64_t probe = 0; probe < kMaxProbes; ++probe) {
+        std::atomic<uint64_t>& slot = slots_[(hash.idx(mask_ + 1) + probe) & mask_];
+        uint64_t expected = slot.load();
+        while(expected == 0 || (expected >> 32) == tag) {
+          int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(expected)) + incr;
+          // A slot whose delta drops back to zero is free again.
+          uint64_t desired = delta == 0 ? 0 : (tag << 32) | static_cast<uint32_t>(delta);
+          if(slot.compare_exchange_weak(expected, desired)) {
+            return true;
+          }
+        }
+      }
+      ++overflows_;
+      return false;
+    }
+
+    /// Number of reads that found no free slot.
+    inline uint64_t overflows() const {
+      return overflows_.load();
+    }
+
+    /// Parking: a waiter samples wait_epoch() before checking the row, and park() returns once
+    /// a writer has called notify() on the row's stripe since (or after a timeout, for writes
+    /// that don't notify, e.g. those that copy the row to the tail).
+    inline uint64_t wait_epoch(KeyHash hash) const {
+      return stripe(hash).epoch.load();
+    }
+    inline void park(KeyHash hash, uint64_t epoch) {
+      Stripe& waiters = stripe(hash);
+      std::unique_lock<std::mutex> lock{ waiters.mutex };
+      ++waiters.waiting;
+      waiters.cv.wait_for(lock, std::chrono::milliseconds{ kParkTimeoutMs }, [&] {
+        return waiters.epoch.load() != epoch;
+      });
+      --waiters.waiting;
+    }
+    /// A reader parked inside a store operation calls refresh() between timeouts, with a pointer
+    /// into the record it waits on, so that it does not hold the store's epochs (page flushes,
+    /// head shifts) back; see FasterKv::RefreshWhileWaiting(). False once the record is no longer
+    /// mutable: the reader must then stop waiting for it.
+    typedef bool(*RefreshFn)(void* store, const void* record);
+    inline void set_refresh(void* store, RefreshFn refresh) {
+      store_ = store;
+      refresh_ = refresh;
+    }
+    inline bool refresh(const void* record) const {
+      return refresh_ == nullptr || refresh_(store_, record);
+    }
+    inline void notify(KeyHash hash) {
+      Stripe& waiters = stripe(hash);
+      ++waiters.epoch;
+      if(waiters.waiting.load() > 0) {
+        std::lock_guard<std::mutex> lock{ waiters.mutex };
+        waiters.cv.notify_all();
+      }
+    }
+
+    /// How many times, and for how long in total, readers waited at the staleness bound.
+    inline void record_blocked(std::chrono::nanoseconds duration) {
+      ++blocked_;
+      blocked_ns_ += duration.count();
+    }
+    inline uint64_t blocked() const {
+      return blocked_.load();
+    }
+    inline uint64_t blocked_ns() const {
+      return blocked_ns_.load();
+    }
+
+  private:
+    static constexpr uint64_t kMaxProbes = 16;
+    static constexpr uint64_t kNumStripes = 64;
+    static constexpr uint32_t kParkTimeoutMs = 1;
+
+    struct Stripe {
+      Stripe()
+        : epoch{ 0 }
+        , waiting{ 0 } {
+      }
+
+      std::mutex mutex;
+      std::condition_variable cv;
+      std::atomic<uint64_t> epoch;
+      std::atomic<uint32_t> waiting;
+    };
+
+    inline Stripe& stripe(KeyHash hash) const {
+      return stripes_[hash.control() % kNumStripes];
+    }
+
+    struct Live {
+      std::mutex mutex;
+      std::unordered_set<uint64_t> ids;
+    };
+    /// Never destroyed, since threads may still exit after static destructors run.
+    static Live& live() {
+      static Live* instance = new Live{};
+      return *instance;
+    }
+    static std::atomic<uint64_t>& next_id() {
+      static std::atomic<uint64_t> instance{ 1 };
+      return instance;
+    }
+
+    /// The hash's bits above the slot index, truncated to 31 bits; never zero, so that an empty
+    /// slot matches no row. (Keys of a dense index hash to themselves, so every bit counts.)
+    inline uint64_t tag_of(KeyHash hash) const {
+      return (((hash.control() >> shift_) << 1) | 1) & 0xffffffffull;
+    }
+
+    uint64_t mask_;
+    uint32_t shift_;
+    std::atomic<uint64_t>* slots_;
+    std::atomic<uint64_t> overflows_;
+
+    mutable Stripe stripes_[kNumStripes];
+    std::atomic<uint64_t> blocked_;
+    std::atomic<uint64_t> blocked_ns_;
+    void* store_;
+    RefreshFn refresh_;
+    uint64_t id_;
+};
+
+/// Reads that one thread counted optimistically, without writing the row's record, and has not
+/// yet added to the side table; so that concurrent reads of a hot row do not bounce the record's
+/// (or the side table slot's) cache line between cores. A row's reads are merged into the side
+/// table when another row needs its entry, every kMaxBufferedReads reads, and when the thread
+/// stops its session or exits. Until then, only this thread sees them.
+class LocalStaleness {
+  public:
+    LocalStaleness()
+      : table_{ nullptr }
+      , table_id_{ 0 }
+      , buffered_{ 0 } {
+      std::memset(entries_, 0, sizeof(entries_));
+    }
+    /// A thread may exit without stopping its session; its reads still count, unless their store
+    /// was closed first.
+    ~LocalStaleness() {
+      flush_if_live();
+    }
+
+    /// This thread's unmerged reads of a row.
+    inline int32_t pending(const StalenessTable* table, KeyHash hash) const {
+      const Entry& entry = entries_[hash.control() % kNumEntries];
+      return owns(table) && entry.count != 0 && entry.hash == hash.control() ? entry.count : 0;
+    }
+
+    inline void add(StalenessTable* table, KeyHash hash, int32_t incr) {
+      if(!owns(table)) {
+        flush_if_live();
+        table_ = table;
+        table_id_ = table->id();
+      }
+      Entry& entry = entries_[hash.control() % kNumEntries];
+      if(entry.count != 0 && entry.hash != hash.control()) {
+        table_->add(KeyHash{ entry.hash }, entry.count);
+        entry.count = 0;
+      }
+      entry.hash = hash.control();
+      entry.count += incr;
+      if(++buffered_ >= kMaxBufferedReads) {
+        flush();
+      }
+    }
+
+    /// Forgets a row's reads, once the caller has folded them into the row's record.
+    inline void clear(const StalenessTable* table, KeyHash hash) {
+      Entry& entry = entries_[hash.control() % kNumEntries];
+      if(owns(table) && entry.hash == hash.control()) {
+        entry.count = 0;
+      }
+    }
+
+    /// Adds every buffered read to the side table; a read that finds no free slot there goes
+    /// uncounted, as the side table's overflows() report.
+    inline void flush() {
+      if(table_ != nullptr) {
+        for(Entry& entry : entries_) {
+          if(entry.count != 0) {
+            table_->add(KeyHash{ entry.hash }, entry.count);
+            entry.count = 0;
+          }
+        }
+      }
+      buffered_ = 0;
+    }
+
+  private:
+    /// Whether the buffered reads are of "table" (and not of a destroyed one at the same address).
+    inline bool owns(const StalenessTable* table) const {
+      return table == table_ && table->id() == table_id_;
+    }
+    /// Flushes to a table that may have been destroyed since this thread last used it.
+    inline void flush_if_live() {
+      if(table_ != nullptr) {
+        StalenessTable::if_live(table_id_, [&]() {
+          flush();
+        });
+        for(Entry& entry : entries_) {
+          entry.count = 0;
+        }
+        buffered_ = 0;
+      }
+    }
+
+    static constexpr uint32_t kNumEntries = 64;
+    static constexpr uint32_t kMaxBufferedReads = 256;
+
+    struct Entry {
+      uint64_t hash;
+      int32_t count;
+    };
+
+    StalenessTable* table_;
+    uint64_t table_id_;
+    Entry entries_[kNumEntries];
+    uint32_t buffered_;
+};
+
+static thread_local LocalStaleness local_staleness;
+
+/// Flat combining for hot rows: while one thread holds a row's lock to add to its weights, the
+/// threads that would wait for the lock publish their (additive) updates to the row's slot
+/// instead, and return at once; the lock holder applies what they published before it unlocks.
+/// Slots are striped by key hash, and combine one row at a time; see mlkv_set_combining().
+class CombiningTable {
+  public:
+    CombiningTable()
+      : slots_{ new Slot[kNumSlots] }
+      , published_{ 0 }
+      , combiners_{ 0 } {
+    }
+    ~CombiningTable() {
+      delete[] slots_;
+    }
+
+    /// Called with the row locked: starts combining updates of "dim" float32 weights to it. False
+    /// if the row's slot is combining some other row.
+    inline bool activate(KeyHash hash, uint64_t dim) {
+      Slot& slot = slot_of(hash);
+      std::lock_guard<std::mutex> lock{ slot.mutex };
+      if(slot.active) {
+        return false;
+      }
+      slot.active = true;
+      slot.hash = hash.control();
+      slot.sum.assign(dim, 0.0f);
+      slot.count = 0;
+      slot.staleness_incr = 0;
+      return true;
+    }
+
+    /// Adds "incr" to what the row's combiner will apply. False if no thread is combining updates
+    /// of "dim" weights to the row.
+    inline bool publish(KeyHash hash, const float* incr, uint64_t dim, int32_t staleness_incr) {
+      Slot& slot = slot_of(hash);
+      std::lock_guard<std::mutex> lock{ slot.mutex };
+      if(!slot.active || slot.hash != hash.control() || slot.sum.size() != dim) {
+        return false;
+      }
+      for(uint64_t idx = 0; idx < dim; ++idx) {
+        slot.sum[idx] += incr[idx];
+      }
+      ++slot.count;
+      slot.staleness_incr += staleness_incr;
+      ++published_;
+      return true;
+    }
+
+    /// Moves the sum of the updates published so far into "sum", and returns how many there were.
+    /// If there were none, or if "last", stops combining the row: a thread that publishes from
+    /// then on waits for the lock instead.
+    inline uint32_t drain(KeyHash hash, std::vector<float>& sum, int32_t& staleness_incr,
+                          bool last) {
+      Slot& slot = slot_of(hash);
+      std::lock_guard<std::mutex> lock{ slot.mutex };
+      uint32_t count = slot.count;
+      if(count > 0) {
+        sum.assign(slot.sum.begin(), slot.sum.end());
+        std::fill(slot.sum.begin(), slot.sum.end(), 0.0f);
+        staleness_incr = slot.staleness_incr;
+        slot.count = 0;
+        slot.staleness_incr = 0;
+      }
+      if(count == 0 || last) {
+        slot.active = false;
+      }
+      return count;
+    }
+
+    inline void record_combiner() {
+      ++combiners_;
+    }
+    /// Updates applied by some other thread than the one that issued them, and how many lock
+    /// holders applied any.
+    inline uint64_t published() const {
+      return published_.load();
+    }
+    inline uint64_t combiners() const {
+      return combiners_.load();
+    }
+
+  private:
+    static constexpr uint64_t kNumSlots = 1024;
+
+    struct Slot {
+      Slot()
+        : active{ false }
+        , hash{ 0 }
+        , count{ 0 }
+        , staleness_incr{ 0 } {
+      }
+
+      std::mutex mutex;
+      bool active;
+      uint64_t hash;
+      std::vector<float> sum;
+      uint32_t count;
+      int32_t staleness_incr;
+    };
+
+    inline Slot& slot_of(KeyHash hash) const {
+      return slots_[hash.control() % kNumSlots];
+    }
+
+    Slot* slots_;
+    std::atomic<uint64_t> published_;
+    std::atomic<uint64_t> combiners_;
+};
+
+/// While another thread holds a row's lock and combines updates to it, publishes "incr" to that
+/// thread, and returns true: the update is as good as applied. Returns false once the row is
+/// unlocked (or replaced), for the caller to lock it as usual.
+inline bool publish_while_locked(const AtomicGenLock& gen_lock, CombiningTable* combining,
+                                 KeyHash hash, const float* incr, uint64_t dim,
+                                 int32_t staleness_incr) {
+  while(true) {
+    GenLock current = gen_lock.load();
+    if(!current.locked || current.replaced) {
+      return false;
+    }
+    if(combining->publish(hash, incr, dim, staleness_incr)) {
+      return true;
+    }
+    std::this_thread::yield();
+  }
+}
+
+/// Locks a row's mutable record. The row's delta in the side table, and this thread's unmerged
+/// reads of it, count towards the staleness bound, and are folded into the record. While the row
+/// is locked by another thread, spins; while it is at the bound, parks, refreshing the store's
+/// epoch between timeouts. Returns false if some other thread replaced the record, or if the
+/// record left the mutable region while this thread was parked.
+inline bool lock_row(AtomicGenLock& gen_lock, StalenessTable* staleness_table, KeyHash hash,
+                     int32_t staleness_incr, int32_t staleness_bound) {
+  constexpr uint32_t kSpinsBeforePark = 64;
+  bool replaced, at_bound;
+  uint32_t spins = 0;
+  bool blocked = false;
+  std::chrono::steady_clock::time_point blocked_since;
+  while(true) {
+    uint64_t epoch = staleness_table->wait_epoch(hash);
+    int32_t delta = staleness_table->delta(hash);
+    int32_t local = local_staleness.pending(staleness_table, hash);
+    if(gen_lock.try_lock(replaced, at_bound, staleness_incr + delta + local, staleness_bound)) {
+      bool folded = staleness_table->add(hash, -delta);
+      assert(folded);
+      local_staleness.clear(staleness_table, hash);
+      if(blocked) {
+        staleness_table->record_blocked(std::chrono::steady_clock::now() - blocked_since);
+      }
+      return true;
+    }
+    if(replaced) {
+      return false;
+    }
+    if(!at_bound || ++spins < kSpinsBeforePark) {
+      std::this_thread::yield();
+      continue;
+    }
+    if(!blocked) {
+      blocked = true;
+      blocked_since = std::chrono::steady_clock::now();
+    }
+    staleness_table->park(hash, epoch);
+    if(!staleness_table->refresh(&gen_lock)) {
+      staleness_table->record_blocked(std::chrono::steady_clock::now() - blocked_since);
+      return false;
+    }
+  }
+}
+
+/// Counts a read of a row without writing its record, if the read would not reach the staleness
+/// bound: the row's staleness, as the record, the side table, and this thread see it, leaves room
+/// for it. Other threads' unmerged reads are not seen, so SSP bounds may be overrun by up to
+/// LocalStaleness::kMaxBufferedReads reads per thread; BSP reads always lock the row. Returns
+/// false if the caller should lock the row instead.
+inline bool count_read_optimistic(const AtomicGenLock& gen_lock, StalenessTable* staleness_table,
+                                  KeyHash hash, int32_t staleness_incr, int32_t staleness_bound) {
+  if(staleness_bound <= 1) {
+    return false;
+  }
+  if(staleness_bound != INT32_MAX) {
+    int64_t staleness = static_cast<int64_t>(gen_lock.load().staleness) +
+                        staleness_table->delta(hash) +
+                        local_staleness.pending(staleness_table, hash);
+    if(staleness + staleness_incr > staleness_bound) {
+      return false;
+    }
+  }
+  local_staleness.add(staleness_table, hash, staleness_incr);
+  return true;
+}
+
+extern "C++" {
+
+/// Copies a row's contents with "copy" under its generation number, as a seqlock reader would:
+/// retries while a writer holds the row, or if one updated it meanwhile.
+template <class F>
+inline void read_row_optimistic(const AtomicGenLock& gen_lock, F copy) {
+  while(true) {
+    GenLock before = gen_lock.load();
+    if(before.locked) {
+      std::this_thread::yield();
+      continue;
+    }
+    copy();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    GenLock after = gen_lock.load();
+    if(after.gen_number == before.gen_number && !after.locked) {
+      return;
+    }
+  }
+}
+
+/// Called by a row's lock holder that activated combining, after its own update: applies the
+/// updates other threads published meanwhile, with "apply" adding a float32 increment to the row's
+/// weights, and then stops combining. Folds their staleness increments into the (locked) record.
+template <class F>
+inline void combine_updates(CombiningTable* combining, AtomicGenLock& gen_lock, KeyHash hash,
+                            F apply) {
+  // Bounds how long one thread applies updates for others.
+  constexpr uint32_t kMaxRounds = 8;
+  static thread_local std::vector<float> sum;
+  int32_t staleness_incr = 0;
+  bool combined = false;
+  for(uint32_t round = 1; round <= kMaxRounds; ++round) {
+    int32_t incr = 0;
+    if(combining->drain(hash, sum, incr, round == kMaxRounds) == 0) {
+      break;
+    }
+    apply(sum.data());
+    staleness_incr += incr;
+    combined = true;
+  }
+  if(combined) {
+    GenLock locked = gen_lock.load();
+    locked.staleness += staleness_incr;
+    gen_lock.store(locked);
+    combining->record_combiner();
+  }
+}
+
+}  // extern "C++"
+
+/// Bytes that the weights of a row take in the log, for "length" bytes of float32 weights.
+inline uint64_t stored_length(mlkv::Format format, uint64_t length) {
+  return format == mlkv::Format::Fp32 ? length :
+         mlkv::StoredLength(format, length / sizeof(float));
+}
+
+/// Offset of the float32 optimizer state that follows a row's weights: the stored weights,
+/// rounded up so that the state stays aligned whatever the format and dimension.
+inline uint64_t state_offset(mlkv::Format format, uint64_t length) {
+  return (stored_length(format, length) + alignof(float) - 1) / alignof(float) * alignof(float);
+}
+
+/// Float32 copy of a quantized row's weights, for RMWs to update before storing them again.
+static thread_local std::vector<float> weights_scratch;
+
+inline float* scratch_weights(uint64_t length) {
+  weights_scratch.resize(length / sizeof(float));
+  return weights_scratch.data();
+}
+
+/// Buffers for pinned reads of rows that cannot be handed out in place. A pinned row is released
+/// on the thread that read it, so each thread keeps its own pool.
+static thread_local std::vector<std::unique_ptr<std::vector<uint8_t>>> pinned_buffers;
+
+inline std::vector<uint8_t>* acquire_pinned_buffer(uint64_t length) {
+  std::vector<uint8_t>* buffer;
+  if(pinned_buffers.empty()) {
+    buffer = new std::vector<uint8_t>();
+  } else {
+    buffer = pinned_buffers.back().release();
+    pinned_buffers.pop_back();
+  }
+  buffer->resize(length);
+  return buffer;
+}
+
+inline void release_pinned_buffer(std::vector<uint8_t>* buffer) {
+  pinned_buffers.emplace_back(buffer);
+}
+
+/// Returns up to "length" bytes of a row's weights as float32; "row_length" bounds what the row
+/// holds.
+inline void read_weights(mlkv::Format format, const uint8_t* row, uint64_t row_length,
+                         uint8_t* output, uint64_t length) {
+  if(format == mlkv::Format::Fp32) {
+    std::memcpy(output, row, std::min(length, row_length));
+    return;
+  }
+  size_t dim = std::min<size_t>(length / sizeof(float), mlkv::StoredDim(format, row_length));
+  mlkv::Decode(format, row, dim, reinterpret_cast<float*>(output));
+}
+
+/// Stores "length" bytes of float32 weights at the start of a row.
+inline void write_weights(mlkv::Format format, const uint8_t* input, uint64_t length,
+                          uint8_t* row) {
+  if(format == mlkv::Format::Fp32) {
+    std::memcpy(row, input, length);
+    return;
+  }
+  mlkv::Encode(format, reinterpret_cast<const float*>(input), length / sizeof(float), row);
+}
+
+/// Adds a float32 increment to the first "length" bytes' worth of weights of a row. Quantized
+/// weights are decoded, updated in float32, and stored again.
+inline void add_weights(mlkv::Format format, const float* incr, uint64_t length, uint8_t* row) {
+  float* weights = reinterpret_cast<float*>(row);
+  if(format != mlkv::Format::Fp32) {
+    weights = scratch_weights(length);
+    read_weights(format, row, stored_length(format, length), reinterpret_cast<uint8_t*>(weights),
+                 length);
+  }
+  for(uint64_t idx = 0; idx < length / sizeof(float); ++idx) {
+    weights[idx] += incr[idx];
+  }
+  if(format != mlkv::Format::Fp32) {
+    write_weights(format, reinterpret_cast<const uint8_t*>(weights), length, row);
+  }
+}
+
+/// Fills the weights of a row created on first touch, per the store's initializer. Returns false
+/// if the store has none.
+inline bool initialize_row(const mlkv::Initializer* initializer, mlkv::Format format,
+                           const Key& key, uint8_t* row, uint64_t length) {
+  if(!initializer || initializer->init == mlkv::Init::None) {
+    return false;
+  }
+  float* weights = format == mlkv::Format::Fp32 ? reinterpret_cast<float*>(row) :
+                   scratch_weights(length);
+  mlkv::InitializeRow(*initializer, key.value(), weights, length / sizeof(float));
+  if(format != mlkv::Format::Fp32) {
+    write_weights(format, reinterpret_cast<const uint8_t*>(weights), length, row);
+  }
+  return true;
+}
+
+// MLKV contexts are templated on the value type, so that stores opened by faster_open_fixed()
+// share them.
+extern "C++" {
+
 class Value {
   public:
     Value()
@@ -126,24 +797,99 @@ class Value {
       return size_;
     }
 
+    /// The interface that MLKV contexts use, shared with FixedValue: the row's length, and how
+    /// many bytes the record has room for.
+    static constexpr bool kFixedLength = false;
+    inline static constexpr uint32_t size_for(uint64_t length) {
+      return static_cast<uint32_t>(sizeof(Value) + length);
+    }
+    inline static constexpr bool holds(uint64_t length) {
+      return true;
+    }
+    inline AtomicGenLock& gen_lock() const {
+      return gen_lock_;
+    }
+    inline uint64_t length() const {
+      return length_;
+    }
+    inline void set_length(uint64_t length) {
+      length_ = length;
+    }
+    inline uint64_t capacity() const {
+      return size_ - sizeof(Value);
+    }
+    inline void set_capacity(uint64_t capacity) {
+      size_ = sizeof(Value) + capacity;
+    }
+
+    inline const uint8_t* buffer() const {
+      return reinterpret_cast<const uint8_t*>(this + 1);
+    }
+    inline uint8_t* buffer() {
+      return reinterpret_cast<uint8_t*>(this + 1);
+    }
+
     friend class UpsertContext;
     friend class ReadContext;
     friend class RmwContext;
-    friend class MLKVReadContext;
-    friend class MLKVUpsertContext;
-    friend class MLKVLookaheadContext;
 
   private:
-    AtomicGenLock gen_lock_;
+    /// Mutable, since reads of the mutable region lock the row to update its staleness.
+    mutable AtomicGenLock gen_lock_;
     uint64_t size_;
     uint64_t length_;
+};
+
+/// A row of exactly "Length" bytes, for stores opened by faster_open_fixed(). Every record has
+/// the same size, so only the generation lock (which packs the staleness) precedes the row;
+/// shorter rows are padded.
+template <uint32_t Length>
+class FixedValue {
+  public:
+    FixedValue()
+      : gen_lock_{ 0 } {
+    }
+
+    inline static constexpr uint32_t size() {
+      return static_cast<uint32_t>(sizeof(FixedValue));
+    }
+
+    static constexpr bool kFixedLength = true;
+    inline static constexpr uint32_t size_for(uint64_t length) {
+      return size();
+    }
+    inline static constexpr bool holds(uint64_t length) {
+      return length <= Length;
+    }
+    inline AtomicGenLock& gen_lock() const {
+      return gen_lock_;
+    }
+    inline uint64_t length() const {
+      return Length;
+    }
+    inline void set_length(uint64_t length) {
+      assert(length <= Length);
+    }
+    inline uint64_t capacity() const {
+      return Length;
+    }
+    /// Contexts set the capacity of each new record (initial or copied) before writing its row;
+    /// the padding past the row is zeroed, so that no uninitialized bytes are flushed to disk.
+    inline void set_capacity(uint64_t capacity) {
+      assert(capacity <= Length);
+      std::memset(buffer_ + capacity, 0, Length - capacity);
+    }
 
     inline const uint8_t* buffer() const {
-      return reinterpret_cast<const uint8_t*>(this + 1);
+      return buffer_;
     }
     inline uint8_t* buffer() {
-      return reinterpret_cast<uint8_t*>(this + 1);
+      return buffer_;
     }
+
+  private:
+    mutable AtomicGenLock gen_lock_;
+    uint8_t buffer_[Length];
 };
 
 class ReadContext : public IAsyncContext {
@@ -326,10 +1072,11 @@ class RmwContext : public IAsyncContext {
     uint64_t length_;
 };
 
+template <class K, class V>
 class DeleteContext : public IAsyncContext {
   public:
-      typedef Key key_t;
-      typedef Value value_t;
+      typedef K key_t;
+      typedef V value_t;
 
       DeleteContext(uint64_t key)
       : key_{ key } {
@@ -359,27 +1106,41 @@ class DeleteContext : public IAsyncContext {
       key_t key_;
 };
 
+template <class K, class V>
 class MLKVReadContext : public IAsyncContext {
  public:
-  typedef Key key_t;
-  typedef Value value_t;
-
-  MLKVReadContext(uint64_t key, uint8_t* output, uint64_t length,
-                  int32_t staleness_incr, int32_t staleness_bound)
-    : key_{ key }
+  typedef K key_t;
+  typedef V value_t;
+
+  MLKVReadContext(uint64_t key, uint8_t* output, uint64_t length, mlkv::Format format,
+                  int32_t staleness_incr, int32_t staleness_bound, StalenessTable* staleness_table,
+                  const mlkv::Initializer* initializer = nullptr, uint8_t* status = nullptr)
+    : found{ false }
+    , counted{ false }
+    , key_{ key }
     , output_{ output }
     , length_{ length }
+    , format_{ format }
     , staleness_incr_{ staleness_incr }
-    , staleness_bound_{ staleness_bound } {
+    , staleness_bound_{ staleness_bound }
+    , staleness_table_{ staleness_table }
+    , initializer_{ initializer }
+    , status_{ status } {
   }
 
   /// Copy (and deep-copy) constructor.
   MLKVReadContext(const MLKVReadContext& other)
-    : key_{ other.key_ }
+    : found{ other.found }
+    , counted{ other.counted }
+    , key_{ other.key_ }
     , output_{ other.output_ }
     , length_{ other.length_ }
+    , format_{ other.format_ }
     , staleness_incr_{ other.staleness_incr_ }
-    , staleness_bound_{ other.staleness_bound_ } {
+    , staleness_bound_{ other.staleness_bound_ }
+    , staleness_table_{ other.staleness_table_ }
+    , initializer_{ other.initializer_ }
+    , status_{ other.status_ } {
   }
 
   /// The implicit and explicit interfaces require a key() accessor.
@@ -387,49 +1148,101 @@ class MLKVReadContext : public IAsyncContext {
     return key_;
   }
   inline int32_t value_size() const {
-    return sizeof(value_t) + length_;
+    return value_t::size_for(weights_length());
   }
   inline uint32_t value_size(const value_t& old_value) const {
-    return sizeof(value_t) + length_;
+    // Keep whatever the row holds beyond what this read returns (e.g., optimizer state).
+    return value_t::size_for(std::max(weights_length(), old_value.length()));
+  }
+  /// Where a batched read wants this key's final status written, if the read goes pending.
+  inline uint8_t* status() const {
+    return status_;
   }
 
-  /// Initial, non-atomic, and atomic RMW methods.
+  /// Non-atomic and atomic Get() methods, for reads issued through Read(). An immutable record
+  /// stays where it is; the read is counted in the side table instead. Unless the read could
+  /// reach the staleness bound, a mutable record is not locked either, but read optimistically.
+  inline void Get(const value_t& value) {
+    if(count_read_optimistic(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                             staleness_bound_)) {
+      counted = true;
+    } else {
+      counted = staleness_table_->add(key_.GetHash(), staleness_incr_);
+    }
+    read_weights(format_, value.buffer(), value.length(), output_, length_);
+    found = true;
+  }
+  inline void GetAtomic(const value_t& value) {
+    if(count_read_optimistic(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                             staleness_bound_)) {
+      read_row_optimistic(value.gen_lock(), [&]() {
+        read_weights(format_, value.buffer(), value.length(), output_, length_);
+      });
+      counted = true;
+      found = true;
+      return;
+    }
+    if(!lock_row(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                 staleness_bound_)) {
+      // Some other thread is replacing this record; its contents are final.
+      GenLock before, after;
+      do {
+        before = value.gen_lock().load();
+        read_weights(format_, value.buffer(), value.length(), output_, length_);
+        after = value.gen_lock().load();
+      } while(before.gen_number != after.gen_number);
+      counted = staleness_table_->add(key_.GetHash(), staleness_incr_);
+      found = true;
+      return;
+    }
+    read_weights(format_, value.buffer(), value.length(), output_, length_);
+    value.gen_lock().unlock(false);
+    counted = true;
+    found = true;
+  }
+
+  /// Initial, non-atomic, and atomic RMW methods, for reads issued through Rmw(), which count the
+  /// read by copying an immutable record to the tail.
   inline void RmwInitial(value_t& value) {
-    // assert(false);
-    found = false;
+    GenLock initial;
+    initial.staleness = staleness_incr_;
+    value.gen_lock().store(initial);
+    value.set_capacity(weights_length());
+    value.set_length(weights_length());
+    // Without an initializer, the row is created but reported as missing.
+    found = initialize_row(initializer_, format_, key_, value.buffer(), length_);
+    if(found) {
+      // Return the weights as stored, so that later reads agree with this one.
+      read_weights(format_, value.buffer(), value.length(), output_, length_);
+    }
   }
   inline void RmwCopy(const value_t& old_value, value_t& value) {
     GenLock before, after;
-    before = old_value.gen_lock_.load();
+    before = old_value.gen_lock().load();
     after.staleness = before.staleness + staleness_incr_;
 
-    value.gen_lock_.store(after);
-    value.size_ = sizeof(value_t) + length_;
-    value.length_ = length_;
+    value.gen_lock().store(after);
+    value.set_capacity(std::max(weights_length(), old_value.length()));
+    value.set_length(std::max(weights_length(), old_value.length()));
 
-    std::memcpy(value.buffer(), old_value.buffer(), old_value.length_);
-    std::memcpy(output_, old_value.buffer(), old_value.length_);
+    std::memcpy(value.buffer(), old_value.buffer(), old_value.length());
+    read_weights(format_, old_value.buffer(), old_value.length(), output_, length_);
     found = true;
   }
   inline bool RmwAtomic(value_t& value) {
-    bool replaced;
-    while(!value.gen_lock_.try_lock(replaced, staleness_incr_, staleness_bound_)
-          && !replaced) {
-      std::this_thread::yield();
-    }
-    if(replaced) {
+    if(!lock_row(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                 staleness_bound_)) {
       // Some other thread replaced this record.
       return false;
     }
-    if(value.size_ < sizeof(value_t) + length_) {
+    if(value.capacity() < weights_length()) {
       // Current value is too small for in-place update.
-      value.gen_lock_.unlock(true);
+      value.gen_lock().unlock(true);
       return false;
     }
-    // In-place update overwrites length and buffer, but not size.
-    value.length_ = length_;
-    std::memcpy(output_, value.buffer(), value.length_);
-    value.gen_lock_.unlock(false);
+    // A read returns the row's weights, and leaves the rest in place.
+    read_weights(format_, value.buffer(), value.length(), output_, length_);
+    value.gen_lock().unlock(false);
     found = true;
     return true;
   }
@@ -442,83 +1255,245 @@ class MLKVReadContext : public IAsyncContext {
 
  public:
   bool found;
+  /// False if a read of an immutable record could not be counted in the side table.
+  bool counted;
 
  private:
+  inline uint64_t weights_length() const {
+    return stored_length(format_, length_);
+  }
+
   key_t key_;
   uint8_t* output_;
+  /// Bytes of float32 weights to return.
   uint64_t length_;
+  mlkv::Format format_;
   int32_t staleness_incr_;
   int32_t staleness_bound_;
+  StalenessTable* staleness_table_;
+  const mlkv::Initializer* initializer_;
+  uint8_t* status_;
 };
 
-class MLKVUpsertContext : public IAsyncContext {
+/// Reads a row for mlkv_read_pinned(): rather than copy float32 weights out of the log, it points
+/// "row" at them and snapshots the row's GenLock. Rows read from disk, or stored in a quantized
+/// format, are decoded into a pooled buffer instead.
+template <class K, class V>
+class MLKVPinnedReadContext : public IAsyncContext {
  public:
-  typedef Key key_t;
-  typedef Value value_t;
-
-  MLKVUpsertContext(uint64_t key, uint8_t* input, uint64_t length,
-                    int32_t staleness_incr, int32_t staleness_bound)
-    : key_{ key }
-    , input_{ input }
+  typedef K key_t;
+  typedef V value_t;
+
+  MLKVPinnedReadContext(uint64_t key, uint64_t length, mlkv::Format format,
+                        int32_t staleness_incr, int32_t staleness_bound,
+                        StalenessTable* staleness_table, mlkv_pinned_row* row, uint8_t* status)
+    : found{ false }
+    , counted{ false }
+    , key_{ key }
     , length_{ length }
+    , format_{ format }
     , staleness_incr_{ staleness_incr }
-    , staleness_bound_{ staleness_bound } {
+    , staleness_bound_{ staleness_bound }
+    , staleness_table_{ staleness_table }
+    , row_{ row }
+    , status_{ status }
+    , from_disk_{ false } {
   }
 
-  /// Copy (and deep-copy) constructor.
-  MLKVUpsertContext(const MLKVUpsertContext& other)
-    : key_{ other.key_ }
-    , input_{ other.input_ }
+  /// Copy (and deep-copy) constructor. Only a read that goes pending is copied, and its record is
+  /// then in an I/O buffer that is freed once the read completes.
+  MLKVPinnedReadContext(const MLKVPinnedReadContext& other)
+    : found{ other.found }
+    , counted{ other.counted }
+    , key_{ other.key_ }
     , length_{ other.length_ }
+    , format_{ other.format_ }
     , staleness_incr_{ other.staleness_incr_ }
-    , staleness_bound_{ other.staleness_bound_ } {
+    , staleness_bound_{ other.staleness_bound_ }
+    , staleness_table_{ other.staleness_table_ }
+    , row_{ other.row_ }
+    , status_{ other.status_ }
+    , from_disk_{ true } {
   }
 
   /// The implicit and explicit interfaces require a key() accessor.
   const key_t& key() const {
     return key_;
   }
-  inline int32_t value_size() const {
-    return sizeof(value_t) + length_;
-  }
-  inline uint32_t value_size(const value_t& old_value) const {
-    return sizeof(value_t) + length_;
+  inline uint8_t* status() const {
+    return status_;
+  }
+
+  /// "address" is where the record lives in the log's memory, so that mlkv_read_pinned() can pin
+  /// its page; it is invalid for records read from disk or the read cache.
+  inline void Get(const value_t& value, Address address) {
+    if(count_read_optimistic(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                             staleness_bound_)) {
+      counted = true;
+    } else {
+      counted = staleness_table_->add(key_.GetHash(), staleness_incr_);
+    }
+    Pin(value, address);
+  }
+  inline void GetAtomic(const value_t& value, Address address) {
+    if(count_read_optimistic(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                             staleness_bound_)) {
+      // Pin() snapshots the row once no writer holds it.
+      counted = true;
+    } else if(lock_row(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                       staleness_bound_)) {
+      value.gen_lock().unlock(false);
+      counted = true;
+    } else {
+      // Some other thread is replacing this record; its contents are final.
+      counted = staleness_table_->add(key_.GetHash(), staleness_incr_);
+    }
+    Pin(value, address);
+  }
+
+ protected:
+  /// The explicit interface requires a DeepCopy_Internal() implementation.
+  Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+    return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+  }
+
+ public:
+  bool found;
+  /// False if a read of an immutable record could not be counted in the side table.
+  bool counted;
+
+ private:
+  inline void Pin(const value_t& value, Address address) {
+    found = true;
+    if(format_ == mlkv::Format::Fp32 && !from_disk_) {
+      GenLock gen_lock = value.gen_lock().load();
+      while(gen_lock.locked) {
+        std::this_thread::yield();
+        gen_lock = value.gen_lock().load();
+      }
+      row_->gen = gen_lock.control_;
+      row_->record = &value.gen_lock();
+      row_->data = value.buffer();
+      row_->length = std::min(length_, value.length());
+      row_->address = address.control();
+      return;
+    }
+    auto* buffer = acquire_pinned_buffer(length_);
+    if(from_disk_) {
+      read_weights(format_, value.buffer(), value.length(), buffer->data(), length_);
+    } else {
+      read_row_optimistic(value.gen_lock(), [&]() {
+        read_weights(format_, value.buffer(), value.length(), buffer->data(), length_);
+      });
+    }
+    row_->buffer = buffer;
+    row_->data = buffer->data();
+    row_->length = length_;
+  }
+
+  key_t key_;
+  /// Bytes of float32 weights to return.
+  uint64_t length_;
+  mlkv::Format format_;
+  int32_t staleness_incr_;
+  int32_t staleness_bound_;
+  StalenessTable* staleness_table_;
+  mlkv_pinned_row* row_;
+  uint8_t* status_;
+  bool from_disk_;
+};
+
+template <class K, class V>
+class MLKVUpsertContext : public IAsyncContext {
+ public:
+  typedef K key_t;
+  typedef V value_t;
+
+  MLKVUpsertContext(uint64_t key, uint8_t* input, uint64_t length, mlkv::Format format,
+                    uint32_t state_slots, int32_t staleness_incr, int32_t staleness_bound,
+                    StalenessTable* staleness_table, uint8_t* status = nullptr)
+    : key_{ key }
+    , input_{ input }
+    , length_{ length }
+    , format_{ format }
+    , state_slots_{ state_slots }
+    , staleness_incr_{ staleness_incr }
+    , staleness_bound_{ staleness_bound }
+    , staleness_table_{ staleness_table }
+    , status_{ status } {
+  }
+
+  /// Copy (and deep-copy) constructor.
+  MLKVUpsertContext(const MLKVUpsertContext& other)
+    : key_{ other.key_ }
+    , input_{ other.input_ }
+    , length_{ other.length_ }
+    , format_{ other.format_ }
+    , state_slots_{ other.state_slots_ }
+    , staleness_incr_{ other.staleness_incr_ }
+    , staleness_bound_{ other.staleness_bound_ }
+    , staleness_table_{ other.staleness_table_ }
+    , status_{ other.status_ } {
+  }
+
+  /// The implicit and explicit interfaces require a key() accessor.
+  const key_t& key() const {
+    return key_;
+  }
+  inline int32_t value_size() const {
+    return value_t::size_for(row_length());
+  }
+  inline uint32_t value_size(const value_t& old_value) const {
+    return value_t::size_for(row_length());
+  }
+  /// Where a batched upsert wants this key's final status written, if the upsert goes pending.
+  inline uint8_t* status() const {
+    return status_;
   }
 
   /// Initial, non-atomic, and atomic RMW methods.
   inline void RmwInitial(value_t& value) {
-    // assert(false);
+    value.gen_lock().store(0);
+    value.set_capacity(row_length());
+    value.set_length(row_length());
+    write_weights(format_, input_, length_, value.buffer());
+    std::memset(value.buffer() + weights_length(), 0, row_length() - weights_length());
   }
   inline void RmwCopy(const value_t& old_value, value_t& value) {
     GenLock before, after;
-    before = old_value.gen_lock_.load();
+    before = old_value.gen_lock().load();
     after.staleness = before.staleness + staleness_incr_;
 
-    value.gen_lock_.store(after);
-    value.size_ = sizeof(value_t) + length_;
-    value.length_ = length_;
+    value.gen_lock().store(after);
+    value.set_capacity(row_length());
+    value.set_length(row_length());
 
-    std::memcpy(value.buffer(), input_, length_);
+    write_weights(format_, input_, length_, value.buffer());
+    // Carry over the row's optimizer state, if it has any yet.
+    uint64_t kept = std::max(weights_length(), std::min(old_value.length(), row_length()));
+    std::memcpy(value.buffer() + weights_length(), old_value.buffer() + weights_length(),
+                kept - weights_length());
+    std::memset(value.buffer() + kept, 0, row_length() - kept);
   }
   inline bool RmwAtomic(value_t& value) {
-    bool replaced;
-    while(!value.gen_lock_.try_lock(replaced, staleness_incr_, staleness_bound_)
-          && !replaced) {
-      std::this_thread::yield();
-    }
-    if(replaced) {
+    if(!lock_row(value.gen_lock(), staleness_table_, key_.GetHash(), staleness_incr_,
+                 staleness_bound_)) {
       // Some other thread replaced this record.
       return false;
     }
-    if(value.size_ < sizeof(value_t) + length_) {
+    if(value.capacity() < row_length()) {
       // Current value is too small for in-place update.
-      value.gen_lock_.unlock(true);
+      value.gen_lock().unlock(true);
       return false;
     }
-    // In-place update overwrites length and buffer, but not size.
-    value.length_ = length_;
-    std::memcpy(value.buffer(), input_, length_);
-    value.gen_lock_.unlock(false);
+    // In-place update overwrites the weights, but not the optimizer state or size.
+    if(value.length() < row_length()) {
+      std::memset(value.buffer() + weights_length(), 0, row_length() - weights_length());
+    }
+    value.set_length(row_length());
+    write_weights(format_, input_, length_, value.buffer());
+    value.gen_lock().unlock(false);
+    staleness_table_->notify(key_.GetHash());
     return true;
   }
 
@@ -529,27 +1504,384 @@ class MLKVUpsertContext : public IAsyncContext {
   }
 
  private:
+  /// Quantized weights, then (aligned) float32 optimizer state.
+  inline uint64_t weights_length() const {
+    return stored_length(format_, length_);
+  }
+  inline uint64_t row_length() const {
+    return state_offset(format_, length_) + length_ * state_slots_;
+  }
+
   key_t key_;
   uint8_t* input_;
   uint64_t length_;
+  mlkv::Format format_;
+  uint32_t state_slots_;
+  int32_t staleness_incr_;
+  int32_t staleness_bound_;
+  StalenessTable* staleness_table_;
+  uint8_t* status_;
+};
+
+/// Adds a float32 increment (e.g., an aggregated gradient) to the stored row; a missing row
+/// starts from the store's initializer, or from zero.
+template <class K, class V>
+class MLKVRmwContext : public IAsyncContext {
+ public:
+  typedef K key_t;
+  typedef V value_t;
+
+  MLKVRmwContext(uint64_t key, uint8_t* incr, uint64_t length, mlkv::Format format,
+                 int32_t staleness_incr, int32_t staleness_bound,
+                 StalenessTable* staleness_table, CombiningTable* combining,
+                 const mlkv::Initializer* initializer, uint8_t* status = nullptr)
+    : key_{ key }
+    , incr_{ incr }
+    , length_{ length }
+    , format_{ format }
+    , staleness_incr_{ staleness_incr }
+    , staleness_bound_{ staleness_bound }
+    , staleness_table_{ staleness_table }
+    , combining_{ combining }
+    , initializer_{ initializer }
+    , status_{ status } {
+  }
+
+  /// Copy (and deep-copy) constructor.
+  MLKVRmwContext(const MLKVRmwContext& other)
+    : key_{ other.key_ }
+    , incr_{ other.incr_ }
+    , length_{ other.length_ }
+    , format_{ other.format_ }
+    , staleness_incr_{ other.staleness_incr_ }
+    , staleness_bound_{ other.staleness_bound_ }
+    , staleness_table_{ other.staleness_table_ }
+    , combining_{ other.combining_ }
+    , initializer_{ other.initializer_ }
+    , status_{ other.status_ } {
+  }
+
+  /// The implicit and explicit interfaces require a key() accessor.
+  const key_t& key() const {
+    return key_;
+  }
+  inline int32_t value_size() const {
+    return value_t::size_for(weights_length());
+  }
+  inline uint32_t value_size(const value_t& old_value) const {
+    // Keep whatever the row holds beyond the weights (e.g., optimizer state).
+    return value_t::size_for(std::max(weights_length(), old_value.length()));
+  }
+  /// Where a batched RMW wants this key's final status written, if the RMW goes pending.
+  inline uint8_t* status() const {
+    return status_;
+  }
+
+  /// Initial, non-atomic, and atomic RMW methods.
+  inline void RmwInitial(value_t& value) {
+    value.gen_lock().store(0);
+    value.set_capacity(weights_length());
+    value.set_length(weights_length());
+    if(initialize_row(initializer_, format_, key_, value.buffer(), length_)) {
+      Add(value);
+    } else {
+      write_weights(format_, incr_, length_, value.buffer());
+    }
+  }
+  inline void RmwCopy(const value_t& old_value, value_t& value) {
+    GenLock before, after;
+    before = old_value.gen_lock().load();
+    after.staleness = before.staleness + staleness_incr_;
+
+    value.gen_lock().store(after);
+    value.set_capacity(std::max(weights_length(), old_value.length()));
+    value.set_length(std::max(weights_length(), old_value.length()));
+
+    std::memcpy(value.buffer(), old_value.buffer(), old_value.length());
+    std::memset(value.buffer() + old_value.length(), 0, value.length() - old_value.length());
+    Add(value);
+  }
+  inline bool RmwAtomic(value_t& value) {
+    KeyHash hash = key_.GetHash();
+    const float* incr = reinterpret_cast<const float*>(incr_);
+    uint64_t dim = length_ / sizeof(float);
+    if(combining_ && publish_while_locked(value.gen_lock(), combining_, hash, incr, dim,
+                                          staleness_incr_)) {
+      return true;
+    }
+    if(!lock_row(value.gen_lock(), staleness_table_, hash, staleness_incr_, staleness_bound_)) {
+      // Some other thread replaced this record.
+      return false;
+    }
+    if(value.capacity() < weights_length()) {
+      // Current value is too small for in-place update.
+      value.gen_lock().unlock(true);
+      return false;
+    }
+    if(value.length() < weights_length()) {
+      std::memset(value.buffer() + value.length(), 0, weights_length() - value.length());
+      value.set_length(weights_length());
+    }
+    bool combine = combining_ && combining_->activate(hash, dim);
+    Add(value);
+    if(combine) {
+      combine_updates(combining_, value.gen_lock(), hash, [&](const float* sum) {
+        add_weights(format_, sum, length_, value.buffer());
+      });
+    }
+    value.gen_lock().unlock(false);
+    staleness_table_->notify(key_.GetHash());
+    return true;
+  }
+
+ protected:
+  /// The explicit interface requires a DeepCopy_Internal() implementation.
+  Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+    return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+  }
+
+ private:
+  inline uint64_t weights_length() const {
+    return stored_length(format_, length_);
+  }
+  inline void Add(value_t& value) const {
+    add_weights(format_, reinterpret_cast<const float*>(incr_), length_, value.buffer());
+  }
+
+  key_t key_;
+  uint8_t* incr_;
+  uint64_t length_;
+  mlkv::Format format_;
+  int32_t staleness_incr_;
+  int32_t staleness_bound_;
+  StalenessTable* staleness_table_;
+  CombiningTable* combining_;
+  const mlkv::Initializer* initializer_;
+  uint8_t* status_;
+};
+
+/// Applies one optimizer step for a float32 gradient. The row holds the weights (in the store's
+/// format) followed by "state_slots" float32 state vectors, of which the optimizer uses the first
+/// few (none for SGD, the accumulator for Adagrad, both moments for Adam); a missing row starts
+/// from the store's initializer (or zero), with zero state.
+template <class K, class V>
+class MLKVOptimizerContext : public IAsyncContext {
+ public:
+  typedef K key_t;
+  typedef V value_t;
+
+  MLKVOptimizerContext(uint64_t key, const uint8_t* grad, uint64_t grad_length,
+                       mlkv::Format format, uint32_t state_slots,
+                       const mlkv::OptimizerConfig& config, int32_t staleness_incr,
+                       int32_t staleness_bound, StalenessTable* staleness_table,
+                       CombiningTable* combining, const mlkv::Initializer* initializer)
+    : key_{ key }
+    , grad_{ grad }
+    , grad_length_{ grad_length }
+    , format_{ format }
+    , state_slots_{ state_slots }
+    , config_{ config }
+    , staleness_incr_{ staleness_incr }
+    , staleness_bound_{ staleness_bound }
+    , staleness_table_{ staleness_table }
+    , combining_{ config.optimizer == mlkv::Optimizer::Sgd ? combining : nullptr }
+    , initializer_{ initializer } {
+  }
+
+  /// Copy (and deep-copy) constructor.
+  MLKVOptimizerContext(const MLKVOptimizerContext& other)
+    : key_{ other.key_ }
+    , grad_{ other.grad_ }
+    , grad_length_{ other.grad_length_ }
+    , format_{ other.format_ }
+    , state_slots_{ other.state_slots_ }
+    , config_{ other.config_ }
+    , staleness_incr_{ other.staleness_incr_ }
+    , staleness_bound_{ other.staleness_bound_ }
+    , staleness_table_{ other.staleness_table_ }
+    , combining_{ other.combining_ }
+    , initializer_{ other.initializer_ } {
+  }
+
+  /// The implicit and explicit interfaces require a key() accessor.
+  const key_t& key() const {
+    return key_;
+  }
+  inline int32_t value_size() const {
+    return value_t::size_for(row_length());
+  }
+  inline uint32_t value_size(const value_t& old_value) const {
+    return value_t::size_for(row_length());
+  }
+
+  /// Initial, non-atomic, and atomic RMW methods.
+  inline void RmwInitial(value_t& value) {
+    value.gen_lock().store(0);
+    value.set_capacity(row_length());
+    value.set_length(row_length());
+    std::memset(value.buffer(), 0, row_length());
+    initialize_row(initializer_, format_, key_, value.buffer(), grad_length_);
+    Apply(value);
+  }
+  inline void RmwCopy(const value_t& old_value, value_t& value) {
+    GenLock before, after;
+    before = old_value.gen_lock().load();
+    after.staleness = before.staleness + staleness_incr_;
+
+    value.gen_lock().store(after);
+    value.set_capacity(row_length());
+    value.set_length(row_length());
+
+    uint64_t copied = std::min(old_value.length(), row_length());
+    std::memcpy(value.buffer(), old_value.buffer(), copied);
+    std::memset(value.buffer() + copied, 0, row_length() - copied);
+    Apply(value);
+  }
+  inline bool RmwAtomic(value_t& value) {
+    KeyHash hash = key_.GetHash();
+    uint64_t dim = grad_length_ / sizeof(float);
+    if(combining_) {
+      // An SGD step is additive: publish it as -learning_rate * gradient.
+      static thread_local std::vector<float> step;
+      step.resize(dim);
+      const float* grad = reinterpret_cast<const float*>(grad_);
+      for(uint64_t idx = 0; idx < dim; ++idx) {
+        step[idx] = -config_.learning_rate * grad[idx];
+      }
+      if(publish_while_locked(value.gen_lock(), combining_, hash, step.data(), dim,
+                              staleness_incr_)) {
+        return true;
+      }
+    }
+    if(!lock_row(value.gen_lock(), staleness_table_, hash, staleness_incr_, staleness_bound_)) {
+      // Some other thread replaced this record.
+      return false;
+    }
+    if(value.capacity() < row_length()) {
+      // Current value is too small to hold the optimizer state.
+      value.gen_lock().unlock(true);
+      return false;
+    }
+    // In-place update overwrites length and buffer, but not size.
+    value.set_length(row_length());
+    bool combine = combining_ && combining_->activate(hash, dim);
+    Apply(value);
+    if(combine) {
+      combine_updates(combining_, value.gen_lock(), hash, [&](const float* sum) {
+        add_weights(format_, sum, grad_length_, value.buffer());
+      });
+    }
+    value.gen_lock().unlock(false);
+    staleness_table_->notify(key_.GetHash());
+    return true;
+  }
+
+ protected:
+  /// The explicit interface requires a DeepCopy_Internal() implementation.
+  Status DeepCopy_Internal(IAsyncContext*& context_copy) {
+    return IAsyncContext::DeepCopy_Internal(*this, context_copy);
+  }
+
+ private:
+  inline uint64_t weights_length() const {
+    return stored_length(format_, grad_length_);
+  }
+  inline uint64_t row_length() const {
+    return state_offset(format_, grad_length_) + grad_length_ * state_slots_;
+  }
+  /// Quantized weights are decoded, updated in float32, and stored again; the state is updated
+  /// in place.
+  inline void Apply(value_t& value) const {
+    float* weights = reinterpret_cast<float*>(value.buffer());
+    if(format_ != mlkv::Format::Fp32) {
+      weights = scratch_weights(grad_length_);
+      read_weights(format_, value.buffer(), weights_length(),
+                   reinterpret_cast<uint8_t*>(weights), grad_length_);
+    }
+    mlkv::ApplyOptimizer(config_, weights,
+                         reinterpret_cast<float*>(value.buffer() +
+                                                  state_offset(format_, grad_length_)),
+                         reinterpret_cast<const float*>(grad_), grad_length_ / sizeof(float));
+    if(format_ != mlkv::Format::Fp32) {
+      write_weights(format_, reinterpret_cast<const uint8_t*>(weights), grad_length_,
+                    value.buffer());
+    }
+  }
+
+  key_t key_;
+  const uint8_t* grad_;
+  uint64_t grad_length_;
+  mlkv::Format format_;
+  uint32_t state_slots_;
+  mlkv::OptimizerConfig config_;
   int32_t staleness_incr_;
   int32_t staleness_bound_;
+  StalenessTable* staleness_table_;
+  /// Only SGD steps, which are additive, are combined.
+  CombiningTable* combining_;
+  const mlkv::Initializer* initializer_;
+};
+
+/// Shared by a store's lookahead threads: what became of the keys they prefetched, and the last
+/// lookahead ticket the trainer has started consuming.
+struct LookaheadState {
+  LookaheadState()
+    : hot{ 0 }
+    , in_time{ 0 }
+    , late{ 0 }
+    , consumed_through{ 0 } {
+  }
+
+  /// Counts one prefetched key of "ticket"; "copied" is false if the row was already mutable.
+  inline void record(uint64_t ticket, bool copied) {
+    if(!copied) {
+      ++hot;
+    } else if(consumed(ticket)) {
+      ++late;
+    } else {
+      ++in_time;
+    }
+  }
+  inline bool consumed(uint64_t ticket) const {
+    return ticket <= consumed_through.load();
+  }
+
+  std::atomic<uint64_t> hot;
+  std::atomic<uint64_t> in_time;
+  std::atomic<uint64_t> late;
+  std::atomic<uint64_t> consumed_through;
 };
 
+template <class K, class V>
 class MLKVLookaheadContext : public IAsyncContext {
   public:
-   typedef Key key_t;
-   typedef Value value_t;
-
-   MLKVLookaheadContext(uint64_t key, uint64_t length)
-     : key_{ key }
-     , length_{ length } {
+   typedef K key_t;
+   typedef V value_t;
+
+   MLKVLookaheadContext(uint64_t key, uint64_t length, mlkv::Format format,
+                        const mlkv::Initializer* initializer = nullptr,
+                        LookaheadState* state = nullptr, uint64_t ticket = 0,
+                        uint32_t* in_flight = nullptr)
+     : copied{ false }
+     , key_{ key }
+     , length_{ length }
+     , format_{ format }
+     , initializer_{ initializer }
+     , state_{ state }
+     , ticket_{ ticket }
+     , in_flight_{ in_flight } {
    }
 
    /// Copy (and deep-copy) constructor.
    MLKVLookaheadContext(const MLKVLookaheadContext& other)
-     : key_{ other.key_ }
-     , length_{ other.length_ } {
+     : copied{ other.copied }
+     , key_{ other.key_ }
+     , length_{ other.length_ }
+     , format_{ other.format_ }
+     , initializer_{ other.initializer_ }
+     , state_{ other.state_ }
+     , ticket_{ other.ticket_ }
+     , in_flight_{ other.in_flight_ } {
    }
 
    /// The implicit and explicit interfaces require a key() accessor.
@@ -557,24 +1889,47 @@ class MLKVLookaheadContext : public IAsyncContext {
      return key_;
    }
    inline uint32_t value_size() const {
-     return sizeof(value_t) + length_;
+     return value_t::size_for(stored_length(format_, length_));
    }
    inline uint32_t value_size(const value_t& old_value) const {
-     return sizeof(value_t) + old_value.length_;
+     return value_t::size_for(old_value.length());
+   }
+   /// For prefetches issued by a lookahead thread: the shared counters, the ticket this key
+   /// belongs to, and the thread's count of prefetches still waiting on disk.
+   inline LookaheadState* state() const {
+     return state_;
+   }
+   inline uint64_t ticket() const {
+     return ticket_;
+   }
+   inline uint32_t* in_flight() const {
+     return in_flight_;
+   }
+
+   /// A missing row is created ahead of time, if the store has an initializer; otherwise the
+   /// prefetch finds nothing, and Rmw() returns Status::NotFound.
+   inline bool RmwInitialAllowed() const {
+     return initializer_ && initializer_->init != mlkv::Init::None;
    }
    inline void RmwInitial(value_t& value) {
-     assert(false);
+     value.gen_lock().store(0);
+     value.set_capacity(stored_length(format_, length_));
+     value.set_length(stored_length(format_, length_));
+     bool initialized = initialize_row(initializer_, format_, key_, value.buffer(), length_);
+     assert(initialized);
+     copied = true;
    }
    inline void RmwCopy(const value_t& old_value, value_t& value) {
      GenLock before, after;
-     before = old_value.gen_lock_.load();
+     before = old_value.gen_lock().load();
      after.staleness = before.staleness;
 
-     value.gen_lock_.store(after);
-     value.size_ = sizeof(value_t) + length_;
-     value.length_ = length_;
+     value.gen_lock().store(after);
+     value.set_capacity(old_value.length());
+     value.set_length(old_value.length());
 
-     std::memcpy(value.buffer(), old_value.buffer(), old_value.length_);
+     std::memcpy(value.buffer(), old_value.buffer(), old_value.length());
+     copied = true;
    }
    inline bool RmwAtomic(value_t& value) {
      return true;
@@ -586,116 +1941,2004 @@ class MLKVLookaheadContext : public IAsyncContext {
       return IAsyncContext::DeepCopy_Internal(*this, context_copy);
     }
 
+   public:
+    /// True if the row was copied to the tail, false if it was already mutable.
+    bool copied;
+
    private:
     key_t key_;
     uint64_t length_;
+    mlkv::Format format_;
+    const mlkv::Initializer* initializer_;
+    LookaheadState* state_;
+    uint64_t ticket_;
+    uint32_t* in_flight_;
+};
+
+/// Batched operations prefetch the hash bucket this many keys ahead of the key being processed,
+/// and the record at the head of its hash chain half as many keys ahead.
+static constexpr size_t kBatchPrefetchDistance = 16;
+
+/// The disk of each I/O backend; see faster_open_ex(). Log segments are 1 GB unless the store's
+/// disk config says otherwise.
+static constexpr uint64_t kDefaultSegmentSize = 1073741824L;
+typedef FASTER::device::FileSystemDisk<FASTER::environment::QueueIoHandler, kDefaultSegmentSize>
+aio_disk_t;
+#ifdef FASTER_URING
+typedef FASTER::device::FileSystemDisk<FASTER::environment::UringIoHandler, kDefaultSegmentSize>
+uring_disk_t;
+#endif
+typedef FASTER::device::NullDisk null_disk_t;
+
+template <class D>
+using store_t = FasterKv<Key, Value, D>;
+template <class D, uint32_t Length>
+using fixed_store_t = FasterKv<Key, FixedValue<Length>, D>;
+template <class D>
+using dense_store_t = FasterKv<DenseKey, Value, D>;
+template <class D, uint32_t Length>
+using dense_fixed_store_t = FasterKv<DenseKey, FixedValue<Length>, D>;
+static constexpr int32_t kDefaultStalenessBound = 128;
+
+/// The key and value types of a store, given a pointer to it.
+template <class S>
+using store_key_t = typename std::remove_pointer<S>::type::key_t;
+template <class S>
+using store_value_t = typename std::remove_pointer<S>::type::value_t;
+
+class LookaheadEngine;
+class WriteBehind;
+
+/// The stores on disk type D. A store holds either variable-length rows ("store"), or, if opened
+/// by faster_open_fixed(), rows of one of the fixed lengths below; if opened by
+/// faster_open_dense(), the same, under a dense index.
+template <class D>
+struct StoreSet {
+  store_t<D>* store = nullptr;
+  fixed_store_t<D, 64>* store_64 = nullptr;
+  fixed_store_t<D, 128>* store_128 = nullptr;
+  fixed_store_t<D, 256>* store_256 = nullptr;
+  fixed_store_t<D, 512>* store_512 = nullptr;
+  dense_store_t<D>* dense_store = nullptr;
+  dense_fixed_store_t<D, 64>* dense_store_64 = nullptr;
+  dense_fixed_store_t<D, 128>* dense_store_128 = nullptr;
+  dense_fixed_store_t<D, 256>* dense_store_256 = nullptr;
+  dense_fixed_store_t<D, 512>* dense_store_512 = nullptr;
 };
 
-typedef FASTER::environment::QueueIoHandler handler_t;
-typedef FASTER::device::FileSystemDisk<handler_t, 1073741824L> disk_t;
-using store_t = FasterKv<Key, Value, disk_t>;
+/// Exactly one store, in the set of its I/O backend.
 struct faster_t {
-  store_t* store;
+  /// One of faster_io_backend; see faster_open_ex().
+  uint8_t backend = FASTER_IO_LIBAIO;
+  StoreSet<aio_disk_t> aio;
+#ifdef FASTER_URING
+  StoreSet<uring_disk_t> uring;
+#endif
+  StoreSet<null_disk_t> in_memory;
+  StalenessTable* staleness_table;
+  /// Optimizer-state vectors stored after the weights in every MLKV row; see
+  /// mlkv_set_state_slots().
+  uint32_t state_slots = 0;
+  /// Expected row length, in bytes, excluding optimizer state; see mlkv_set_value_length_hint().
+  uint64_t value_length_hint = 0;
+  /// How MLKV rows store their weights; see mlkv_set_storage_format().
+  mlkv::Format format = mlkv::Format::Fp32;
+  /// Default staleness policy for MLKV reads; see faster_open_with_policy().
+  mlkv_staleness_policy policy = { MLKV_SYNC_SSP, kDefaultStalenessBound };
+  /// Initial value of rows created on first touch; see mlkv_set_initializer().
+  mlkv::Initializer initializer = { mlkv::Init::None, 0.0f, 0.0f, 0 };
+  /// Started by mlkv_start_lookahead(), or by the first mlkv_lookahead_batch().
+  LookaheadEngine* lookahead = nullptr;
+  std::mutex lookahead_mutex;
+  /// Combines concurrent additive updates of hot rows; see mlkv_set_combining().
+  CombiningTable* combining = nullptr;
+  /// Per-thread write-behind of additive updates; see mlkv_set_write_behind().
+  WriteBehind* write_behind = nullptr;
+  uint32_t write_behind_rows = 0;
+  uint32_t write_behind_interval_ms = 0;
 };
 
-faster_t* faster_open(const uint64_t table_size, const uint64_t log_size, const char* storage) {
-  faster_t* res = new faster_t();
-  std::experimental::filesystem::create_directory(storage);
-  res->store= new store_t { table_size, log_size, storage, 0.8 };
-  return res;
+/// The staleness bound a read waits for under "policy", or the store's default if null. Writes
+/// only ever lower a row's staleness, so they never wait.
+static int32_t read_staleness_bound(const faster_t* faster_t, const mlkv_staleness_policy* policy) {
+  if(policy == nullptr) {
+    policy = &faster_t->policy;
+  }
+  switch(policy->mode) {
+  case MLKV_SYNC_BSP:
+    return 1;
+  case MLKV_SYNC_ASP:
+    return INT32_MAX;
+  default:
+    return policy->bound;
+  }
 }
-
-uint8_t faster_upsert(faster_t* faster_t, const uint64_t key, uint8_t* value, uint64_t value_length) {
-  auto callback = [](IAsyncContext* ctxt, Status result) {
-    CallbackContext<UpsertContext> context{ ctxt };
-  };
-
-  UpsertContext context { key, value, value_length };
-  Status result = faster_t->store->Upsert(context, callback, 1);
-  return static_cast<uint8_t>(result);
+static constexpr int32_t kWriteStalenessBound = INT32_MAX;
+
+/// Calls "op" with whichever store of "stores" is open.
+template <class D, class F>
+auto with_store_of(StoreSet<D>& stores, F&& op) -> decltype(op(stores.store)) {
+  if(stores.store_64) {
+    return op(stores.store_64);
+  } else if(stores.store_128) {
+    return op(stores.store_128);
+  } else if(stores.store_256) {
+    return op(stores.store_256);
+  } else if(stores.store_512) {
+    return op(stores.store_512);
+  } else if(stores.dense_store) {
+    return op(stores.dense_store);
+  } else if(stores.dense_store_64) {
+    return op(stores.dense_store_64);
+  } else if(stores.dense_store_128) {
+    return op(stores.dense_store_128);
+  } else if(stores.dense_store_256) {
+    return op(stores.dense_store_256);
+  } else if(stores.dense_store_512) {
+    return op(stores.dense_store_512);
+  }
+  return op(stores.store);
 }
 
-uint8_t faster_rmw(faster_t* faster_t, const uint64_t key, uint8_t* incr, const uint64_t value_length) {
-  auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
-    CallbackContext<RmwContext> context{ ctxt };
-  };
-  RmwContext context{ key, incr, value_length };
-  Status result = faster_t->store->Rmw(context, callback, 1);
-  return static_cast<uint8_t>(result);
+/// Calls "op" with whichever store "faster_t" holds.
+template <class F>
+auto with_store(faster_t* faster_t, F&& op) -> decltype(op(faster_t->aio.store)) {
+  switch(faster_t->backend) {
+#ifdef FASTER_URING
+  case FASTER_IO_URING:
+    return with_store_of(faster_t->uring, op);
+#endif
+  case FASTER_IO_NULL:
+    return with_store_of(faster_t->in_memory, op);
+  default:
+    return with_store_of(faster_t->aio, op);
+  }
 }
 
-uint8_t faster_read(faster_t* faster_t, const uint64_t key, uint8_t* output) {
-  auto callback = [](IAsyncContext* ctxt, Status result) {
-    CallbackContext<ReadContext> context{ ctxt };
-  };
+/// The staleness table of "faster_t", whose store must be open.
+static StalenessTable* new_staleness_table(faster_t* faster_t, uint64_t num_slots) {
+  StalenessTable* table = new StalenessTable{ num_slots };
+  with_store(faster_t, [&](auto* store) {
+    typedef typename std::remove_pointer<decltype(store)>::type kv_t;
+    table->set_refresh(store, [](void* store, const void* record) {
+      return static_cast<kv_t*>(store)->RefreshWhileWaiting(record);
+    });
+  });
+  return table;
+}
 
-  ReadContext context {key, output};
-  Status result = faster_t->store->Read(context, callback, 1);
-  return static_cast<uint8_t>(result);
+/// Calls "op" with the store, if it holds variable-length rows under a hashed index (the only
+/// kind that the non-MLKV operations support); Aborted if not.
+template <class D, class F>
+inline Status plain_store_op(store_t<D>* store, F& op) {
+  return op(store);
+}
+template <class S, class F>
+inline Status plain_store_op(S* store, F& op) {
+  return Status::Aborted;
+}
+template <class F>
+Status with_plain_store(faster_t* faster_t, F&& op) {
+  return with_store(faster_t, [&](auto* store) {
+    return plain_store_op(store, op);
+  });
 }
 
-uint8_t faster_delete(faster_t* faster_t, const uint64_t key) {
-  auto callback = [](IAsyncContext* ctxt, Status result) {
-    CallbackContext<DeleteContext> context { ctxt };
-    assert(result == Status::Ok || result == Status::NotFound);
-  };
+/// False if a row of "length" bytes of float32 weights, in the store's format, plus
+/// "state_slots" float32 state vectors, does not fit the store's records.
+template <class V>
+inline bool row_fits(const faster_t* faster_t, uint64_t length, uint32_t state_slots) {
+  return V::holds(state_offset(faster_t->format, length) + length * state_slots);
+}
 
-  DeleteContext context {key};
-  Status result = faster_t->store->Delete(context, callback, 1);
-  return static_cast<uint8_t>(result);
+/// False if "key" has no slot in the store's index, i.e., if the index is dense and the key is
+/// at or past its capacity.
+template <class S>
+inline bool key_fits(const S* store, uint64_t key) {
+  return !S::key_t::kDense || key < store->DenseCapacity();
 }
 
-uint8_t mlkv_read(faster_t* faster_t, const uint64_t key, uint8_t* output, const uint64_t value_length) {
-  auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
-    CallbackContext<MLKVReadContext> context{ ctxt };
-  };
-  MLKVReadContext context{ key, output, value_length, 1, 128 };
-  Status result = faster_t->store->Rmw(context, callback, 1);
-  if (context.found == false) {
-    return static_cast<uint8_t>(FASTER::core::Status::NotFound);
-  }
-  return static_cast<uint8_t>(result);
+/// Sizes the first disk read of a record to hold a whole row, optimizer state included. (For
+/// fixed-length rows, that size is known up front.)
+static void update_value_size_hint(faster_t* faster_t) {
+  uint64_t row_length = faster_t->value_length_hint == 0 ? 0 :
+                        state_offset(faster_t->format, faster_t->value_length_hint) +
+                        faster_t->value_length_hint * faster_t->state_slots;
+  with_store(faster_t, [&](auto* store) {
+    typedef store_value_t<decltype(store)> value_t;
+    store->SetValueSizeHint(row_length == 0 && !value_t::kFixedLength ? 0 :
+                            value_t::size_for(row_length));
+  });
 }
 
-uint8_t mlkv_upsert(faster_t* faster_t, const uint64_t key, uint8_t* value, uint64_t value_length) {
-  auto callback = [](IAsyncContext* ctxt, Status result) {
-    CallbackContext<MLKVUpsertContext> context{ ctxt };
+/// Per-thread scratch space reused across batched calls, so a batch does not allocate once the
+/// arena has grown to the largest batch seen.
+struct BatchScratch {
+  std::vector<KeyHash> hashes;
+  /// Batch positions, grouped by key; group i covers order[group_begin[i]..group_begin[i + 1]).
+  std::vector<size_t> order;
+  std::vector<size_t> group_begin;
+  std::vector<uint64_t> unique_keys;
+  std::vector<uint8_t> unique_statuses;
+  /// Aggregated payloads of keys that occur more than once in the batch.
+  std::vector<uint8_t> payloads;
+  /// Payload to apply for each unique key: either the caller's, or one in the arena above.
+  std::vector<uint8_t*> unique_payloads;
+};
+static thread_local BatchScratch batch_scratch;
+
+/// Issues one operation per key, as a software pipeline: while key i is being issued, the record
+/// for key i + D/2 and the hash bucket for key i + D are already on their way into cache. Keys
+/// that do not fit the store's index are skipped, with status Aborted. Returns true if any
+/// operation went pending.
+template <class S>
+static bool pipeline_batch(S* store, const uint64_t* keys, size_t num_keys, uint8_t* statuses,
+                           const std::function<Status(size_t)>& issue) {
+  std::vector<KeyHash>& hashes = batch_scratch.hashes;
+  hashes.clear();
+  for(size_t idx = 0; idx < num_keys; ++idx) {
+    hashes.push_back(typename S::key_t{ keys[idx] }.GetHash());
+  }
+  auto fits = [&](size_t idx) {
+    return key_fits(store, keys[idx]);
   };
 
-  MLKVUpsertContext context { key, value, value_length, -1, 128 };
-  Status result = faster_t->store->Rmw(context, callback, 1);
-  return static_cast<uint8_t>(result);
+  constexpr size_t kRecordDistance = kBatchPrefetchDistance / 2;
+  bool pending = false;
+  for(size_t idx = 0; idx < num_keys + kBatchPrefetchDistance; ++idx) {
+    if(idx < num_keys && fits(idx)) {
+      store->PrefetchBucket(hashes[idx]);
+    }
+    if(idx >= kRecordDistance && idx - kRecordDistance < num_keys && fits(idx - kRecordDistance)) {
+      store->PrefetchRecord(hashes[idx - kRecordDistance]);
+    }
+    if(idx >= kBatchPrefetchDistance) {
+      size_t issued = idx - kBatchPrefetchDistance;
+      if(!fits(issued)) {
+        statuses[issued] = static_cast<uint8_t>(Status::Aborted);
+        continue;
+      }
+      pending |= issue(issued) == Status::Pending;
+    }
+  }
+  return pending;
 }
 
-uint8_t mlkv_lookahead(faster_t* faster_t, const uint64_t key, const uint64_t value_length) {
+/// Groups the batch positions by key (stable, so later positions of a key come later), filling
+/// in batch_scratch.order, group_begin and unique_keys.
+static void group_batch_keys(const uint64_t* keys, size_t num_keys) {
+  std::vector<size_t>& order = batch_scratch.order;
+  order.resize(num_keys);
+  for(size_t idx = 0; idx < num_keys; ++idx) {
+    order[idx] = idx;
+  }
+  std::stable_sort(order.begin(), order.end(), [keys](size_t lhs, size_t rhs) {
+    return keys[lhs] < keys[rhs];
+  });
+
+  batch_scratch.group_begin.clear();
+  batch_scratch.unique_keys.clear();
+  for(size_t idx = 0; idx < num_keys; ++idx) {
+    if(idx == 0 || keys[order[idx]] != keys[order[idx - 1]]) {
+      batch_scratch.group_begin.push_back(idx);
+      batch_scratch.unique_keys.push_back(keys[order[idx]]);
+    }
+  }
+  batch_scratch.group_begin.push_back(num_keys);
+}
+
+/// Copies each unique key's status to every batch position holding that key.
+static void scatter_batch_statuses(uint8_t* statuses) {
+  const std::vector<size_t>& order = batch_scratch.order;
+  const std::vector<size_t>& group_begin = batch_scratch.group_begin;
+  for(size_t group = 0; group + 1 < group_begin.size(); ++group) {
+    for(size_t idx = group_begin[group]; idx < group_begin[group + 1]; ++idx) {
+      statuses[order[idx]] = batch_scratch.unique_statuses[group];
+    }
+  }
+}
+
+/// A batch succeeds unless some key failed with something other than NotFound.
+static uint8_t batch_result(const uint8_t* statuses, size_t num_keys) {
+  for(size_t idx = 0; idx < num_keys; ++idx) {
+    Status result = static_cast<Status>(statuses[idx]);
+    if(result != Status::Ok && result != Status::NotFound) {
+      return statuses[idx];
+    }
+  }
+  return static_cast<uint8_t>(Status::Ok);
+}
+
+/// Adds "incrs[idx]" to the row of "keys[idx]", for distinct keys, as a pipelined batch of RMWs;
+/// each retires "counts(idx)" units of staleness. Waits for any that go pending.
+template <class S, class C>
+static void rmw_distinct_keys(faster_t* faster_t, S* store, const uint64_t* keys, size_t num_keys,
+                              uint8_t* const* incrs, C counts, const uint64_t value_length,
+                              uint8_t* statuses) {
+  typedef MLKVRmwContext<typename S::key_t, typename S::value_t> context_t;
+  auto callback = [](IAsyncContext* ctxt, Status result) {
+    CallbackContext<context_t> context{ ctxt };
+    *context->status() = static_cast<uint8_t>(result);
+  };
+  bool pending = pipeline_batch(store, keys, num_keys, statuses, [&](size_t idx) {
+    context_t context{ keys[idx], incrs[idx], value_length, faster_t->format, -counts(idx),
+                       kWriteStalenessBound, faster_t->staleness_table, faster_t->combining,
+                       &faster_t->initializer, &statuses[idx] };
+    Status result = store->Rmw(context, callback, 1);
+    faster_t->staleness_table->notify(context.key().GetHash());
+    statuses[idx] = static_cast<uint8_t>(result);
+    return result;
+  });
+  if(pending) {
+    store->CompletePending(true);
+  }
+}
+
+/// Write-behind for additive MLKV updates; see mlkv_set_write_behind(). Each thread sums its
+/// updates to a row in an open-addressed table, and pushes the sums to the store as one batch of
+/// RMWs: once the table holds max_rows rows, once a row has as many updates as the staleness
+/// bound lets readers run ahead of, before a bounded read, and on mlkv_flush_updates() or
+/// faster_stop_session(). The store's WriteBehind thread pushes the tables of idle threads once
+/// the flush interval has passed, and of threads that have exited. Until then, no thread sees the
+/// updates.
+struct UpdateBuffer {
+  /// Held by the thread while it updates or pushes the table, and by the WriteBehind thread while
+  /// it pushes the table.
+  std::mutex mutex;
+  /// The store whose updates the table holds (null once its WriteBehind is gone), and their
+  /// length.
+  faster_t* owner = nullptr;
+  uint64_t value_length = 0;
+  /// Set once the thread has exited, or has moved on to another table; only the WriteBehind
+  /// thread then pushes this one.
+  std::atomic<bool> orphaned{ false };
+  /// Open-addressed by key; a slot with no updates is free.
+  std::vector<uint64_t> keys;
+  std::vector<int32_t> counts;
+  std::vector<float> sums;
+  /// Occupied slots, in the order their rows were first updated.
+  std::vector<size_t> rows;
+  std::chrono::steady_clock::time_point last_flush;
+  /// The first push since the last mlkv_flush_updates() that did not return Ok.
+  uint8_t error = static_cast<uint8_t>(Status::Ok);
+
+  /// Scratch for a push.
+  std::vector<uint64_t> flush_keys;
+  std::vector<uint8_t*> flush_incrs;
+  std::vector<int32_t> flush_counts;
+  std::vector<uint8_t> flush_statuses;
+};
+
+/// Pushes a table's updates to its store, on a session the calling thread holds there; returns
+/// as a batch does, and holds a failure for mlkv_flush_updates(). The caller locks the table.
+static uint8_t push_updates(UpdateBuffer& buffer) {
+  buffer.last_flush = std::chrono::steady_clock::now();
+  faster_t* faster_t = buffer.owner;
+  if(faster_t == nullptr || buffer.rows.empty()) {
+    return static_cast<uint8_t>(Status::Ok);
+  }
+  size_t dim = buffer.value_length / sizeof(float);
+  buffer.flush_keys.clear();
+  buffer.flush_incrs.clear();
+  buffer.flush_counts.clear();
+  for(size_t slot : buffer.rows) {
+    buffer.flush_keys.push_back(buffer.keys[slot]);
+    buffer.flush_incrs.push_back(reinterpret_cast<uint8_t*>(&buffer.sums[slot * dim]));
+    buffer.flush_counts.push_back(buffer.counts[slot]);
+  }
+  size_t num_rows = buffer.rows.size();
+  buffer.flush_statuses.resize(num_rows);
+  with_store(faster_t, [&](auto* store) {
+    rmw_distinct_keys(faster_t, store, buffer.flush_keys.data(), num_rows,
+                      buffer.flush_incrs.data(), [&](size_t idx) {
+      return buffer.flush_counts[idx];
+    }, buffer.value_length, buffer.flush_statuses.data());
+  });
+  for(size_t slot : buffer.rows) {
+    buffer.counts[slot] = 0;
+    std::fill(&buffer.sums[slot * dim], &buffer.sums[(slot + 1) * dim], 0.0f);
+  }
+  buffer.rows.clear();
+  uint8_t result = batch_result(buffer.flush_statuses.data(), num_rows);
+  if(buffer.error == static_cast<uint8_t>(Status::Ok)) {
+    buffer.error = result;
+  }
+  return result;
+}
+
+/// Locks a table of this thread's, refreshing the thread's session on "faster_t" meanwhile: the
+/// WriteBehind thread may be pushing the table, and waiting for this thread's epoch to move on.
+static std::unique_lock<std::mutex> lock_update_buffer(faster_t* faster_t, UpdateBuffer& buffer) {
+  std::unique_lock<std::mutex> lock{ buffer.mutex, std::try_to_lock };
+  while(!lock.owns_lock()) {
+    with_store(faster_t, [](auto* store) {
+      store->Refresh();
+    });
+    lock.try_lock();
+  }
+  return lock;
+}
+
+/// Pushes the write-behind tables that a store's threads do not push themselves: a table whose
+/// flush interval has passed since its last push, so that an idle thread's updates still reach
+/// the readers that wait for them, and the table of a thread that has exited or moved on. Holds a
+/// session only while it pushes.
+class WriteBehind {
+ public:
+  WriteBehind(faster_t* faster_t, uint32_t interval_ms)
+    : faster_t_{ faster_t }
+    , interval_{ interval_ms }
+    , orphans_{ false }
+    , stopping_{ false } {
+    thread_ = std::thread{ &WriteBehind::Run, this };
+  }
+
+  /// Pushes the tables left, then detaches them from the store.
+  ~WriteBehind() {
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    for(const auto& buffer : buffers_) {
+      std::lock_guard<std::mutex> lock{ buffer->mutex };
+      buffer->owner = nullptr;
+    }
+  }
+
+  void Register(std::shared_ptr<UpdateBuffer> buffer) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    buffers_.push_back(std::move(buffer));
+  }
+
+  /// A table was orphaned; pushes it now, rather than at the next interval.
+  void Notify() {
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      orphans_ = true;
+    }
+    cv_.notify_all();
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    while(true) {
+      auto woken = [&] {
+        return stopping_ || orphans_;
+      };
+      if(interval_.count() > 0) {
+        cv_.wait_for(lock, interval_, woken);
+      } else {
+        cv_.wait(lock, woken);
+      }
+      bool stopping = stopping_;
+      orphans_ = false;
+      std::vector<std::shared_ptr<UpdateBuffer>> buffers = buffers_;
+      lock.unlock();
+      std::vector<UpdateBuffer*> done = Push(buffers, stopping);
+      lock.lock();
+      buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                    [&](const std::shared_ptr<UpdateBuffer>& buffer) {
+        return std::find(done.begin(), done.end(), buffer.get()) != done.end();
+      }), buffers_.end());
+      if(stopping) {
+        return;
+      }
+    }
+  }
+
+  /// Pushes the tables that are due (all of them, if "stopping"); returns the orphaned ones,
+  /// which no thread uses again.
+  std::vector<UpdateBuffer*> Push(const std::vector<std::shared_ptr<UpdateBuffer>>& buffers,
+                                  bool stopping) {
+    std::vector<UpdateBuffer*> done;
+    bool session = false;
+    auto now = std::chrono::steady_clock::now();
+    for(const auto& buffer : buffers) {
+      bool orphaned = buffer->orphaned.load();
+      std::unique_lock<std::mutex> lock{ buffer->mutex, std::defer_lock };
+      if(orphaned) {
+        lock.lock();
+      } else if(!lock.try_lock()) {
+        // Its thread is using it, and pushes it if it is due.
+        continue;
+      }
+      if(buffer->owner == faster_t_ && !buffer->rows.empty() &&
+         (orphaned || stopping ||
+          (interval_.count() > 0 && now - buffer->last_flush >= interval_))) {
+        if(!session) {
+          with_store(faster_t_, [](auto* store) {
+            store->StartSession();
+          });
+          session = true;
+        }
+        push_updates(*buffer);
+      }
+      if(orphaned) {
+        done.push_back(buffer.get());
+      }
+    }
+    if(session) {
+      with_store(faster_t_, [](auto* store) {
+        store->StopSession();
+      });
+    }
+    return done;
+  }
+
+  faster_t* faster_t_;
+  std::chrono::milliseconds interval_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<std::shared_ptr<UpdateBuffer>> buffers_;
+  bool orphans_;
+  bool stopping_;
+  std::thread thread_;
+};
+
+/// This thread's write-behind table, which it shares with its store's WriteBehind thread.
+class LocalUpdateBuffer {
+ public:
+  /// The thread's updates are pushed even if it exits without stopping its session.
+  ~LocalUpdateBuffer() {
+    Release(nullptr);
+  }
+
+  UpdateBuffer* get() const {
+    return buffer_.get();
+  }
+
+  /// Starts a new table for updates of "faster_t" of "value_length" bytes.
+  UpdateBuffer& Reset(faster_t* faster_t, uint64_t value_length) {
+    Release(faster_t);
+    buffer_ = std::make_shared<UpdateBuffer>();
+    // Keep the table at most half full.
+    size_t num_slots = 2;
+    while(num_slots < 2 * static_cast<size_t>(faster_t->write_behind_rows)) {
+      num_slots <<= 1;
+    }
+    buffer_->owner = faster_t;
+    buffer_->value_length = value_length;
+    buffer_->keys.assign(num_slots, 0);
+    buffer_->counts.assign(num_slots, 0);
+    buffer_->sums.assign(num_slots * (value_length / sizeof(float)), 0.0f);
+    buffer_->last_flush = std::chrono::steady_clock::now();
+    faster_t->write_behind->Register(buffer_);
+    return *buffer_;
+  }
+
+ private:
+  /// Hands the table to its store's WriteBehind thread, to push what it still holds. The thread
+  /// refreshes its session on "session" (unless null) while it waits for the table.
+  void Release(faster_t* session) {
+    if(!buffer_) {
+      return;
+    }
+    {
+      std::unique_lock<std::mutex> lock = session != nullptr ?
+        lock_update_buffer(session, *buffer_) : std::unique_lock<std::mutex>{ buffer_->mutex };
+      buffer_->orphaned = true;
+      if(buffer_->owner != nullptr) {
+        buffer_->owner->write_behind->Notify();
+      }
+    }
+    buffer_.reset();
+  }
+
+  std::shared_ptr<UpdateBuffer> buffer_;
+};
+static thread_local LocalUpdateBuffer update_buffer;
+
+/// Pushes this thread's buffered updates of "faster_t" to the store; returns the first push of
+/// them that did not return Ok since the last call, this one included.
+static uint8_t flush_updates(faster_t* faster_t) {
+  UpdateBuffer* buffer = update_buffer.get();
+  if(buffer == nullptr) {
+    return static_cast<uint8_t>(Status::Ok);
+  }
+  std::unique_lock<std::mutex> lock = lock_update_buffer(faster_t, *buffer);
+  if(buffer->owner != faster_t) {
+    return static_cast<uint8_t>(Status::Ok);
+  }
+  push_updates(*buffer);
+  uint8_t result = buffer->error;
+  buffer->error = static_cast<uint8_t>(Status::Ok);
+  return result;
+}
+
+/// Adds a float32 update of a key's weights to this thread's write-behind table, if the store has
+/// one and the staleness bound allows for it; returns false if the caller should apply it now.
+/// A push that this update sets off holds any failure for mlkv_flush_updates().
+static bool buffer_update(faster_t* faster_t, const uint64_t key, const float* incr,
+                          const uint64_t value_length) {
+  int32_t staleness_bound = read_staleness_bound(faster_t, nullptr);
+  if(faster_t->write_behind == nullptr || staleness_bound <= 1) {
+    return false;
+  }
+  UpdateBuffer* buffer = update_buffer.get();
+  std::unique_lock<std::mutex> lock;
+  if(buffer != nullptr) {
+    lock = lock_update_buffer(faster_t, *buffer);
+    if(buffer->owner != faster_t || buffer->value_length != value_length) {
+      lock.unlock();
+      buffer = nullptr;
+    }
+  }
+  if(buffer == nullptr) {
+    buffer = &update_buffer.Reset(faster_t, value_length);
+    lock = lock_update_buffer(faster_t, *buffer);
+  }
+
+  size_t dim = value_length / sizeof(float);
+  size_t mask = buffer->keys.size() - 1;
+  size_t slot = Utility::GetHashCode(key) & mask;
+  while(buffer->counts[slot] != 0 && buffer->keys[slot] != key) {
+    slot = (slot + 1) & mask;
+  }
+  if(buffer->counts[slot] == 0) {
+    buffer->keys[slot] = key;
+    buffer->rows.push_back(slot);
+  }
+  float* sum = &buffer->sums[slot * dim];
+  for(size_t idx = 0; idx < dim; ++idx) {
+    sum[idx] += incr[idx];
+  }
+  ++buffer->counts[slot];
+
+  if(buffer->counts[slot] >= staleness_bound ||
+     buffer->rows.size() >= faster_t->write_behind_rows ||
+     (faster_t->write_behind_interval_ms > 0 &&
+      std::chrono::steady_clock::now() - buffer->last_flush >=
+      std::chrono::milliseconds{ faster_t->write_behind_interval_ms })) {
+    push_updates(*buffer);
+  }
+  return true;
+}
+
+/// Pushes this thread's buffered updates of "faster_t", holding any failure for
+/// mlkv_flush_updates().
+static void push_own_updates(faster_t* faster_t) {
+  UpdateBuffer* buffer = update_buffer.get();
+  if(buffer != nullptr) {
+    std::unique_lock<std::mutex> lock = lock_update_buffer(faster_t, *buffer);
+    if(buffer->owner == faster_t) {
+      push_updates(*buffer);
+    }
+  }
+}
+
+/// Before a read that may wait at the staleness bound, pushes this thread's buffered updates, so
+/// that the read does not wait on updates only this thread can apply.
+static void flush_updates_for_read(faster_t* faster_t, int32_t staleness_bound) {
+  if(staleness_bound != INT32_MAX) {
+    push_own_updates(faster_t);
+  }
+}
+
+/// Prefetches the rows of upcoming minibatches in the background, on its own threads and
+/// sessions, so that the trainer's reads find them in the mutable region.
+///
+/// Each submitted key list becomes a ticket; tickets are served in order. A thread claims up to
+/// "max_pending" keys of the oldest ticket at a time and issues a lookahead RMW for each, which
+/// copies a read-only or on-disk row to the tail. At most "max_pending" of a thread's RMWs wait
+/// on disk at once. Once the trainer consumes a ticket, its unissued keys are dropped.
+///
+/// Before issuing its keys, a thread pins the log's tail page, which keeps the head address from
+/// passing the rows it copies there until the ticket is consumed. The log lets pins hold the head
+/// back by as many pages as the rows of the unconsumed tickets fill.
+class LookaheadEngine {
+ public:
+  virtual ~LookaheadEngine() {
+  }
+
+  /// Queues a ticket; duplicate keys are prefetched once, in order of first appearance.
+  virtual uint64_t Submit(const uint64_t* keys, size_t num_keys, uint64_t value_length) = 0;
+  /// The trainer is about to read the rows of "ticket" and of every ticket before it; its reads
+  /// take over from their pins.
+  virtual void Consume(uint64_t ticket) = 0;
+  /// The trainer is done with the rows of "ticket" and of every ticket before it.
+  virtual void Release(uint64_t ticket) = 0;
+  virtual const LookaheadState& state() const = 0;
+};
+
+/// The lookahead engine of a store of type S.
+template <class S>
+class StoreLookaheadEngine : public LookaheadEngine {
+ public:
+  typedef MLKVLookaheadContext<typename S::key_t, typename S::value_t> lookahead_context_t;
+
+  StoreLookaheadEngine(S* store, mlkv::Format format, const mlkv::Initializer* initializer,
+                       uint32_t num_threads, uint32_t max_pending)
+    : store_{ store }
+    , format_{ format }
+    , initializer_{ initializer }
+    , max_pending_{ std::max(max_pending, 1u) }
+    , next_ticket_{ 1 }
+    , stopping_{ false }
+    , pinned_bytes_{ 0 } {
+    for(uint32_t idx = 0; idx < std::max(num_threads, 1u); ++idx) {
+      threads_.emplace_back(&StoreLookaheadEngine::Run, this);
+    }
+  }
+
+  ~StoreLookaheadEngine() {
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for(auto& thread : threads_) {
+      thread.join();
+    }
+    for(const auto& pin : pins_) {
+      store_->hlog.UnpinPage(pin.address);
+    }
+    store_->hlog.ReservePinnedHeadPages(0);
+  }
+
+  uint64_t Submit(const uint64_t* keys, size_t num_keys, uint64_t value_length) override {
+    Ticket ticket;
+    ticket.keys.reserve(num_keys);
+    std::unordered_set<uint64_t> seen;
+    for(size_t idx = 0; idx < num_keys; ++idx) {
+      if(seen.insert(keys[idx]).second) {
+        ticket.keys.push_back(keys[idx]);
+      }
+    }
+    ticket.value_length = value_length;
+    ticket.next = 0;
+    uint64_t id;
+    {
+      std::lock_guard<std::mutex> lock{ mutex_ };
+      id = next_ticket_++;
+      ticket.id = id;
+      queue_.push_back(std::move(ticket));
+    }
+    cv_.notify_all();
+    return id;
+  }
+
+  void Consume(uint64_t ticket) override {
+    uint64_t consumed = state_.consumed_through.load();
+    while(consumed < ticket &&
+          !state_.consumed_through.compare_exchange_weak(consumed, ticket)) {
+    }
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    auto released = std::remove_if(pins_.begin(), pins_.end(), [&](const Pin& pin) {
+      if(pin.ticket > ticket) {
+        return false;
+      }
+      store_->hlog.UnpinPage(pin.address);
+      pinned_bytes_ -= pin.bytes;
+      return true;
+    });
+    pins_.erase(released, pins_.end());
+    ReservePinnedPages();
+  }
+
+  void Release(uint64_t ticket) override {
+    Consume(ticket);
+  }
+
+  const LookaheadState& state() const override {
+    return state_;
+  }
+
+ private:
+  struct Ticket {
+    uint64_t id;
+    std::vector<uint64_t> keys;
+    uint64_t value_length;
+    size_t next;
+  };
+
+  /// A tail page pinned for a ticket, with the bytes of the rows to be copied after it.
+  struct Pin {
+    uint64_t ticket;
+    Address address;
+    uint64_t bytes;
+  };
+
+  /// Claims the next keys to prefetch. Waits for a ticket if "wait" is set; returns false if
+  /// there is none (or the engine is stopping).
+  bool Claim(bool wait, std::vector<uint64_t>& keys, uint64_t& ticket, uint64_t& value_length) {
+    std::unique_lock<std::mutex> lock{ mutex_ };
+    while(true) {
+      while(!queue_.empty() && (queue_.front().next == queue_.front().keys.size() ||
+                                state_.consumed(queue_.front().id))) {
+        // Keys never issued before their ticket was consumed were prefetched too late.
+        state_.late += queue_.front().keys.size() - queue_.front().next;
+        queue_.pop_front();
+      }
+      if(stopping_) {
+        return false;
+      }
+      if(!queue_.empty()) {
+        break;
+      }
+      if(!wait) {
+        return false;
+      }
+      cv_.wait(lock);
+    }
+    Ticket& front = queue_.front();
+    size_t count = std::min<size_t>(max_pending_, front.keys.size() - front.next);
+    keys.assign(front.keys.begin() + front.next, front.keys.begin() + front.next + count);
+    front.next += count;
+    ticket = front.id;
+    value_length = front.value_length;
+    return true;
+  }
+
+  void Run() {
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<lookahead_context_t> context{ ctxt };
+      --*context->in_flight();
+      if(result == Status::Ok) {
+        context->state()->record(context->ticket(), context->copied);
+      }
+    };
+
+    std::vector<uint64_t> keys;
+    uint64_t ticket, value_length;
+    while(Claim(true, keys, ticket, value_length)) {
+      // Hold a session only while there is work, so that an idle engine never holds up
+      // checkpoints or epoch reclamation.
+      store_->StartSession();
+      uint32_t in_flight = 0;
+      do {
+        PinTail(ticket, keys.size() * RowBytes(value_length));
+        for(uint64_t key : keys) {
+          if(!key_fits(store_, key)) {
+            continue;
+          }
+          if(state_.consumed(ticket)) {
+            ++state_.late;
+            continue;
+          }
+          while(in_flight >= max_pending_) {
+            store_->CompletePending(false);
+          }
+          lookahead_context_t context{ key, value_length, format_, initializer_, &state_,
+                                       ticket, &in_flight };
+          Status result = store_->Rmw(context, callback, 1);
+          if(result == Status::Pending) {
+            ++in_flight;
+          } else if(result == Status::Ok) {
+            state_.record(ticket, context.copied);
+          }
+        }
+      } while(Claim(false, keys, ticket, value_length));
+      store_->CompletePending(true);
+      store_->StopSession();
+    }
+  }
+
+  /// Log bytes taken by a copied row.
+  static uint64_t RowBytes(uint64_t value_length) {
+    return sizeof(RecordInfo) + sizeof(typename S::key_t) + value_length;
+  }
+
+  void PinTail(uint64_t ticket, uint64_t bytes) {
+    std::lock_guard<std::mutex> lock{ mutex_ };
+    Address tail = store_->hlog.GetTailAddress();
+    store_->hlog.PinPage(tail);
+    pins_.push_back(Pin{ ticket, tail, bytes });
+    pinned_bytes_ += bytes;
+    ReservePinnedPages();
+  }
+
+  /// Lets the pins hold the head back over the pages the rows of unconsumed tickets fill, plus
+  /// the partly filled page each starts on.
+  void ReservePinnedPages() {
+    uint64_t pages = (pinned_bytes_ + S::hlog_t::kPageSize - 1) / S::hlog_t::kPageSize + 1;
+    store_->hlog.ReservePinnedHeadPages(pins_.empty() ? 0 : static_cast<uint32_t>(
+      std::min<uint64_t>(pages, UINT32_MAX)));
+  }
+
+  S* store_;
+  mlkv::Format format_;
+  const mlkv::Initializer* initializer_;
+  uint32_t max_pending_;
+  LookaheadState state_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Ticket> queue_;
+  uint64_t next_ticket_;
+  bool stopping_;
+  std::vector<std::thread> threads_;
+  /// Tail pages pinned for each unconsumed ticket.
+  std::vector<Pin> pins_;
+  uint64_t pinned_bytes_;
+};
+
+static constexpr uint32_t kDefaultLookaheadThreads = 1;
+static constexpr uint32_t kDefaultLookaheadPending = 64;
+
+/// Reads a row that the side table has no room to count, by copying it to the tail as before; or
+/// creates a missing row, if the store has an initializer.
+template <class S>
+static Status mlkv_read_copy(faster_t* faster_t, S* store, const uint64_t key, uint8_t* output,
+                             const uint64_t value_length, int32_t staleness_bound,
+                             uint8_t* status = nullptr) {
+  typedef MLKVReadContext<typename S::key_t, typename S::value_t> context_t;
   auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
-    CallbackContext<MLKVLookaheadContext> context{ ctxt };
+    CallbackContext<context_t> context{ ctxt };
+    if(context->status()) {
+      if(result == Status::Ok && !context->found) {
+        result = Status::NotFound;
+      }
+      *context->status() = static_cast<uint8_t>(result);
+    }
   };
-  MLKVLookaheadContext context{ key, value_length };
-  Status result = faster_t->store->Rmw(context, callback, 1);
-  return static_cast<uint8_t>(result);
+  context_t context{ key, output, value_length, faster_t->format, 1, staleness_bound,
+                     faster_t->staleness_table, &faster_t->initializer, status };
+  Status result = store->Rmw(context, callback, 1);
+  if(result == Status::Ok && !context.found) {
+    return Status::NotFound;
+  }
+  return result;
 }
 
-faster_t* faster_recover(const uint64_t table_size, const uint64_t log_size, const char* storage, const char* checkpoint_token) {
+/// Replays the sessions of a checkpoint into a newly constructed store.
+template <class S>
+static bool recover_store(S* store, const char* checkpoint_token) {
   Guid token = Guid::Parse(checkpoint_token);
-  faster_t* res = new faster_t();
-  res->store= new store_t { table_size, log_size, storage, 0.8 };
-
   uint32_t version;
   std::vector<Guid> recovered_session_ids;
-  Status status = res->store->Recover(token, token, version, recovered_session_ids);
+  Status status = store->Recover(token, token, version, recovered_session_ids);
   if(status != Status::Ok) {
-    return nullptr;
+    return false;
   }
 
   std::vector<uint64_t> serial_nums;
   for(const auto& recovered_session_id : recovered_session_ids) {
-    serial_nums.push_back(res->store->ContinueSession(recovered_session_id));
-    res->store->StopSession();
+    serial_nums.push_back(store->ContinueSession(recovered_session_id));
+    store->StopSession();
   }
+  return true;
+}
+
+/// How a store is constructed, besides its sizes; see faster_options.
+struct StoreConfig {
+  double mutable_fraction = 0.8;
+  bool pre_allocate_log = false;
+  /// Passed to the store's disk (see FileSystemDisk).
+  std::string disk;
+};
+
+/// Constructs the store of "stores" that holds rows of "row_length" bytes (0 for variable-length
+/// rows), under a dense index if "dense"; false if no fixed length is instantiated for it.
+template <class D>
+static bool new_store_of(StoreSet<D>& stores, const uint64_t table_size, const uint64_t log_size,
+                         const std::string& storage, const uint32_t row_length, const bool dense,
+                         const StoreConfig& config) {
+  auto construct = [&](auto*& store) {
+    store = new std::remove_reference_t<decltype(*store)>{ table_size, log_size, storage,
+        config.mutable_fraction, config.pre_allocate_log, config.disk };
+  };
+  switch(row_length) {
+  case 0:
+    dense ? construct(stores.dense_store) : construct(stores.store);
+    return true;
+  case 64:
+    dense ? construct(stores.dense_store_64) : construct(stores.store_64);
+    return true;
+  case 128:
+    dense ? construct(stores.dense_store_128) : construct(stores.store_128);
+    return true;
+  case 256:
+    dense ? construct(stores.dense_store_256) : construct(stores.store_256);
+    return true;
+  case 512:
+    dense ? construct(stores.dense_store_512) : construct(stores.store_512);
+    return true;
+  default:
+    return false;
+  }
+}
+
+template <class D>
+static void delete_stores(StoreSet<D>& stores) {
+  delete stores.store;
+  delete stores.store_64;
+  delete stores.store_128;
+  delete stores.store_256;
+  delete stores.store_512;
+  delete stores.dense_store;
+  delete stores.dense_store_64;
+  delete stores.dense_store_128;
+  delete stores.dense_store_256;
+  delete stores.dense_store_512;
+}
+
+}  // extern "C++"
+
+/// Constructs the store, on faster_t's I/O backend, that holds rows of "row_length" bytes (0 for
+/// variable-length rows), under a dense index if "dense"; false if no fixed length is
+/// instantiated for it.
+static bool new_store(faster_t* faster_t, const uint64_t table_size, const uint64_t log_size,
+                      const char* storage, const uint32_t row_length, const bool dense,
+                      const StoreConfig& config = StoreConfig{}) {
+  bool constructed;
+  switch(faster_t->backend) {
+#ifdef FASTER_URING
+  case FASTER_IO_URING:
+    constructed = new_store_of(faster_t->uring, table_size, log_size, storage, row_length, dense,
+                               config);
+    break;
+#endif
+  case FASTER_IO_NULL:
+    // An empty path tells the log that it has no backing storage.
+    constructed = new_store_of(faster_t->in_memory, table_size, log_size, "", row_length, dense,
+                               config);
+    break;
+  default:
+    constructed = new_store_of(faster_t->aio, table_size, log_size, storage, row_length, dense,
+                               config);
+  }
+  if(constructed && dense) {
+    with_store(faster_t, [](auto* store) {
+      store->SetDenseIndex();
+    });
+  }
+  return constructed;
+}
+
+/// A dense index has room for at least this many buckets, so that index checkpoints still split
+/// into sector-aligned chunks.
+static constexpr uint64_t kMinDenseTableSize = 2048;
+
+/// Number of hash buckets a dense index needs for keys in [0, num_keys).
+static uint64_t dense_table_size(const uint64_t num_keys) {
+  uint64_t table_size = kMinDenseTableSize;
+  while(table_size * HashBucket::kNumEntries < num_keys) {
+    table_size <<= 1;
+  }
+  return table_size;
+}
+
+/// Sets faster_t's I/O backend and "config" from "options" (null for the defaults); false if
+/// they are out of range, or name a backend this build lacks.
+static bool apply_options(faster_t* faster_t, const faster_options* options,
+                          StoreConfig& config) {
+  if(!options) {
+    return true;
+  }
+  switch(options->io_backend) {
+  case FASTER_IO_LIBAIO:
+  case FASTER_IO_NULL:
+#ifdef FASTER_URING
+  case FASTER_IO_URING:
+#endif
+    faster_t->backend = options->io_backend;
+    break;
+  default:
+    return false;
+  }
+  if(options->mutable_fraction != 0) {
+    if(options->mutable_fraction < 0 || options->mutable_fraction > 1) {
+      return false;
+    }
+    config.mutable_fraction = options->mutable_fraction;
+  }
+  config.pre_allocate_log = options->pre_allocate_log;
+  if(options->segment_size != 0) {
+    // Pages are flushed whole, so a segment must hold at least one.
+    if(!Utility::IsPowerOfTwo(options->segment_size) ||
+        options->segment_size < Address::kMaxOffset + 1) {
+      return false;
+    }
+    config.disk += "segment_size=" + std::to_string(options->segment_size) + ";";
+  }
+  if(options->io_threads != 0) {
+    config.disk += "io_threads=" + std::to_string(options->io_threads) + ";";
+  }
+  return true;
+}
+
+faster_t* faster_open(const uint64_t table_size, const uint64_t log_size, const char* storage) {
+  return faster_open_with_policy(table_size, log_size, storage, nullptr);
+}
+
+/// Opens a store whose MLKV reads follow "policy" unless a call overrides it (see
+/// mlkv_read_ex()); null means SSP with a bound of 128.
+faster_t* faster_open_with_policy(const uint64_t table_size, const uint64_t log_size,
+                                  const char* storage, const mlkv_staleness_policy* policy) {
+  faster_t* res = new faster_t();
+  std::experimental::filesystem::create_directory(storage);
+  new_store(res, table_size, log_size, storage, 0, false);
+  res->staleness_table = new_staleness_table(res, 2 * table_size);
+  if(policy) {
+    res->policy = *policy;
+  }
+  return res;
+}
+
+/// Opens a store for the MLKV API whose records each hold a row of exactly "row_length" bytes
+/// (64, 128, 256 or 512): the stored weights, in the storage format, plus any optimizer state.
+/// Such records drop the 16 bytes that a variable-length row spends on its size and length.
+/// Shorter rows are padded; operations on longer ones fail with Aborted, as do the non-MLKV
+/// faster_upsert(), faster_rmw() and faster_read(). Returns null for other lengths.
+faster_t* faster_open_fixed(const uint64_t table_size, const uint64_t log_size,
+                            const char* storage, const uint32_t row_length,
+                            const mlkv_staleness_policy* policy) {
+  faster_t* res = new faster_t();
+  std::experimental::filesystem::create_directory(storage);
+  if(row_length == 0 || !new_store(res, table_size, log_size, storage, row_length, false)) {
+    delete res;
+    return nullptr;
+  }
+  res->staleness_table = new_staleness_table(res, 2 * table_size);
+  if(policy) {
+    res->policy = *policy;
+  }
+  update_value_size_hint(res);
+  return res;
+}
+
+/// Opens a store for the MLKV API whose keys are dense integer IDs in [0, num_keys): its index
+/// maps each ID straight to a slot of its own, with no hashing, tags or overflow buckets. Rows
+/// are variable-length if "row_length" is 0, else as for faster_open_fixed(). Operations on keys
+/// past the index's capacity (at least "num_keys") fail with Aborted, as do the non-MLKV
+/// faster_upsert(), faster_rmw() and faster_read(). Returns null for unsupported row lengths.
+faster_t* faster_open_dense(const uint64_t num_keys, const uint64_t log_size, const char* storage,
+                            const uint32_t row_length, const mlkv_staleness_policy* policy) {
+  faster_t* res = new faster_t();
+  uint64_t table_size = dense_table_size(num_keys);
+  std::experimental::filesystem::create_directory(storage);
+  if(!new_store(res, table_size, log_size, storage, row_length, true)) {
+    delete res;
+    return nullptr;
+  }
+  res->staleness_table = new_staleness_table(res, 2 * table_size);
+  if(policy) {
+    res->policy = *policy;
+  }
+  update_value_size_hint(res);
   return res;
 }
 
+/// Opens a store as faster_open(), faster_open_fixed() or faster_open_dense() would (by
+/// "options->row_length" and "options->dense"; "table_size" is the number of keys of a dense
+/// index), on the I/O backend and with the log geometry that "options" selects (see
+/// faster_options). A store on the null backend ignores "storage" and cannot be checkpointed;
+/// once its log is full, operations that would append records fail with OutOfMemory. Returns
+/// null if the options or sizes are invalid, the store cannot be created, or io_uring is
+/// selected in a build without it.
+faster_t* faster_open_ex(const uint64_t table_size, const uint64_t log_size, const char* storage,
+                         const faster_options* options, const mlkv_staleness_policy* policy) {
+  faster_t* res = new faster_t();
+  StoreConfig config;
+  if(!apply_options(res, options, config)) {
+    delete res;
+    return nullptr;
+  }
+  bool dense = options && options->dense;
+  uint32_t row_length = options ? options->row_length : 0;
+  uint64_t index_size = dense ? dense_table_size(table_size) : table_size;
+  try {
+    if(res->backend != FASTER_IO_NULL) {
+      std::experimental::filesystem::create_directory(storage);
+    }
+    if(!new_store(res, index_size, log_size, storage, row_length, dense, config)) {
+      delete res;
+      return nullptr;
+    }
+  } catch(const std::exception&) {
+    // E.g., a log size that is not a whole number of pages, or a disk that fails to open.
+    faster_destroy(res);
+    return nullptr;
+  }
+  res->staleness_table = new_staleness_table(res, 2 * index_size);
+  if(policy) {
+    res->policy = *policy;
+  }
+  update_value_size_hint(res);
+  return res;
+}
+
+/// Sets how MLKV operations fill the weights of a row they find missing (one of
+/// mlkv_init_kind), seeded per key with "seed"; see mlkv_initializer.h for the parameters.
+/// Reads then create the row and return its initial value instead of NotFound. Call before
+/// the first MLKV operation.
+void mlkv_set_initializer(faster_t* faster_t, const uint8_t kind, const float param1,
+                          const float param2, const uint64_t seed) {
+  faster_t->initializer = mlkv::Initializer{ static_cast<mlkv::Init>(kind), param1, param2, seed };
+}
+
+/// Stores the weights of MLKV rows as one of mlkv_storage_format, quantized on write and
+/// dequantized on read; the API still takes and returns float32. Int8 rows carry a per-row scale.
+/// Optimizer state stays float32. Call before the first MLKV operation (and again after recovery).
+/// Returns false, and keeps the current format, if "format" is not an mlkv_storage_format.
+bool mlkv_set_storage_format(faster_t* faster_t, const uint8_t format) {
+  if(format > MLKV_FORMAT_INT8) {
+    return false;
+  }
+  faster_t->format = static_cast<mlkv::Format>(format);
+  update_value_size_hint(faster_t);
+  return true;
+}
+
+/// Lays every MLKV row out as its weights followed by "num_slots" optimizer-state vectors of the
+/// same length, so a row and its state share one record, one lock and one disk read. Call before
+/// the first MLKV operation (and again after recovery); reads still return just the weights.
+void mlkv_set_state_slots(faster_t* faster_t, const uint32_t num_slots) {
+  faster_t->state_slots = num_slots;
+  update_value_size_hint(faster_t);
+}
+
+/// Lets each thread sum its mlkv_rmw_batch() and mlkv_sgd() updates in a write-behind table of up
+/// to "max_rows" rows (0 disables it), and push them to the store as one batch once the table is
+/// full, or once a row has as many updates as the staleness bound allows; a background thread
+/// pushes a table "flush_interval_ms" (unless 0) after its last push, even if its thread has gone
+/// idle, and the table of a thread that exits. See also mlkv_flush_updates(). Updates stay
+/// invisible, even to the thread that made them, until pushed. Has no effect under BSP. Call
+/// before the first MLKV operation.
+void mlkv_set_write_behind(faster_t* faster_t, const uint32_t max_rows,
+                           const uint32_t flush_interval_ms) {
+  delete faster_t->write_behind;
+  faster_t->write_behind = nullptr;
+  faster_t->write_behind_rows = max_rows;
+  faster_t->write_behind_interval_ms = flush_interval_ms;
+  if(max_rows > 0) {
+    faster_t->write_behind = new WriteBehind{ faster_t, flush_interval_ms };
+  }
+}
+
+/// Pushes this thread's write-behind updates to the store. A buffered update returns Ok; this
+/// returns the first push of the thread's updates that failed since the last call, this one
+/// included.
+uint8_t mlkv_flush_updates(faster_t* faster_t) {
+  return flush_updates(faster_t);
+}
+
+/// Combines concurrent gradient pushes to a hot row: a thread that finds the row locked by another
+/// thread's mlkv_rmw_batch() or mlkv_sgd() leaves its update for that thread to apply, rather than
+/// wait for the lock. Call before the first MLKV operation.
+void mlkv_set_combining(faster_t* faster_t, const bool enabled) {
+  if(enabled && !faster_t->combining) {
+    faster_t->combining = new CombiningTable{};
+  } else if(!enabled) {
+    delete faster_t->combining;
+    faster_t->combining = nullptr;
+  }
+}
+
+/// Keeps up to "size" bytes (a power of 2, at least 512) of rows read from disk in an in-memory
+/// read cache, so hot rows that were evicted from the log are read again without I/O, and without
+/// being copied back into the log. Call before the first session starts. Returns false if "size"
+/// is invalid.
+bool mlkv_set_read_cache(faster_t* faster_t, const uint64_t size) {
+  if(!Utility::IsPowerOfTwo(size) || size < 512) {
+    return false;
+  }
+  with_store(faster_t, [&](auto* store) {
+    store->SetReadCache(size);
+  });
+  return true;
+}
+
+/// Counts reads per key in a count-min sketch of "sketch_width" (a power of 2) counters per row,
+/// and copies a row read from disk back to the tail of the log on its key's "threshold"-th recent
+/// read; mlkv_promote_hot() does the same for hot rows in the read-only region. With a read
+/// cache, rows read once are not admitted to it. Call before the first session starts. Returns
+/// false if "sketch_width" or "threshold" (at least 2) is invalid.
+bool mlkv_set_promotion(faster_t* faster_t, const uint64_t sketch_width,
+                        const uint32_t threshold) {
+  if(!Utility::IsPowerOfTwo(sketch_width) || threshold < 2) {
+    return false;
+  }
+  with_store(faster_t, [&](auto* store) {
+    store->SetPromotion(sketch_width, threshold);
+  });
+  return true;
+}
+
+/// Copies the hot rows among the next "max_bytes" of the read-only region to the tail of the log.
+/// Returns how many it copied.
+uint64_t mlkv_promote_hot(faster_t* faster_t, const uint64_t max_bytes) {
+  return with_store(faster_t, [&](auto* store) {
+    return store->PromoteHotRecords(max_bytes);
+  });
+}
+
+/// For tables whose rows all have the same length: lets a row on disk come back in one I/O,
+/// instead of one for its header, then one for its key, then one for its value.
+void mlkv_set_value_length_hint(faster_t* faster_t, const uint64_t value_length) {
+  faster_t->value_length_hint = value_length;
+  update_value_size_hint(faster_t);
+}
+
+uint8_t faster_upsert(faster_t* faster_t, const uint64_t key, uint8_t* value, uint64_t value_length) {
+  auto callback = [](IAsyncContext* ctxt, Status result) {
+    CallbackContext<UpsertContext> context{ ctxt };
+  };
+
+  UpsertContext context { key, value, value_length };
+  Status result = with_plain_store(faster_t, [&](auto* store) {
+    return store->Upsert(context, callback, 1);
+  });
+  return static_cast<uint8_t>(result);
+}
+
+uint8_t faster_rmw(faster_t* faster_t, const uint64_t key, uint8_t* incr, const uint64_t value_length) {
+  auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
+    CallbackContext<RmwContext> context{ ctxt };
+  };
+  RmwContext context{ key, incr, value_length };
+  Status result = with_plain_store(faster_t, [&](auto* store) {
+    return store->Rmw(context, callback, 1);
+  });
+  return static_cast<uint8_t>(result);
+}
+
+uint8_t faster_read(faster_t* faster_t, const uint64_t key, uint8_t* output) {
+  auto callback = [](IAsyncContext* ctxt, Status result) {
+    CallbackContext<ReadContext> context{ ctxt };
+  };
+
+  ReadContext context {key, output};
+  Status result = with_plain_store(faster_t, [&](auto* store) {
+    return store->Read(context, callback, 1);
+  });
+  return static_cast<uint8_t>(result);
+}
+
+uint8_t faster_delete(faster_t* faster_t, const uint64_t key) {
+  return with_store(faster_t, [&](auto* store) {
+    typedef DeleteContext<store_key_t<decltype(store)>, store_value_t<decltype(store)>> context_t;
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<context_t> context { ctxt };
+      assert(result == Status::Ok || result == Status::NotFound);
+    };
+    if(!key_fits(store, key)) {
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+
+    context_t context {key};
+    Status result = store->Delete(context, callback, 1);
+    return static_cast<uint8_t>(result);
+  });
+}
+
+uint8_t mlkv_read(faster_t* faster_t, const uint64_t key, uint8_t* output, const uint64_t value_length) {
+  return mlkv_read_ex(faster_t, key, output, value_length, nullptr);
+}
+
+/// Like mlkv_read(), but waits at the staleness bound of "policy" rather than the store's.
+uint8_t mlkv_read_ex(faster_t* faster_t, const uint64_t key, uint8_t* output,
+                     const uint64_t value_length, const mlkv_staleness_policy* policy) {
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_key_t<decltype(store)> key_t;
+    typedef store_value_t<decltype(store)> value_t;
+    typedef MLKVReadContext<key_t, value_t> context_t;
+    auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
+      CallbackContext<context_t> context{ ctxt };
+    };
+    if(!row_fits<value_t>(faster_t, value_length, 0) || !key_fits(store, key)) {
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+    int32_t staleness_bound = read_staleness_bound(faster_t, policy);
+    flush_updates_for_read(faster_t, staleness_bound);
+    context_t context{ key, output, value_length, faster_t->format, 1, staleness_bound,
+                       faster_t->staleness_table };
+    Status result = store->Read(context, callback, 1);
+    if((result == Status::Ok && !context.counted) ||
+       (result == Status::NotFound && faster_t->initializer.init != mlkv::Init::None)) {
+      result = mlkv_read_copy(faster_t, store, key, output, value_length, staleness_bound);
+    }
+    return static_cast<uint8_t>(result);
+  });
+}
+
+/// Reads a row without copying it out of the log, if it is in memory and stored as float32: "row"
+/// then points into the log, whose page stays pinned until mlkv_release_pinned(). Otherwise, the
+/// row is decoded into a pooled buffer. As with a seqlock, the caller consumes the row and then
+/// calls mlkv_validate_pinned(), reading the row again if a writer updated it in place meanwhile.
+/// A row is released on the thread that read it.
+uint8_t mlkv_read_pinned(faster_t* faster_t, const uint64_t key, const uint64_t value_length,
+                         mlkv_pinned_row* row) {
+  *row = mlkv_pinned_row{};
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_key_t<decltype(store)> key_t;
+    typedef store_value_t<decltype(store)> value_t;
+    typedef MLKVPinnedReadContext<key_t, value_t> context_t;
+    auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
+      CallbackContext<context_t> context{ ctxt };
+      if(result == Status::Ok && !context->found) {
+        result = Status::NotFound;
+      }
+      *context->status() = static_cast<uint8_t>(result);
+    };
+    if(!row_fits<value_t>(faster_t, value_length, 0) || !key_fits(store, key)) {
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+    int32_t staleness_bound = read_staleness_bound(faster_t, nullptr);
+    flush_updates_for_read(faster_t, staleness_bound);
+    uint8_t status;
+    context_t context{ key, value_length, faster_t->format, 1, staleness_bound,
+                       faster_t->staleness_table, row, &status };
+    bool pending = false;
+    Status result = store->Read(context, callback, 1);
+    if(result == Status::Pending) {
+      store->CompletePending(true);
+      result = static_cast<Status>(status);
+      pending = true;
+    }
+
+    if((result == Status::Ok && !pending && !context.counted) ||
+       (result == Status::NotFound && faster_t->initializer.init != mlkv::Init::None)) {
+      // Count the read, or create the row, by copying it to the tail.
+      if(row->buffer != nullptr) {
+        release_pinned_buffer(static_cast<std::vector<uint8_t>*>(row->buffer));
+      }
+      *row = mlkv_pinned_row{};
+      auto* buffer = acquire_pinned_buffer(value_length);
+      result = mlkv_read_copy(faster_t, store, key, buffer->data(), value_length, staleness_bound,
+                              &status);
+      if(result == Status::Pending) {
+        store->CompletePending(true);
+        result = static_cast<Status>(status);
+      }
+      if(result != Status::Ok) {
+        release_pinned_buffer(buffer);
+        return static_cast<uint8_t>(result);
+      }
+      row->buffer = buffer;
+      row->data = buffer->data();
+      row->length = value_length;
+      return static_cast<uint8_t>(result);
+    }
+
+    if(result == Status::Ok && row->buffer == nullptr) {
+      Address address{ row->address };
+      if(address != Address::kInvalidAddress && address >= store->hlog.head_address.load()) {
+        store->hlog.PinPage(address);
+      } else {
+        // The row is in the read cache, or its page is already closing; this thread has not
+        // refreshed its epoch since the read, so the row is still there to copy from.
+        auto* buffer = acquire_pinned_buffer(row->length);
+        std::memcpy(buffer->data(), row->data, row->length);
+        row->record = nullptr;
+        row->buffer = buffer;
+        row->data = buffer->data();
+      }
+    }
+    return static_cast<uint8_t>(result);
+  });
+}
+
+/// True if a row from mlkv_read_pinned() held the same weights from the read until this call: no
+/// writer locked it meanwhile, and its page stayed in memory. A pooled copy is always valid. Any
+/// locked access advances the row's generation, so another thread's read of a row in the mutable
+/// region also fails validation.
+bool mlkv_validate_pinned(faster_t* faster_t, const mlkv_pinned_row* row) {
+  if(row->data == nullptr) {
+    return false;
+  }
+  if(row->buffer != nullptr) {
+    return true;
+  }
+  // Order the caller's loads of the row before the load of its GenLock.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  GenLock before{ row->gen };
+  GenLock after = static_cast<const AtomicGenLock*>(row->record)->load();
+  return with_store(faster_t, [&](auto* store) {
+    // A pinned page is closed anyway if it holds the head back too far; its frame, and so the
+    // GenLock just loaded, may then hold some other record.
+    if(Address{ row->address } < store->hlog.safe_head_address.load()) {
+      return false;
+    }
+    return !before.locked && !after.locked && before.gen_number == after.gen_number;
+  });
+}
+
+/// Unpins the page of a row from mlkv_read_pinned(), or returns its buffer to the pool.
+void mlkv_release_pinned(faster_t* faster_t, mlkv_pinned_row* row) {
+  if(row->buffer != nullptr) {
+    release_pinned_buffer(static_cast<std::vector<uint8_t>*>(row->buffer));
+  } else if(row->data != nullptr) {
+    with_store(faster_t, [&](auto* store) {
+      store->hlog.UnpinPage(Address{ row->address });
+    });
+  }
+  *row = mlkv_pinned_row{};
+}
+
+uint8_t mlkv_read_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys, uint8_t* output,
+                        const uint64_t value_length, uint8_t* statuses) {
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_key_t<decltype(store)> key_t;
+    typedef store_value_t<decltype(store)> value_t;
+    typedef MLKVReadContext<key_t, value_t> context_t;
+    auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
+      CallbackContext<context_t> context{ ctxt };
+      if(result == Status::Ok && !context->found) {
+        result = Status::NotFound;
+      }
+      *context->status() = static_cast<uint8_t>(result);
+    };
+    if(!row_fits<value_t>(faster_t, value_length, 0)) {
+      std::fill(statuses, statuses + num_keys, static_cast<uint8_t>(Status::Aborted));
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+
+    int32_t staleness_bound = read_staleness_bound(faster_t, nullptr);
+    flush_updates_for_read(faster_t, staleness_bound);
+    bool pending = pipeline_batch(store, keys, num_keys, statuses, [&](size_t idx) {
+      context_t context{ keys[idx], output + idx * value_length, value_length, faster_t->format, 1,
+                         staleness_bound, faster_t->staleness_table, nullptr, &statuses[idx] };
+      Status result = store->Read(context, callback, 1);
+      if((result == Status::Ok && !context.counted) ||
+         (result == Status::NotFound && faster_t->initializer.init != mlkv::Init::None)) {
+        result = mlkv_read_copy(faster_t, store, keys[idx], output + idx * value_length,
+                                value_length, staleness_bound, &statuses[idx]);
+      }
+      // If pending, the callback overwrites this with the final status.
+      statuses[idx] = static_cast<uint8_t>(result);
+      return result;
+    });
+    if(pending) {
+      store->CompletePending(true);
+      if(faster_t->initializer.init != mlkv::Init::None) {
+        // Create the rows that turned out to be missing only once read from disk.
+        bool created_pending = false;
+        for(size_t idx = 0; idx < num_keys; ++idx) {
+          if(statuses[idx] != static_cast<uint8_t>(Status::NotFound)) {
+            continue;
+          }
+          Status result = mlkv_read_copy(faster_t, store, keys[idx], output + idx * value_length,
+                                         value_length, staleness_bound, &statuses[idx]);
+          created_pending |= result == Status::Pending;
+          statuses[idx] = static_cast<uint8_t>(result);
+        }
+        if(created_pending) {
+          store->CompletePending(true);
+        }
+      }
+    }
+    return batch_result(statuses, num_keys);
+  });
+}
+
+uint8_t mlkv_upsert(faster_t* faster_t, const uint64_t key, uint8_t* value, uint64_t value_length) {
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_key_t<decltype(store)> key_t;
+    typedef store_value_t<decltype(store)> value_t;
+    typedef MLKVUpsertContext<key_t, value_t> context_t;
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<context_t> context{ ctxt };
+    };
+    if(!row_fits<value_t>(faster_t, value_length, faster_t->state_slots) ||
+       !key_fits(store, key)) {
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+
+    context_t context { key, value, value_length, faster_t->format, faster_t->state_slots,
+                        -1, kWriteStalenessBound, faster_t->staleness_table };
+    Status result = store->Rmw(context, callback, 1);
+    faster_t->staleness_table->notify(context.key().GetHash());
+    return static_cast<uint8_t>(result);
+  });
+}
+
+uint8_t mlkv_upsert_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys, uint8_t* values,
+                          const uint64_t value_length, uint8_t* statuses) {
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_key_t<decltype(store)> key_t;
+    typedef store_value_t<decltype(store)> value_t;
+    typedef MLKVUpsertContext<key_t, value_t> context_t;
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<context_t> context{ ctxt };
+      *context->status() = static_cast<uint8_t>(result);
+    };
+    if(!row_fits<value_t>(faster_t, value_length, faster_t->state_slots)) {
+      std::fill(statuses, statuses + num_keys, static_cast<uint8_t>(Status::Aborted));
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+
+    // Duplicate keys collapse into one upsert of the last value written for that key, which
+    // still retires one unit of staleness per duplicate.
+    group_batch_keys(keys, num_keys);
+    const std::vector<size_t>& order = batch_scratch.order;
+    const std::vector<size_t>& group_begin = batch_scratch.group_begin;
+    const std::vector<uint64_t>& unique_keys = batch_scratch.unique_keys;
+    batch_scratch.unique_statuses.resize(unique_keys.size());
+    uint8_t* unique_statuses = batch_scratch.unique_statuses.data();
+
+    bool pending = pipeline_batch(store, unique_keys.data(), unique_keys.size(), unique_statuses,
+                                  [&](size_t group) {
+      size_t last = order[group_begin[group + 1] - 1];
+      int32_t count = static_cast<int32_t>(group_begin[group + 1] - group_begin[group]);
+      context_t context{ unique_keys[group], values + last * value_length, value_length,
+                         faster_t->format, faster_t->state_slots, -count, kWriteStalenessBound,
+                         faster_t->staleness_table, &unique_statuses[group] };
+      Status result = store->Rmw(context, callback, 1);
+      faster_t->staleness_table->notify(context.key().GetHash());
+      unique_statuses[group] = static_cast<uint8_t>(result);
+      return result;
+    });
+    if(pending) {
+      store->CompletePending(true);
+    }
+    scatter_batch_statuses(statuses);
+    return batch_result(statuses, num_keys);
+  });
+}
+
+uint8_t mlkv_rmw_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys, uint8_t* incrs,
+                       const uint64_t value_length, uint8_t* statuses) {
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_value_t<decltype(store)> value_t;
+    if(!row_fits<value_t>(faster_t, value_length, 0)) {
+      std::fill(statuses, statuses + num_keys, static_cast<uint8_t>(Status::Aborted));
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+
+    if(faster_t->write_behind_rows > 0) {
+      uint8_t result = static_cast<uint8_t>(Status::Ok);
+      bool buffered = true;
+      for(size_t idx = 0; idx < num_keys && buffered; ++idx) {
+        if(!key_fits(store, keys[idx])) {
+          statuses[idx] = static_cast<uint8_t>(Status::Aborted);
+          result = statuses[idx];
+          continue;
+        }
+        const float* incr = reinterpret_cast<const float*>(incrs + idx * value_length);
+        buffered = buffer_update(faster_t, keys[idx], incr, value_length);
+        statuses[idx] = static_cast<uint8_t>(Status::Ok);
+      }
+      if(buffered) {
+        return result;
+      }
+      // The staleness bound does not allow for buffering, so no key was buffered.
+    }
+
+    // Increments of duplicate keys are summed into the scratch arena first, so each row takes its
+    // lock once per batch.
+    group_batch_keys(keys, num_keys);
+    const std::vector<size_t>& order = batch_scratch.order;
+    const std::vector<size_t>& group_begin = batch_scratch.group_begin;
+    const std::vector<uint64_t>& unique_keys = batch_scratch.unique_keys;
+    batch_scratch.unique_statuses.resize(unique_keys.size());
+    uint8_t* unique_statuses = batch_scratch.unique_statuses.data();
+
+    std::vector<uint8_t*>& unique_incrs = batch_scratch.unique_payloads;
+    unique_incrs.resize(unique_keys.size());
+    size_t arena_size = 0;
+    for(size_t group = 0; group < unique_keys.size(); ++group) {
+      if(group_begin[group + 1] - group_begin[group] > 1) {
+        arena_size += value_length;
+      }
+    }
+    batch_scratch.payloads.resize(arena_size);
+    uint8_t* arena = batch_scratch.payloads.data();
+    for(size_t group = 0; group < unique_keys.size(); ++group) {
+      uint8_t* first = incrs + order[group_begin[group]] * value_length;
+      if(group_begin[group + 1] - group_begin[group] == 1) {
+        unique_incrs[group] = first;
+        continue;
+      }
+      std::memcpy(arena, first, value_length);
+      float* sum = reinterpret_cast<float*>(arena);
+      for(size_t idx = group_begin[group] + 1; idx < group_begin[group + 1]; ++idx) {
+        const float* incr = reinterpret_cast<const float*>(incrs + order[idx] * value_length);
+        for(uint64_t elem = 0; elem < value_length / sizeof(float); ++elem) {
+          sum[elem] += incr[elem];
+        }
+      }
+      unique_incrs[group] = arena;
+      arena += value_length;
+    }
+
+    rmw_distinct_keys(faster_t, store, unique_keys.data(), unique_keys.size(), unique_incrs.data(),
+                      [&](size_t group) {
+      return static_cast<int32_t>(group_begin[group + 1] - group_begin[group]);
+    }, value_length, unique_statuses);
+    scatter_batch_statuses(statuses);
+    return batch_result(statuses, num_keys);
+  });
+}
+
+/// Runs one optimizer step on a key's row, as a single RMW; pushing a gradient retires one unit
+/// of staleness, like mlkv_upsert().
+static uint8_t mlkv_optimizer_step(faster_t* faster_t, const uint64_t key, const uint8_t* grad,
+                                   const uint64_t grad_length, const mlkv::OptimizerConfig& config) {
+  // Without a configured layout, a row holds just the state this optimizer needs.
+  uint32_t state_slots = faster_t->state_slots;
+  if(state_slots == 0) {
+    state_slots = mlkv::NumStateSlots(config.optimizer);
+  } else if(state_slots < mlkv::NumStateSlots(config.optimizer)) {
+    return static_cast<uint8_t>(Status::Aborted);
+  }
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_key_t<decltype(store)> key_t;
+    typedef store_value_t<decltype(store)> value_t;
+    typedef MLKVOptimizerContext<key_t, value_t> context_t;
+    auto callback = [](IAsyncContext* ctxt, Status result) {
+      CallbackContext<context_t> context{ ctxt };
+    };
+    if(!row_fits<value_t>(faster_t, grad_length, state_slots) || !key_fits(store, key)) {
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+
+    context_t context{ key, grad, grad_length, faster_t->format, state_slots, config, -1,
+                       kWriteStalenessBound, faster_t->staleness_table, faster_t->combining,
+                       &faster_t->initializer };
+    Status result = store->Rmw(context, callback, 1);
+    faster_t->staleness_table->notify(context.key().GetHash());
+    return static_cast<uint8_t>(result);
+  });
+}
+
+uint8_t mlkv_sgd(faster_t* faster_t, const uint64_t key, uint8_t* grad, const uint64_t grad_length,
+                 const float learning_rate) {
+  if(faster_t->write_behind_rows > 0) {
+    // An SGD step is additive: buffer it as -learning_rate * gradient.
+    bool fits = with_store(faster_t, [&](auto* store) {
+      typedef store_value_t<decltype(store)> value_t;
+      return row_fits<value_t>(faster_t, grad_length, 0) && key_fits(store, key);
+    });
+    if(!fits) {
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+    static thread_local std::vector<float> step;
+    step.resize(grad_length / sizeof(float));
+    const float* gradient = reinterpret_cast<const float*>(grad);
+    for(size_t idx = 0; idx < step.size(); ++idx) {
+      step[idx] = -learning_rate * gradient[idx];
+    }
+    if(buffer_update(faster_t, key, step.data(), grad_length)) {
+      return static_cast<uint8_t>(Status::Ok);
+    }
+  }
+  mlkv::OptimizerConfig config{ mlkv::Optimizer::Sgd, learning_rate, 0.0f, 0.0f, 0.0f, 0 };
+  return mlkv_optimizer_step(faster_t, key, grad, grad_length, config);
+}
+
+uint8_t mlkv_adagrad(faster_t* faster_t, const uint64_t key, uint8_t* grad, const uint64_t grad_length,
+                     const float learning_rate, const float epsilon) {
+  mlkv::OptimizerConfig config{ mlkv::Optimizer::Adagrad, learning_rate, 0.0f, 0.0f, epsilon, 0 };
+  return mlkv_optimizer_step(faster_t, key, grad, grad_length, config);
+}
+
+uint8_t mlkv_adam(faster_t* faster_t, const uint64_t key, uint8_t* grad, const uint64_t grad_length,
+                  const float learning_rate, const float beta1, const float beta2, const float epsilon,
+                  const uint64_t step) {
+  mlkv::OptimizerConfig config{ mlkv::Optimizer::Adam, learning_rate, beta1, beta2, epsilon, step };
+  return mlkv_optimizer_step(faster_t, key, grad, grad_length, config);
+}
+
+uint8_t mlkv_lookahead(faster_t* faster_t, const uint64_t key, const uint64_t value_length) {
+  return with_store(faster_t, [&](auto* store) {
+    typedef store_key_t<decltype(store)> key_t;
+    typedef store_value_t<decltype(store)> value_t;
+    typedef MLKVLookaheadContext<key_t, value_t> context_t;
+    auto callback = [](FASTER::core::IAsyncContext* ctxt, FASTER::core::Status result) {
+      CallbackContext<context_t> context{ ctxt };
+    };
+    if(!row_fits<value_t>(faster_t, value_length, 0) || !key_fits(store, key)) {
+      return static_cast<uint8_t>(Status::Aborted);
+    }
+    context_t context{ key, value_length, faster_t->format, &faster_t->initializer };
+    Status result = store->Rmw(context, callback, 1);
+    return static_cast<uint8_t>(result);
+  });
+}
+
+static LookaheadEngine* new_lookahead_engine(faster_t* faster_t, const uint32_t num_threads,
+                                             const uint32_t max_pending) {
+  return with_store(faster_t, [&](auto* store) -> LookaheadEngine* {
+    typedef typename std::remove_pointer<decltype(store)>::type s_t;
+    return new StoreLookaheadEngine<s_t>{ store, faster_t->format, &faster_t->initializer,
+                                          num_threads, max_pending };
+  });
+}
+
+/// Starts the store's lookahead engine with "num_threads" threads, each with at most
+/// "max_pending" prefetches waiting on disk. Returns false if it is already running.
+bool mlkv_start_lookahead(faster_t* faster_t, const uint32_t num_threads, const uint32_t max_pending) {
+  std::lock_guard<std::mutex> lock{ faster_t->lookahead_mutex };
+  if(faster_t->lookahead) {
+    return false;
+  }
+  faster_t->lookahead = new_lookahead_engine(faster_t, num_threads, max_pending);
+  return true;
+}
+
+/// Queues the keys of upcoming minibatches for prefetching, and returns their ticket. Call
+/// mlkv_lookahead_consume() with the ticket when the trainer reaches those minibatches.
+uint64_t mlkv_lookahead_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys,
+                              const uint64_t value_length) {
+  LookaheadEngine* lookahead;
+  {
+    std::lock_guard<std::mutex> lock{ faster_t->lookahead_mutex };
+    if(!faster_t->lookahead) {
+      faster_t->lookahead = new_lookahead_engine(faster_t, kDefaultLookaheadThreads,
+                                                 kDefaultLookaheadPending);
+    }
+    lookahead = faster_t->lookahead;
+  }
+  return lookahead->Submit(keys, num_keys, value_length);
+}
+
+/// The trainer reaches the minibatches of "ticket" and of every ticket before it: their keys are no
+/// longer prefetched, and their rows are unpinned, since the trainer's own reads now pin them.
+void mlkv_lookahead_consume(faster_t* faster_t, const uint64_t ticket) {
+  std::lock_guard<std::mutex> lock{ faster_t->lookahead_mutex };
+  if(faster_t->lookahead) {
+    faster_t->lookahead->Consume(ticket);
+  }
+}
+
+/// Consumes "ticket" and every ticket before it, once the training steps that read them are done;
+/// a trainer that never calls mlkv_lookahead_consume() releases its tickets' pins here.
+void mlkv_lookahead_release(faster_t* faster_t, const uint64_t ticket) {
+  std::lock_guard<std::mutex> lock{ faster_t->lookahead_mutex };
+  if(faster_t->lookahead) {
+    faster_t->lookahead->Release(ticket);
+  }
+}
+
+void mlkv_get_lookahead_stats(faster_t* faster_t, mlkv_lookahead_stats* stats) {
+  std::lock_guard<std::mutex> lock{ faster_t->lookahead_mutex };
+  if(!faster_t->lookahead) {
+    *stats = mlkv_lookahead_stats{ 0, 0, 0, 0 };
+    return;
+  }
+  const LookaheadState& state = faster_t->lookahead->state();
+  stats->hot = state.hot.load();
+  stats->in_time = state.in_time.load();
+  stats->late = state.late.load();
+  stats->pinned_pages_closed = with_store(faster_t, [](auto* store) {
+    return store->hlog.pinned_pages_closed();
+  });
+}
+
+void mlkv_get_staleness_stats(faster_t* faster_t, mlkv_staleness_stats* stats) {
+  stats->blocked = faster_t->staleness_table->blocked();
+  stats->blocked_ns = faster_t->staleness_table->blocked_ns();
+  stats->untracked_reads = faster_t->staleness_table->overflows();
+}
+
+void mlkv_get_combining_stats(faster_t* faster_t, mlkv_combining_stats* stats) {
+  stats->published = faster_t->combining ? faster_t->combining->published() : 0;
+  stats->combiners = faster_t->combining ? faster_t->combining->combiners() : 0;
+}
+
+void mlkv_get_read_cache_stats(faster_t* faster_t, mlkv_read_cache_stats* stats) {
+  ReadCacheStats read_cache = with_store(faster_t, [](auto* store) {
+    return store->GetReadCacheStats();
+  });
+  stats->hits = read_cache.hits;
+  stats->admissions = read_cache.admissions;
+  stats->second_chances = read_cache.second_chances;
+  stats->evicted_bytes = read_cache.evicted_bytes;
+}
+
+void mlkv_get_promotion_stats(faster_t* faster_t, mlkv_promotion_stats* stats) {
+  PromotionStats promotion = with_store(faster_t, [](auto* store) {
+    return store->GetPromotionStats();
+  });
+  stats->promoted_read_only = promotion.read_only_promotions;
+  stats->promoted_from_disk = promotion.disk_promotions;
+  stats->skipped_cold = promotion.cold_records;
+  stats->sketch_resets = promotion.sketch.resets;
+  stats->sampled_keys = promotion.sketch.sampled_keys;
+  stats->mean_overestimate = promotion.sketch.mean_overestimate;
+}
+
+void mlkv_get_io_stats(faster_t* faster_t, mlkv_io_stats* stats) {
+  IoQueueStats io_queue = with_store(faster_t, [](auto* store) {
+    return store->GetIoQueueStats();
+  });
+  stats->depth = io_queue.depth;
+  stats->pending = io_queue.pending;
+  stats->latency_us = io_queue.latency_us;
+  stats->min_latency_us = io_queue.min_latency_us;
+  stats->iops = io_queue.iops;
+  stats->throttled = io_queue.throttled;
+  stats->throttled_ns = io_queue.throttled_ns;
+}
+
+faster_t* faster_recover(const uint64_t table_size, const uint64_t log_size, const char* storage, const char* checkpoint_token) {
+  faster_t* res = new faster_t();
+  new_store(res, table_size, log_size, storage, 0, false);
+  res->staleness_table = new_staleness_table(res, 2 * table_size);
+
+  bool recovered = with_store(res, [&](auto* store) {
+    return recover_store(store, checkpoint_token);
+  });
+  if(!recovered) {
+    return nullptr;
+  }
+  return res;
+}
+
+/// Recovers a store opened by faster_open_fixed() with the same "row_length".
+faster_t* faster_recover_fixed(const uint64_t table_size, const uint64_t log_size,
+                               const char* storage, const char* checkpoint_token,
+                               const uint32_t row_length) {
+  faster_t* res = new faster_t();
+  if(row_length == 0 || !new_store(res, table_size, log_size, storage, row_length, false)) {
+    delete res;
+    return nullptr;
+  }
+  res->staleness_table = new_staleness_table(res, 2 * table_size);
+  update_value_size_hint(res);
+
+  bool recovered = with_store(res, [&](auto* store) {
+    return recover_store(store, checkpoint_token);
+  });
+  if(!recovered) {
+    return nullptr;
+  }
+  return res;
+}
+
+/// Recovers a store opened by faster_open_dense() with the same "num_keys" and "row_length".
+faster_t* faster_recover_dense(const uint64_t num_keys, const uint64_t log_size,
+                               const char* storage, const char* checkpoint_token,
+                               const uint32_t row_length) {
+  faster_t* res = new faster_t();
+  uint64_t table_size = dense_table_size(num_keys);
+  if(!new_store(res, table_size, log_size, storage, row_length, true)) {
+    delete res;
+    return nullptr;
+  }
+  res->staleness_table = new_staleness_table(res, 2 * table_size);
+  update_value_size_hint(res);
+
+  bool recovered = with_store(res, [&](auto* store) {
+    return recover_store(store, checkpoint_token);
+  });
+  if(!recovered) {
+    return nullptr;
+  }
+  return res;
+}
+
+/// Recovers a store opened by faster_open_ex() with the same "table_size" and "options"; null
+/// for stores on the null backend, or if the store or checkpoint cannot be opened.
+faster_t* faster_recover_ex(const uint64_t table_size, const uint64_t log_size,
+                            const char* storage, const char* checkpoint_token,
+                            const faster_options* options) {
+  faster_t* res = new faster_t();
+  StoreConfig config;
+  bool dense = options && options->dense;
+  uint32_t row_length = options ? options->row_length : 0;
+  uint64_t index_size = dense ? dense_table_size(table_size) : table_size;
+  if(!apply_options(res, options, config) || res->backend == FASTER_IO_NULL) {
+    delete res;
+    return nullptr;
+  }
+  bool recovered;
+  try {
+    if(!new_store(res, index_size, log_size, storage, row_length, dense, config)) {
+      delete res;
+      return nullptr;
+    }
+    res->staleness_table = new_staleness_table(res, 2 * index_size);
+    update_value_size_hint(res);
+    recovered = with_store(res, [&](auto* store) {
+      return recover_store(store, checkpoint_token);
+    });
+  } catch(const std::exception&) {
+    recovered = false;
+  }
+  if(!recovered) {
+    faster_destroy(res);
+    return nullptr;
+  }
+  return res;
+}
+
+/// Checkpoints the store; false for stores on the null backend, which have nowhere to write one.
 bool faster_checkpoint(faster_t *faster_t) {
   static Guid token;
   static std::atomic<bool> index_checkpoint_completed;
@@ -710,45 +3953,68 @@ bool faster_checkpoint(faster_t *faster_t) {
     hybrid_log_checkpoint_completed = true;
   };
 
-  faster_t->store->StartSession();
-  bool result = faster_t->store->Checkpoint(index_persistence_callback, hybrid_log_persistence_callback, token);
-
-  while(!index_checkpoint_completed) {
-    faster_t->store->CompletePending(false);
-  }
-  while(!hybrid_log_checkpoint_completed) {
-    faster_t->store->CompletePending(false);
+  if(faster_t->backend == FASTER_IO_NULL) {
+    return false;
   }
-  faster_t->store->CompletePending(true);
-  faster_t->store->StopSession();
 
-  return result;
+  return with_store(faster_t, [&](auto* store) {
+    store->StartSession();
+    bool result = store->Checkpoint(index_persistence_callback, hybrid_log_persistence_callback, token);
+
+    while(!index_checkpoint_completed) {
+      store->CompletePending(false);
+    }
+    while(!hybrid_log_checkpoint_completed) {
+      store->CompletePending(false);
+    }
+    store->CompletePending(true);
+    store->StopSession();
+
+    return result;
+  });
 }
 
 void faster_destroy(faster_t *faster_t) {
   if (faster_t == NULL)
     return;
 
-  delete faster_t->store;
+  // Lookahead and write-behind threads hold sessions on the store, so stop them first.
+  delete faster_t->lookahead;
+  delete faster_t->write_behind;
+  delete_stores(faster_t->aio);
+#ifdef FASTER_URING
+  delete_stores(faster_t->uring);
+#endif
+  delete_stores(faster_t->in_memory);
+  delete faster_t->staleness_table;
+  delete faster_t->combining;
   delete faster_t;
 }
 
 // Thread-related
 void faster_complete_pending(faster_t* faster_t, bool wait) {
   if (faster_t != NULL) {
-    faster_t->store->CompletePending(wait);
+    with_store(faster_t, [&](auto* store) {
+      store->CompletePending(wait);
+    });
   }
 }
 
 void faster_start_session(faster_t* faster_t) {
   if (faster_t != NULL) {
-    faster_t->store->StartSession();
+    with_store(faster_t, [&](auto* store) {
+      store->StartSession();
+    });
   }
 }
 
 void faster_stop_session(faster_t* faster_t) {
   if (faster_t != NULL) {
-    faster_t->store->StopSession();
+    push_own_updates(faster_t);
+    local_staleness.flush();
+    with_store(faster_t, [&](auto* store) {
+      store->StopSession();
+    });
   }
 }
 } // extern "C"
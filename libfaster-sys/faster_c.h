@@ -17,6 +17,132 @@ extern "C" {
 
 typedef struct faster_t faster_t;
 
+// How far a reader may run ahead of the writers of a row: BSP waits for every pending write, SSP
+// for all but "bound" of them, ASP never waits.
+typedef enum mlkv_sync_mode {
+  MLKV_SYNC_BSP = 0,
+  MLKV_SYNC_SSP = 1,
+  MLKV_SYNC_ASP = 2
+} mlkv_sync_mode;
+
+// How MLKV operations fill a row they create on first touch: ZEROS, UNIFORM in [param1, param2),
+// NORMAL with mean param1 and stddev param2, or XAVIER (Glorot uniform) with fan-in param1 and
+// fan-out param2 (0 means the row's dimension).
+typedef enum mlkv_init_kind {
+  MLKV_INIT_NONE = 0,
+  MLKV_INIT_ZEROS = 1,
+  MLKV_INIT_UNIFORM = 2,
+  MLKV_INIT_NORMAL = 3,
+  MLKV_INIT_XAVIER = 4
+} mlkv_init_kind;
+
+// How MLKV rows store their weights; the API always takes and returns float32. INT8 rows keep a
+// float32 scale per row, and optimizer state is float32 in every format.
+typedef enum mlkv_storage_format {
+  MLKV_FORMAT_FP32 = 0,
+  MLKV_FORMAT_FP16 = 1,
+  MLKV_FORMAT_BF16 = 2,
+  MLKV_FORMAT_INT8 = 3
+} mlkv_storage_format;
+
+// Where faster_open_ex() puts a store's log: files written with Linux AIO, or with io_uring (in
+// builds with USE_URING), or nowhere, for a store that must fit in memory: once its log is full,
+// writes that would append records fail with OutOfMemory.
+typedef enum faster_io_backend {
+  FASTER_IO_LIBAIO = 0,
+  FASTER_IO_URING = 1,
+  FASTER_IO_NULL = 2
+} faster_io_backend;
+
+// Options of faster_open_ex(). Zero fields take faster_open()'s defaults: libaio, 1 GB log
+// segments (otherwise a power of 2, at least 32 MB), 80% of the in-memory log mutable, an I/O
+// handler sized for 16 threads, and variable-length rows under a hashed index. row_length and
+// dense are as for faster_open_fixed() and faster_open_dense(). pre_allocate_log allocates
+// every page of the in-memory log up front.
+typedef struct faster_options {
+  uint8_t io_backend;
+  uint64_t segment_size;
+  double mutable_fraction;
+  bool pre_allocate_log;
+  uint32_t io_threads;
+  uint32_t row_length;
+  bool dense;
+} faster_options;
+
+typedef struct mlkv_staleness_policy {
+  uint8_t mode;
+  int32_t bound;
+} mlkv_staleness_policy;
+
+typedef struct mlkv_staleness_stats {
+  uint64_t blocked;
+  uint64_t blocked_ns;
+  uint64_t untracked_reads;
+} mlkv_staleness_stats;
+
+// Gradient pushes that mlkv_set_combining() had another thread apply, and how many lock holders
+// applied any.
+typedef struct mlkv_combining_stats {
+  uint64_t published;
+  uint64_t combiners;
+} mlkv_combining_stats;
+
+// Reads that mlkv_set_read_cache()'s cache served instead of the disk, rows it admitted after a
+// disk read, hits that copied a row about to be evicted back to its tail, and bytes it evicted.
+typedef struct mlkv_read_cache_stats {
+  uint64_t hits;
+  uint64_t admissions;
+  uint64_t second_chances;
+  uint64_t evicted_bytes;
+} mlkv_read_cache_stats;
+
+// Rows mlkv_set_promotion() copied back to the tail of the log from the read-only region and from
+// disk, and rows it left where they were as not hot enough. Also the accuracy of its sketch: how
+// many times its counters were halved, and by how much it overestimated the read counts of a
+// sample of keys, on average.
+typedef struct mlkv_promotion_stats {
+  uint64_t promoted_read_only;
+  uint64_t promoted_from_disk;
+  uint64_t skipped_cold;
+  uint64_t sketch_resets;
+  uint64_t sampled_keys;
+  double mean_overestimate;
+} mlkv_promotion_stats;
+
+// The adaptive limit on reads in flight from disk: the current limit, reads in flight, the mean
+// latency of recent reads and the lowest seen recently (in microseconds), recent reads per
+// second, and how many times, and for how long in all, threads waited to issue a read.
+typedef struct mlkv_io_stats {
+  uint32_t depth;
+  uint64_t pending;
+  double latency_us;
+  double min_latency_us;
+  double iops;
+  uint64_t throttled;
+  uint64_t throttled_ns;
+} mlkv_io_stats;
+
+// What became of the keys the lookahead engine prefetched: already in the mutable region, copied
+// there before the trainer consumed their ticket, or after it (or never issued). Also counts log
+// pages evicted while pinned by an unreleased ticket.
+typedef struct mlkv_lookahead_stats {
+  uint64_t hot;
+  uint64_t in_time;
+  uint64_t late;
+  uint64_t pinned_pages_closed;
+} mlkv_lookahead_stats;
+
+// A row read by mlkv_read_pinned(): "length" bytes of float32 weights at "data", in place in the
+// in-memory log or in a pooled copy. The remaining fields belong to the store.
+typedef struct mlkv_pinned_row {
+  const uint8_t* data;
+  uint64_t length;
+  uint64_t address;
+  uint64_t gen;
+  const void* record;
+  void* buffer;
+} mlkv_pinned_row;
+
 // Thread-related operations
 void faster_complete_pending(faster_t* faster_t, bool wait);
 void faster_start_session(faster_t* faster_t);
@@ -24,14 +150,51 @@ void faster_stop_session(faster_t* faster_t);
 
 // Operations
 faster_t* faster_open(const uint64_t table_size, const uint64_t log_size, const char* storage);
+faster_t* faster_open_with_policy(const uint64_t table_size, const uint64_t log_size, const char* storage, const mlkv_staleness_policy* policy);
+faster_t* faster_open_fixed(const uint64_t table_size, const uint64_t log_size, const char* storage, const uint32_t row_length, const mlkv_staleness_policy* policy);
+faster_t* faster_open_dense(const uint64_t num_keys, const uint64_t log_size, const char* storage, const uint32_t row_length, const mlkv_staleness_policy* policy);
+faster_t* faster_open_ex(const uint64_t table_size, const uint64_t log_size, const char* storage, const faster_options* options, const mlkv_staleness_policy* policy);
+bool mlkv_set_storage_format(faster_t* faster_t, const uint8_t format);
+void mlkv_set_state_slots(faster_t* faster_t, const uint32_t num_slots);
+void mlkv_set_value_length_hint(faster_t* faster_t, const uint64_t value_length);
+void mlkv_set_combining(faster_t* faster_t, const bool enabled);
+bool mlkv_set_read_cache(faster_t* faster_t, const uint64_t size);
+bool mlkv_set_promotion(faster_t* faster_t, const uint64_t sketch_width, const uint32_t threshold);
+uint64_t mlkv_promote_hot(faster_t* faster_t, const uint64_t max_bytes);
+void mlkv_set_write_behind(faster_t* faster_t, const uint32_t max_rows, const uint32_t flush_interval_ms);
+uint8_t mlkv_flush_updates(faster_t* faster_t);
+void mlkv_set_initializer(faster_t* faster_t, const uint8_t kind, const float param1, const float param2, const uint64_t seed);
 uint8_t faster_upsert(faster_t* faster_t, const uint64_t key, uint8_t* value, uint64_t value_length);
 uint8_t faster_rmw(faster_t* faster_t, const uint64_t key, uint8_t* incr, const uint64_t value_length);
 uint8_t faster_read(faster_t* faster_t, const uint64_t key, uint8_t* output);
 uint8_t faster_delete(faster_t* faster_t, const uint64_t key);
 uint8_t mlkv_read(faster_t* faster_t, const uint64_t key, uint8_t* output, const uint64_t value_length);
+uint8_t mlkv_read_ex(faster_t* faster_t, const uint64_t key, uint8_t* output, const uint64_t value_length, const mlkv_staleness_policy* policy);
+uint8_t mlkv_read_pinned(faster_t* faster_t, const uint64_t key, const uint64_t value_length, mlkv_pinned_row* row);
+bool mlkv_validate_pinned(faster_t* faster_t, const mlkv_pinned_row* row);
+void mlkv_release_pinned(faster_t* faster_t, mlkv_pinned_row* row);
+uint8_t mlkv_read_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys, uint8_t* output, const uint64_t value_length, uint8_t* statuses);
 uint8_t mlkv_upsert(faster_t* faster_t, const uint64_t key, uint8_t* value, uint64_t value_length);
+uint8_t mlkv_upsert_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys, uint8_t* values, const uint64_t value_length, uint8_t* statuses);
+uint8_t mlkv_rmw_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys, uint8_t* incrs, const uint64_t value_length, uint8_t* statuses);
+uint8_t mlkv_sgd(faster_t* faster_t, const uint64_t key, uint8_t* grad, const uint64_t grad_length, const float learning_rate);
+uint8_t mlkv_adagrad(faster_t* faster_t, const uint64_t key, uint8_t* grad, const uint64_t grad_length, const float learning_rate, const float epsilon);
+uint8_t mlkv_adam(faster_t* faster_t, const uint64_t key, uint8_t* grad, const uint64_t grad_length, const float learning_rate, const float beta1, const float beta2, const float epsilon, const uint64_t step);
 uint8_t mlkv_lookahead(faster_t* faster_t, const uint64_t key, const uint64_t value_length);
+bool mlkv_start_lookahead(faster_t* faster_t, const uint32_t num_threads, const uint32_t max_pending);
+uint64_t mlkv_lookahead_batch(faster_t* faster_t, const uint64_t* keys, size_t num_keys, const uint64_t value_length);
+void mlkv_lookahead_consume(faster_t* faster_t, const uint64_t ticket);
+void mlkv_lookahead_release(faster_t* faster_t, const uint64_t ticket);
+void mlkv_get_lookahead_stats(faster_t* faster_t, mlkv_lookahead_stats* stats);
+void mlkv_get_staleness_stats(faster_t* faster_t, mlkv_staleness_stats* stats);
+void mlkv_get_combining_stats(faster_t* faster_t, mlkv_combining_stats* stats);
+void mlkv_get_read_cache_stats(faster_t* faster_t, mlkv_read_cache_stats* stats);
+void mlkv_get_promotion_stats(faster_t* faster_t, mlkv_promotion_stats* stats);
+void mlkv_get_io_stats(faster_t* faster_t, mlkv_io_stats* stats);
 faster_t* faster_recover(const uint64_t table_size, const uint64_t log_size, const char* storage, const char* checkpoint_token);
+faster_t* faster_recover_fixed(const uint64_t table_size, const uint64_t log_size, const char* storage, const char* checkpoint_token, const uint32_t row_length);
+faster_t* faster_recover_dense(const uint64_t num_keys, const uint64_t log_size, const char* storage, const char* checkpoint_token, const uint32_t row_length);
+faster_t* faster_recover_ex(const uint64_t table_size, const uint64_t log_size, const char* storage, const char* checkpoint_token, const faster_options* options);
 bool faster_checkpoint(faster_t* faster_t);
 void faster_destroy(faster_t* faster_t);
 
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Float32 initial values for MLKV rows that are created on first touch, seeded per key so that
+// a row's initial value does not depend on which thread or operation created it.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace mlkv {
+
+enum class Init : uint8_t {
+  None,
+  Zeros,
+  Uniform,
+  Normal,
+  Xavier
+};
+
+/// How to fill the weights of a new row. Uniform draws from [param1, param2); Normal from
+/// N(param1, param2^2); Xavier (Glorot uniform) from [-b, b), with b = sqrt(6 / (fan_in +
+/// fan_out)), fan_in = param1 and fan_out = param2, each defaulting to the row's dimension if 0.
+struct Initializer {
+  Init init;
+  float param1;
+  float param2;
+  uint64_t seed;
+};
+
+/// SplitMix64: statistically sound, and cheap enough to seed once per row.
+class SplitMix64 {
+ public:
+  SplitMix64(uint64_t seed)
+    : state_{ seed } {
+  }
+
+  inline uint64_t Next() {
+    uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+  /// Uniform in [0, 1), from the upper 24 bits.
+  inline float NextFloat() {
+    return static_cast<float>(Next() >> 40) * (1.0f / 16777216.0f);
+  }
+
+ private:
+  uint64_t state_;
+};
+
+inline void FillUniform(SplitMix64& rng, float* row, size_t dim, float low, float high) {
+  for(size_t idx = 0; idx < dim; ++idx) {
+    row[idx] = low + (high - low) * rng.NextFloat();
+  }
+}
+
+/// Box-Muller, two values per pair of draws.
+inline void FillNormal(SplitMix64& rng, float* row, size_t dim, float mean, float stddev) {
+  constexpr float kTwoPi = 6.28318530717958647692f;
+  for(size_t idx = 0; idx < dim; idx += 2) {
+    // 1 - u is in (0, 1], so the log is finite.
+    float radius = stddev * std::sqrt(-2.0f * std::log(1.0f - rng.NextFloat()));
+    float angle = kTwoPi * rng.NextFloat();
+    row[idx] = mean + radius * std::cos(angle);
+    if(idx + 1 < dim) {
+      row[idx + 1] = mean + radius * std::sin(angle);
+    }
+  }
+}
+
+/// Fills the "dim" weights of the row for "key". Returns false, leaving the row alone, if there
+/// is no initializer.
+inline bool InitializeRow(const Initializer& init, uint64_t key, float* row, size_t dim) {
+  // Mix the key before combining it with the seed, so neighbouring keys get unrelated streams.
+  SplitMix64 rng{ init.seed ^ SplitMix64{ key }.Next() };
+  switch(init.init) {
+  case Init::None:
+    return false;
+  case Init::Zeros:
+    for(size_t idx = 0; idx < dim; ++idx) {
+      row[idx] = 0.0f;
+    }
+    return true;
+  case Init::Uniform:
+    FillUniform(rng, row, dim, init.param1, init.param2);
+    return true;
+  case Init::Normal:
+    FillNormal(rng, row, dim, init.param1, init.param2);
+    return true;
+  case Init::Xavier: {
+    float fan_in = init.param1 > 0.0f ? init.param1 : static_cast<float>(dim);
+    float fan_out = init.param2 > 0.0f ? init.param2 : static_cast<float>(dim);
+    float bound = std::sqrt(6.0f / (fan_in + fan_out));
+    FillUniform(rng, row, dim, -bound, bound);
+    return true;
+  }
+  }
+  return false;
+}
+
+}  // namespace mlkv
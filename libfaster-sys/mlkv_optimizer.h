@@ -0,0 +1,248 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Float32 optimizer kernels applied by MLKV's RMW contexts, with runtime CPU dispatch.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MLKV_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace mlkv {
+
+enum class Optimizer : uint8_t {
+  Sgd,
+  Adagrad,
+  Adam
+};
+
+/// Number of float32 state vectors, each as long as the weight vector, that an optimizer keeps
+/// per row.
+inline constexpr uint32_t NumStateSlots(Optimizer optimizer) {
+  return optimizer == Optimizer::Adam ? 2 : (optimizer == Optimizer::Adagrad ? 1 : 0);
+}
+
+/// Hyperparameters for one update step. (Adam uses "step", 1-based, for bias correction.)
+struct OptimizerConfig {
+  Optimizer optimizer;
+  float learning_rate;
+  float beta1;
+  float beta2;
+  float epsilon;
+  uint64_t step;
+};
+
+/// Kernel signatures. "state" points at NumStateSlots() vectors of "dim" floats each, back to
+/// back.
+typedef void(*SgdKernel)(float* weights, const float* grad, size_t dim, float lr);
+typedef void(*AdagradKernel)(float* weights, float* accum, const float* grad, size_t dim, float lr,
+                             float epsilon);
+typedef void(*AdamKernel)(float* weights, float* moment1, float* moment2, const float* grad,
+                          size_t dim, float lr, float beta1, float beta2, float epsilon);
+
+namespace kernels {
+
+inline void SgdScalar(float* weights, const float* grad, size_t dim, float lr) {
+  for(size_t idx = 0; idx < dim; ++idx) {
+    weights[idx] -= lr * grad[idx];
+  }
+}
+
+inline void AdagradScalar(float* weights, float* accum, const float* grad, size_t dim, float lr,
+                          float epsilon) {
+  for(size_t idx = 0; idx < dim; ++idx) {
+    accum[idx] += grad[idx] * grad[idx];
+    weights[idx] -= lr * grad[idx] / (std::sqrt(accum[idx]) + epsilon);
+  }
+}
+
+/// "lr" already includes Adam's bias correction.
+inline void AdamScalar(float* weights, float* moment1, float* moment2, const float* grad,
+                       size_t dim, float lr, float beta1, float beta2, float epsilon) {
+  for(size_t idx = 0; idx < dim; ++idx) {
+    moment1[idx] = beta1 * moment1[idx] + (1.0f - beta1) * grad[idx];
+    moment2[idx] = beta2 * moment2[idx] + (1.0f - beta2) * grad[idx] * grad[idx];
+    weights[idx] -= lr * moment1[idx] / (std::sqrt(moment2[idx]) + epsilon);
+  }
+}
+
+#ifdef MLKV_X86_DISPATCH
+
+__attribute__((target("avx2,fma")))
+inline void SgdAvx2(float* weights, const float* grad, size_t dim, float lr) {
+  const __m256 neg_lr = _mm256_set1_ps(-lr);
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    __m256 w = _mm256_loadu_ps(weights + idx);
+    w = _mm256_fmadd_ps(neg_lr, _mm256_loadu_ps(grad + idx), w);
+    _mm256_storeu_ps(weights + idx, w);
+  }
+  SgdScalar(weights + idx, grad + idx, dim - idx, lr);
+}
+
+__attribute__((target("avx2,fma")))
+inline void AdagradAvx2(float* weights, float* accum, const float* grad, size_t dim, float lr,
+                        float epsilon) {
+  const __m256 lr_v = _mm256_set1_ps(lr);
+  const __m256 eps_v = _mm256_set1_ps(epsilon);
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    __m256 g = _mm256_loadu_ps(grad + idx);
+    __m256 a = _mm256_fmadd_ps(g, g, _mm256_loadu_ps(accum + idx));
+    _mm256_storeu_ps(accum + idx, a);
+    __m256 step = _mm256_div_ps(_mm256_mul_ps(lr_v, g), _mm256_add_ps(_mm256_sqrt_ps(a), eps_v));
+    _mm256_storeu_ps(weights + idx, _mm256_sub_ps(_mm256_loadu_ps(weights + idx), step));
+  }
+  AdagradScalar(weights + idx, accum + idx, grad + idx, dim - idx, lr, epsilon);
+}
+
+__attribute__((target("avx2,fma")))
+inline void AdamAvx2(float* weights, float* moment1, float* moment2, const float* grad,
+                     size_t dim, float lr, float beta1, float beta2, float epsilon) {
+  const __m256 lr_v = _mm256_set1_ps(lr);
+  const __m256 b1 = _mm256_set1_ps(beta1);
+  const __m256 b2 = _mm256_set1_ps(beta2);
+  const __m256 one_minus_b1 = _mm256_set1_ps(1.0f - beta1);
+  const __m256 one_minus_b2 = _mm256_set1_ps(1.0f - beta2);
+  const __m256 eps_v = _mm256_set1_ps(epsilon);
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    __m256 g = _mm256_loadu_ps(grad + idx);
+    __m256 m = _mm256_fmadd_ps(b1, _mm256_loadu_ps(moment1 + idx), _mm256_mul_ps(one_minus_b1, g));
+    __m256 v = _mm256_fmadd_ps(b2, _mm256_loadu_ps(moment2 + idx),
+                               _mm256_mul_ps(one_minus_b2, _mm256_mul_ps(g, g)));
+    _mm256_storeu_ps(moment1 + idx, m);
+    _mm256_storeu_ps(moment2 + idx, v);
+    __m256 step = _mm256_div_ps(_mm256_mul_ps(lr_v, m), _mm256_add_ps(_mm256_sqrt_ps(v), eps_v));
+    _mm256_storeu_ps(weights + idx, _mm256_sub_ps(_mm256_loadu_ps(weights + idx), step));
+  }
+  AdamScalar(weights + idx, moment1 + idx, moment2 + idx, grad + idx, dim - idx, lr, beta1, beta2,
+             epsilon);
+}
+
+/// _mm512_sqrt_ps() starts from an undefined vector, which GCC reports as maybe-uninitialized
+/// once inlined; the zero-masked form computes the same all-lanes result.
+__attribute__((target("avx512f")))
+inline __m512 SqrtAvx512(__m512 value) {
+  return _mm512_maskz_sqrt_ps(static_cast<__mmask16>(0xFFFF), value);
+}
+
+__attribute__((target("avx512f")))
+inline void SgdAvx512(float* weights, const float* grad, size_t dim, float lr) {
+  const __m512 neg_lr = _mm512_set1_ps(-lr);
+  size_t idx = 0;
+  for(; idx + 16 <= dim; idx += 16) {
+    __m512 w = _mm512_loadu_ps(weights + idx);
+    w = _mm512_fmadd_ps(neg_lr, _mm512_loadu_ps(grad + idx), w);
+    _mm512_storeu_ps(weights + idx, w);
+  }
+  SgdScalar(weights + idx, grad + idx, dim - idx, lr);
+}
+
+__attribute__((target("avx512f")))
+inline void AdagradAvx512(float* weights, float* accum, const float* grad, size_t dim, float lr,
+                          float epsilon) {
+  const __m512 lr_v = _mm512_set1_ps(lr);
+  const __m512 eps_v = _mm512_set1_ps(epsilon);
+  size_t idx = 0;
+  for(; idx + 16 <= dim; idx += 16) {
+    __m512 g = _mm512_loadu_ps(grad + idx);
+    __m512 a = _mm512_fmadd_ps(g, g, _mm512_loadu_ps(accum + idx));
+    _mm512_storeu_ps(accum + idx, a);
+    __m512 step = _mm512_div_ps(_mm512_mul_ps(lr_v, g), _mm512_add_ps(SqrtAvx512(a), eps_v));
+    _mm512_storeu_ps(weights + idx, _mm512_sub_ps(_mm512_loadu_ps(weights + idx), step));
+  }
+  AdagradScalar(weights + idx, accum + idx, grad + idx, dim - idx, lr, epsilon);
+}
+
+__attribute__((target("avx512f")))
+inline void AdamAvx512(float* weights, float* moment1, float* moment2, const float* grad,
+                       size_t dim, float lr, float beta1, float beta2, float epsilon) {
+  const __m512 lr_v = _mm512_set1_ps(lr);
+  const __m512 b1 = _mm512_set1_ps(beta1);
+  const __m512 b2 = _mm512_set1_ps(beta2);
+  const __m512 one_minus_b1 = _mm512_set1_ps(1.0f - beta1);
+  const __m512 one_minus_b2 = _mm512_set1_ps(1.0f - beta2);
+  const __m512 eps_v = _mm512_set1_ps(epsilon);
+  size_t idx = 0;
+  for(; idx + 16 <= dim; idx += 16) {
+    __m512 g = _mm512_loadu_ps(grad + idx);
+    __m512 m = _mm512_fmadd_ps(b1, _mm512_loadu_ps(moment1 + idx), _mm512_mul_ps(one_minus_b1, g));
+    __m512 v = _mm512_fmadd_ps(b2, _mm512_loadu_ps(moment2 + idx),
+                               _mm512_mul_ps(one_minus_b2, _mm512_mul_ps(g, g)));
+    _mm512_storeu_ps(moment1 + idx, m);
+    _mm512_storeu_ps(moment2 + idx, v);
+    __m512 step = _mm512_div_ps(_mm512_mul_ps(lr_v, m), _mm512_add_ps(SqrtAvx512(v), eps_v));
+    _mm512_storeu_ps(weights + idx, _mm512_sub_ps(_mm512_loadu_ps(weights + idx), step));
+  }
+  AdamScalar(weights + idx, moment1 + idx, moment2 + idx, grad + idx, dim - idx, lr, beta1, beta2,
+             epsilon);
+}
+
+#endif
+
+}  // namespace kernels
+
+/// The widest kernels this CPU supports, chosen once per process.
+struct OptimizerKernels {
+  SgdKernel sgd;
+  AdagradKernel adagrad;
+  AdamKernel adam;
+
+  static const OptimizerKernels& Get() {
+    static const OptimizerKernels instance = Select();
+    return instance;
+  }
+
+ private:
+  static OptimizerKernels Select() {
+#ifdef MLKV_X86_DISPATCH
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f")) {
+      return { kernels::SgdAvx512, kernels::AdagradAvx512, kernels::AdamAvx512 };
+    }
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+      return { kernels::SgdAvx2, kernels::AdagradAvx2, kernels::AdamAvx2 };
+    }
+#endif
+    return { kernels::SgdScalar, kernels::AdagradScalar, kernels::AdamScalar };
+  }
+};
+
+/// Applies one update step to "dim" weights, with the optimizer's state slots at "state".
+inline void ApplyOptimizer(const OptimizerConfig& config, float* weights, float* state,
+                           const float* grad, size_t dim) {
+  const OptimizerKernels& kernels = OptimizerKernels::Get();
+  switch(config.optimizer) {
+  case Optimizer::Sgd:
+    kernels.sgd(weights, grad, dim, config.learning_rate);
+    break;
+  case Optimizer::Adagrad:
+    kernels.adagrad(weights, state, grad, dim, config.learning_rate, config.epsilon);
+    break;
+  case Optimizer::Adam: {
+    // Fold the bias correction into the learning rate once per row, not once per element.
+    double step = static_cast<double>(config.step < 1 ? 1 : config.step);
+    double correction1 = 1.0 - std::pow(static_cast<double>(config.beta1), step);
+    double correction2 = 1.0 - std::pow(static_cast<double>(config.beta2), step);
+    float lr = static_cast<float>(config.learning_rate * std::sqrt(correction2) / correction1);
+    kernels.adam(weights, state, state + dim, grad, dim, lr, config.beta1, config.beta2,
+                 config.epsilon);
+    break;
+  }
+  }
+}
+
+/// Applies one update step to a row of "dim" weights, followed by the optimizer's state slots.
+inline void ApplyOptimizer(const OptimizerConfig& config, float* row, const float* grad,
+                           size_t dim) {
+  ApplyOptimizer(config, row, row + dim, grad, dim);
+}
+
+}  // namespace mlkv
@@ -0,0 +1,364 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+// Storage formats for the weights of MLKV rows: the API always deals in float32, while the log
+// may hold fp16, bf16, or int8 with a per-row scale. Encode/decode kernels use runtime CPU
+// dispatch.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MLKV_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace mlkv {
+
+enum class Format : uint8_t {
+  Fp32,
+  Fp16,
+  Bf16,
+  Int8
+};
+
+/// Bytes that "dim" weights take in the log, rounded up to a whole float so that anything
+/// stored after them (e.g., optimizer state) stays aligned. Int8 rows start with their scale.
+inline size_t StoredLength(Format format, size_t dim) {
+  size_t bytes;
+  switch(format) {
+  case Format::Fp16:
+  case Format::Bf16:
+    bytes = 2 * dim;
+    break;
+  case Format::Int8:
+    bytes = sizeof(float) + dim;
+    break;
+  default:
+    bytes = sizeof(float) * dim;
+    break;
+  }
+  return (bytes + sizeof(float) - 1) / sizeof(float) * sizeof(float);
+}
+
+/// Inverse of StoredLength(), for rows that may be shorter than the caller expects.
+inline size_t StoredDim(Format format, size_t stored_length) {
+  switch(format) {
+  case Format::Fp16:
+  case Format::Bf16:
+    return stored_length / 2;
+  case Format::Int8:
+    return stored_length < sizeof(float) ? 0 : stored_length - sizeof(float);
+  default:
+    return stored_length / sizeof(float);
+  }
+}
+
+typedef void(*EncodeKernel)(const float* weights, size_t dim, uint8_t* stored);
+typedef void(*DecodeKernel)(const uint8_t* stored, size_t dim, float* weights);
+
+namespace kernels {
+
+inline uint32_t FloatBits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+inline float BitsFloat(uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/// IEEE half precision, rounding to nearest even.
+inline uint16_t FloatToHalf(float value) {
+  uint32_t bits = FloatBits(value);
+  uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  uint32_t abs = bits & 0x7FFFFFFF;
+  if(abs >= 0x7F800000) {
+    // Inf or NaN.
+    return sign | 0x7C00 | (abs > 0x7F800000 ? 0x200 : 0);
+  }
+  if(abs >= 0x477FF000) {
+    // Rounds to >= 65520: overflow to Inf.
+    return sign | 0x7C00;
+  }
+  if(abs < 0x38800000) {
+    // Subnormal half (or zero): add 0.5 so the FPU does the rounding.
+    float shifted = BitsFloat(abs) + 0.5f;
+    return sign | static_cast<uint16_t>(FloatBits(shifted) - FloatBits(0.5f));
+  }
+  uint32_t mantissa_odd = (abs >> 13) & 1;
+  abs += 0xC8000FFF + mantissa_odd;  // Rebias the exponent, and round.
+  return sign | static_cast<uint16_t>(abs >> 13);
+}
+inline float HalfToFloat(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  uint32_t exponent = (half >> 10) & 0x1F;
+  uint32_t mantissa = half & 0x3FF;
+  if(exponent == 0x1F) {
+    return BitsFloat(sign | 0x7F800000 | (mantissa << 13));
+  }
+  if(exponent == 0) {
+    // Zero or subnormal: mantissa * 2^-24.
+    float magnitude = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+    return BitsFloat(sign | FloatBits(magnitude));
+  }
+  return BitsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+/// Brain float: the upper half of a float32, rounding to nearest even.
+inline uint16_t FloatToBfloat(float value) {
+  uint32_t bits = FloatBits(value);
+  if((bits & 0x7FFFFFFF) > 0x7F800000) {
+    // Keep NaNs NaN.
+    return static_cast<uint16_t>((bits >> 16) | 0x40);
+  }
+  bits += 0x7FFF + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+inline float BfloatToFloat(uint16_t bfloat) {
+  return BitsFloat(static_cast<uint32_t>(bfloat) << 16);
+}
+
+inline void EncodeFp16Scalar(const float* weights, size_t dim, uint8_t* stored) {
+  uint16_t* halves = reinterpret_cast<uint16_t*>(stored);
+  for(size_t idx = 0; idx < dim; ++idx) {
+    halves[idx] = FloatToHalf(weights[idx]);
+  }
+}
+inline void DecodeFp16Scalar(const uint8_t* stored, size_t dim, float* weights) {
+  const uint16_t* halves = reinterpret_cast<const uint16_t*>(stored);
+  for(size_t idx = 0; idx < dim; ++idx) {
+    weights[idx] = HalfToFloat(halves[idx]);
+  }
+}
+
+inline void EncodeBf16Scalar(const float* weights, size_t dim, uint8_t* stored) {
+  uint16_t* bfloats = reinterpret_cast<uint16_t*>(stored);
+  for(size_t idx = 0; idx < dim; ++idx) {
+    bfloats[idx] = FloatToBfloat(weights[idx]);
+  }
+}
+inline void DecodeBf16Scalar(const uint8_t* stored, size_t dim, float* weights) {
+  const uint16_t* bfloats = reinterpret_cast<const uint16_t*>(stored);
+  for(size_t idx = 0; idx < dim; ++idx) {
+    weights[idx] = BfloatToFloat(bfloats[idx]);
+  }
+}
+
+/// Symmetric int8: the row's largest magnitude maps to 127.
+inline float Int8Scale(const float* weights, size_t dim) {
+  float max_abs = 0.0f;
+  for(size_t idx = 0; idx < dim; ++idx) {
+    max_abs = std::max(max_abs, std::fabs(weights[idx]));
+  }
+  return max_abs / 127.0f;
+}
+inline void EncodeInt8Tail(const float* weights, size_t dim, float inv_scale, int8_t* codes) {
+  for(size_t idx = 0; idx < dim; ++idx) {
+    codes[idx] = static_cast<int8_t>(std::nearbyint(weights[idx] * inv_scale));
+  }
+}
+inline void DecodeInt8Tail(const int8_t* codes, size_t dim, float scale, float* weights) {
+  for(size_t idx = 0; idx < dim; ++idx) {
+    weights[idx] = scale * codes[idx];
+  }
+}
+inline void EncodeInt8Scalar(const float* weights, size_t dim, uint8_t* stored) {
+  float scale = Int8Scale(weights, dim);
+  std::memcpy(stored, &scale, sizeof(scale));
+  EncodeInt8Tail(weights, dim, scale == 0.0f ? 0.0f : 1.0f / scale,
+                 reinterpret_cast<int8_t*>(stored + sizeof(scale)));
+}
+inline void DecodeInt8Scalar(const uint8_t* stored, size_t dim, float* weights) {
+  float scale;
+  std::memcpy(&scale, stored, sizeof(scale));
+  DecodeInt8Tail(reinterpret_cast<const int8_t*>(stored + sizeof(scale)), dim, scale, weights);
+}
+
+#ifdef MLKV_X86_DISPATCH
+
+__attribute__((target("avx2,f16c")))
+inline void EncodeFp16Avx2(const float* weights, size_t dim, uint8_t* stored) {
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(weights + idx), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(stored + 2 * idx), halves);
+  }
+  EncodeFp16Scalar(weights + idx, dim - idx, stored + 2 * idx);
+}
+
+__attribute__((target("avx2,f16c")))
+inline void DecodeFp16Avx2(const uint8_t* stored, size_t dim, float* weights) {
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    __m128i halves = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stored + 2 * idx));
+    _mm256_storeu_ps(weights + idx, _mm256_cvtph_ps(halves));
+  }
+  DecodeFp16Scalar(stored + 2 * idx, dim - idx, weights + idx);
+}
+
+__attribute__((target("avx2")))
+inline __m128i FloatToBfloatAvx2(__m256 values) {
+  __m256i bits = _mm256_castps_si256(values);
+  __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1));
+  __m256i rounded = _mm256_add_epi32(bits, _mm256_add_epi32(lsb, _mm256_set1_epi32(0x7FFF)));
+  // NaNs keep their upper half, made quiet.
+  __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(values, values, _CMP_UNORD_Q));
+  __m256i quiet = _mm256_or_si256(bits, _mm256_set1_epi32(0x400000));
+  rounded = _mm256_blendv_epi8(rounded, quiet, nan);
+  __m256i upper = _mm256_srli_epi32(rounded, 16);
+  // Pack the 8 x 32-bit lanes down to 8 x 16 bits.
+  __m256i packed = _mm256_packus_epi32(upper, upper);
+  packed = _mm256_permute4x64_epi64(packed, 0x08);
+  return _mm256_castsi256_si128(packed);
+}
+
+__attribute__((target("avx2")))
+inline void EncodeBf16Avx2(const float* weights, size_t dim, uint8_t* stored) {
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(stored + 2 * idx),
+                     FloatToBfloatAvx2(_mm256_loadu_ps(weights + idx)));
+  }
+  EncodeBf16Scalar(weights + idx, dim - idx, stored + 2 * idx);
+}
+
+__attribute__((target("avx2")))
+inline void DecodeBf16Avx2(const uint8_t* stored, size_t dim, float* weights) {
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    __m128i bfloats = _mm_loadu_si128(reinterpret_cast<const __m128i*>(stored + 2 * idx));
+    __m256i bits = _mm256_slli_epi32(_mm256_cvtepu16_epi32(bfloats), 16);
+    _mm256_storeu_ps(weights + idx, _mm256_castsi256_ps(bits));
+  }
+  DecodeBf16Scalar(stored + 2 * idx, dim - idx, weights + idx);
+}
+
+__attribute__((target("avx2")))
+inline void EncodeInt8Avx2(const float* weights, size_t dim, uint8_t* stored) {
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+  __m256 max_abs = _mm256_setzero_ps();
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    max_abs = _mm256_max_ps(max_abs, _mm256_and_ps(_mm256_loadu_ps(weights + idx), abs_mask));
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, max_abs);
+  float scale = std::max(*std::max_element(lanes, lanes + 8), Int8Scale(weights + idx, dim - idx) * 127.0f);
+  scale /= 127.0f;
+  std::memcpy(stored, &scale, sizeof(scale));
+
+  float inv_scale = scale == 0.0f ? 0.0f : 1.0f / scale;
+  const __m256 inv = _mm256_set1_ps(inv_scale);
+  const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+  int8_t* codes = reinterpret_cast<int8_t*>(stored + sizeof(scale));
+  idx = 0;
+  for(; idx + 32 <= dim; idx += 32) {
+    // Round to nearest even, then saturate down to 8 bits; the packs interleave 128-bit lanes,
+    // which the final permute undoes.
+    __m256i a = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(weights + idx), inv));
+    __m256i b = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(weights + idx + 8), inv));
+    __m256i c = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(weights + idx + 16), inv));
+    __m256i d = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_loadu_ps(weights + idx + 24), inv));
+    __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(a, b), _mm256_packs_epi32(c, d));
+    packed = _mm256_permutevar8x32_epi32(packed, order);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(codes + idx), packed);
+  }
+  EncodeInt8Tail(weights + idx, dim - idx, inv_scale, codes + idx);
+}
+
+__attribute__((target("avx2")))
+inline void DecodeInt8Avx2(const uint8_t* stored, size_t dim, float* weights) {
+  float scale;
+  std::memcpy(&scale, stored, sizeof(scale));
+  const __m256 scale_v = _mm256_set1_ps(scale);
+  const int8_t* codes = reinterpret_cast<const int8_t*>(stored + sizeof(scale));
+  size_t idx = 0;
+  for(; idx + 8 <= dim; idx += 8) {
+    __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(codes + idx));
+    __m256 values = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(bytes));
+    _mm256_storeu_ps(weights + idx, _mm256_mul_ps(values, scale_v));
+  }
+  DecodeInt8Tail(codes + idx, dim - idx, scale, weights + idx);
+}
+
+#endif
+
+}  // namespace kernels
+
+/// The widest kernels this CPU supports, chosen once per process.
+struct QuantizeKernels {
+  EncodeKernel encode_fp16;
+  DecodeKernel decode_fp16;
+  EncodeKernel encode_bf16;
+  DecodeKernel decode_bf16;
+  EncodeKernel encode_int8;
+  DecodeKernel decode_int8;
+
+  static const QuantizeKernels& Get() {
+    static const QuantizeKernels instance = Select();
+    return instance;
+  }
+
+ private:
+  static QuantizeKernels Select() {
+#ifdef MLKV_X86_DISPATCH
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+      return { kernels::EncodeFp16Avx2, kernels::DecodeFp16Avx2,
+               kernels::EncodeBf16Avx2, kernels::DecodeBf16Avx2,
+               kernels::EncodeInt8Avx2, kernels::DecodeInt8Avx2 };
+    }
+#endif
+    return { kernels::EncodeFp16Scalar, kernels::DecodeFp16Scalar,
+             kernels::EncodeBf16Scalar, kernels::DecodeBf16Scalar,
+             kernels::EncodeInt8Scalar, kernels::DecodeInt8Scalar };
+  }
+};
+
+/// Writes "dim" float32 weights to "stored", in StoredLength(format, dim) bytes.
+inline void Encode(Format format, const float* weights, size_t dim, uint8_t* stored) {
+  const QuantizeKernels& kernels = QuantizeKernels::Get();
+  switch(format) {
+  case Format::Fp16:
+    kernels.encode_fp16(weights, dim, stored);
+    break;
+  case Format::Bf16:
+    kernels.encode_bf16(weights, dim, stored);
+    break;
+  case Format::Int8:
+    kernels.encode_int8(weights, dim, stored);
+    break;
+  default:
+    std::memmove(stored, weights, sizeof(float) * dim);
+    break;
+  }
+}
+
+/// Reads "dim" float32 weights back from "stored".
+inline void Decode(Format format, const uint8_t* stored, size_t dim, float* weights) {
+  const QuantizeKernels& kernels = QuantizeKernels::Get();
+  switch(format) {
+  case Format::Fp16:
+    kernels.decode_fp16(stored, dim, weights);
+    break;
+  case Format::Bf16:
+    kernels.decode_bf16(stored, dim, weights);
+    break;
+  case Format::Int8:
+    kernels.decode_int8(stored, dim, weights);
+    break;
+  default:
+    std::memmove(weights, stored, sizeof(float) * dim);
+    break;
+  }
+}
+
+}  // namespace mlkv
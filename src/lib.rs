@@ -14,6 +14,56 @@ pub struct FasterKv {
 }
 
 impl FasterKv {
+    // Stores row weights as ffi::mlkv_storage_format_* (f16, bf16, or i8 with a per-row scale); reads and writes stay f32. Returns false for an unknown format
+    pub fn mlkv_set_storage_format(&self, format: u8) -> bool {
+        unsafe { ffi::mlkv_set_storage_format(self.faster_t, format) }
+    }
+
+    // Co-locates num_slots optimizer-state vectors with the weights of every MLKV row
+    pub fn mlkv_set_state_slots(&self, num_slots: u32) -> () {
+        unsafe { ffi::mlkv_set_state_slots(self.faster_t, num_slots) }
+    }
+
+    // Expected row length in bytes, so that a row on disk is fetched with a single I/O
+    pub fn mlkv_set_value_length_hint(&self, value_length: u64) -> () {
+        unsafe { ffi::mlkv_set_value_length_hint(self.faster_t, value_length) }
+    }
+
+    // Rows that MLKV operations find missing are created with this initializer (ffi::mlkv_init_kind_*), seeded per key
+    pub fn mlkv_set_initializer(&self, kind: u8, param1: f32, param2: f32, seed: u64) -> () {
+        unsafe { ffi::mlkv_set_initializer(self.faster_t, kind, param1, param2, seed) }
+    }
+
+    // Lets a thread that finds a hot row locked by another gradient push leave its update to that thread
+    pub fn mlkv_set_combining(&self, enabled: bool) -> () {
+        unsafe { ffi::mlkv_set_combining(self.faster_t, enabled) }
+    }
+
+    // Keeps up to size bytes (a power of 2) of rows read from disk in memory, so hot evicted rows are read again without I/O
+    pub fn mlkv_set_read_cache(&self, size: u64) -> bool {
+        unsafe { ffi::mlkv_set_read_cache(self.faster_t, size) }
+    }
+
+    // Copies rows whose keys are read at least threshold times back to the tail of the log, tracking reads in a sketch_width-wide count-min sketch
+    pub fn mlkv_set_promotion(&self, sketch_width: u64, threshold: u32) -> bool {
+        unsafe { ffi::mlkv_set_promotion(self.faster_t, sketch_width, threshold) }
+    }
+
+    // Copies the hot rows in the next max_bytes of the read-only region to the tail of the log
+    pub fn mlkv_promote_hot(&self, max_bytes: u64) -> u64 {
+        unsafe { ffi::mlkv_promote_hot(self.faster_t, max_bytes) }
+    }
+
+    // Sums each thread's rmw_batch/sgd updates of up to max_rows rows, pushing them when full, at the staleness bound, or every flush_interval_ms
+    pub fn mlkv_set_write_behind(&self, max_rows: u32, flush_interval_ms: u32) -> () {
+        unsafe { ffi::mlkv_set_write_behind(self.faster_t, max_rows, flush_interval_ms) }
+    }
+
+    // Pushes this thread's write-behind updates to the store; returns the first failed push of them since the last call
+    pub fn mlkv_flush_updates(&self) -> u8 {
+        unsafe { ffi::mlkv_flush_updates(self.faster_t) }
+    }
+
     pub fn upsert(&self, key: u64, value_ptr: *mut u8, value_length: u64) -> u8 {
         unsafe {
             ffi::faster_upsert(
@@ -67,6 +117,38 @@ impl FasterKv {
         }
     }
 
+    // Reads keys.len() rows into value_ptr, value_length bytes apart; per-key results go to statuses
+    pub fn mlkv_read_batch(&self, keys: &[u64], value_ptr: *mut u8, value_length: u64, statuses: &mut [u8]) -> u8 {
+        assert!(statuses.len() >= keys.len());
+        unsafe {
+            ffi::mlkv_read_batch(
+                self.faster_t,
+                keys.as_ptr(),
+                keys.len() as _,
+                value_ptr,
+                value_length,
+                statuses.as_mut_ptr(),
+            )
+        }
+    }
+
+    // Reads a row in place in the log where possible; check validate() after consuming it, and drop it on this thread
+    pub fn mlkv_read_pinned(&self, key: u64, value_length: u64) -> (u8, PinnedRow) {
+        let mut row = PinnedRow {
+            faster: self,
+            row: ffi::mlkv_pinned_row {
+                data: std::ptr::null(),
+                length: 0,
+                address: 0,
+                gen: 0,
+                record: std::ptr::null(),
+                buffer: std::ptr::null_mut(),
+            },
+        };
+        let status = unsafe { ffi::mlkv_read_pinned(self.faster_t, key, value_length, &mut row.row) };
+        (status, row)
+    }
+
     pub fn mlkv_upsert(&self, key: u64, value_ptr: *mut u8, value_length: u64) -> u8 {
         unsafe {
             ffi::mlkv_upsert(
@@ -78,6 +160,93 @@ impl FasterKv {
         }
     }
 
+    // Reads under the given sync mode (ffi::mlkv_sync_mode_*) and bound instead of the store's policy
+    pub fn mlkv_read_ex(&self, key: u64, value_ptr: *mut u8, value_length: u64, mode: u8, bound: i32) -> u8 {
+        let policy = ffi::mlkv_staleness_policy { mode: mode, bound: bound };
+        unsafe {
+            ffi::mlkv_read_ex(
+                self.faster_t,
+                key,
+                value_ptr,
+                value_length,
+                &policy,
+            )
+        }
+    }
+
+    // Duplicate keys in the batch are written once, with the last of their values
+    pub fn mlkv_upsert_batch(&self, keys: &[u64], value_ptr: *mut u8, value_length: u64, statuses: &mut [u8]) -> u8 {
+        assert!(statuses.len() >= keys.len());
+        unsafe {
+            ffi::mlkv_upsert_batch(
+                self.faster_t,
+                keys.as_ptr(),
+                keys.len() as _,
+                value_ptr,
+                value_length,
+                statuses.as_mut_ptr(),
+            )
+        }
+    }
+
+    // Adds f32 increments to the stored rows; duplicate keys in the batch are summed and applied once
+    pub fn mlkv_rmw_batch(&self, keys: &[u64], incr_ptr: *mut u8, value_length: u64, statuses: &mut [u8]) -> u8 {
+        assert!(statuses.len() >= keys.len());
+        unsafe {
+            ffi::mlkv_rmw_batch(
+                self.faster_t,
+                keys.as_ptr(),
+                keys.len() as _,
+                incr_ptr,
+                value_length,
+                statuses.as_mut_ptr(),
+            )
+        }
+    }
+
+    // Optimizer steps on f32 rows: the row holds the weights, then Adagrad's accumulator or Adam's two moments
+    pub fn mlkv_sgd(&self, key: u64, grad_ptr: *mut u8, grad_length: u64, learning_rate: f32) -> u8 {
+        unsafe {
+            ffi::mlkv_sgd(
+                self.faster_t,
+                key,
+                grad_ptr,
+                grad_length,
+                learning_rate,
+            )
+        }
+    }
+
+    pub fn mlkv_adagrad(&self, key: u64, grad_ptr: *mut u8, grad_length: u64, learning_rate: f32, epsilon: f32) -> u8 {
+        unsafe {
+            ffi::mlkv_adagrad(
+                self.faster_t,
+                key,
+                grad_ptr,
+                grad_length,
+                learning_rate,
+                epsilon,
+            )
+        }
+    }
+
+    pub fn mlkv_adam(&self, key: u64, grad_ptr: *mut u8, grad_length: u64, learning_rate: f32,
+                     beta1: f32, beta2: f32, epsilon: f32, step: u64) -> u8 {
+        unsafe {
+            ffi::mlkv_adam(
+                self.faster_t,
+                key,
+                grad_ptr,
+                grad_length,
+                learning_rate,
+                beta1,
+                beta2,
+                epsilon,
+                step,
+            )
+        }
+    }
+
     pub fn mlkv_lookahead(&self, key: u64, value_length: u64) -> u8 {
         unsafe {
             ffi::mlkv_lookahead(
@@ -88,6 +257,89 @@ impl FasterKv {
         }
     }
 
+    // Starts the background prefetch engine; otherwise the first mlkv_lookahead_batch starts it with defaults
+    pub fn mlkv_start_lookahead(&self, num_threads: u32, max_pending: u32) -> bool {
+        unsafe { ffi::mlkv_start_lookahead(self.faster_t, num_threads, max_pending) }
+    }
+
+    // Queues the keys of upcoming minibatches for prefetching and returns their ticket
+    pub fn mlkv_lookahead_batch(&self, keys: &[u64], value_length: u64) -> u64 {
+        unsafe {
+            ffi::mlkv_lookahead_batch(
+                self.faster_t,
+                keys.as_ptr(),
+                keys.len() as _,
+                value_length,
+            )
+        }
+    }
+
+    // Marks a ticket, and all tickets before it, as reached by the trainer, and unpins their rows
+    pub fn mlkv_lookahead_consume(&self, ticket: u64) -> () {
+        unsafe { ffi::mlkv_lookahead_consume(self.faster_t, ticket) }
+    }
+
+    // Consumes a ticket, and all tickets before it, once their training step is done
+    pub fn mlkv_lookahead_release(&self, ticket: u64) -> () {
+        unsafe { ffi::mlkv_lookahead_release(self.faster_t, ticket) }
+    }
+
+    pub fn lookahead_stats(&self) -> ffi::mlkv_lookahead_stats {
+        let mut stats = ffi::mlkv_lookahead_stats { hot: 0, in_time: 0, late: 0, pinned_pages_closed: 0 };
+        unsafe { ffi::mlkv_get_lookahead_stats(self.faster_t, &mut stats) }
+        stats
+    }
+
+    // How often, and for how many nanoseconds in total, reads waited at the staleness bound
+    pub fn staleness_stats(&self) -> ffi::mlkv_staleness_stats {
+        let mut stats = ffi::mlkv_staleness_stats { blocked: 0, blocked_ns: 0, untracked_reads: 0 };
+        unsafe { ffi::mlkv_get_staleness_stats(self.faster_t, &mut stats) }
+        stats
+    }
+
+    // Gradient pushes applied by another thread, and how many lock holders applied any
+    pub fn combining_stats(&self) -> ffi::mlkv_combining_stats {
+        let mut stats = ffi::mlkv_combining_stats { published: 0, combiners: 0 };
+        unsafe { ffi::mlkv_get_combining_stats(self.faster_t, &mut stats) }
+        stats
+    }
+
+    // Reads served by the read cache, rows admitted to it, second chances given, and bytes evicted
+    pub fn read_cache_stats(&self) -> ffi::mlkv_read_cache_stats {
+        let mut stats = ffi::mlkv_read_cache_stats { hits: 0, admissions: 0, second_chances: 0, evicted_bytes: 0 };
+        unsafe { ffi::mlkv_get_read_cache_stats(self.faster_t, &mut stats) }
+        stats
+    }
+
+    // Rows promoted from the read-only region and from disk, rows skipped as cold, and the sketch's accuracy
+    pub fn promotion_stats(&self) -> ffi::mlkv_promotion_stats {
+        let mut stats = ffi::mlkv_promotion_stats {
+            promoted_read_only: 0,
+            promoted_from_disk: 0,
+            skipped_cold: 0,
+            sketch_resets: 0,
+            sampled_keys: 0,
+            mean_overestimate: 0.0,
+        };
+        unsafe { ffi::mlkv_get_promotion_stats(self.faster_t, &mut stats) }
+        stats
+    }
+
+    // The adaptive limit on reads in flight from disk, reads in flight, recent and lowest read latency, recent IOPS, and time spent throttled
+    pub fn io_stats(&self) -> ffi::mlkv_io_stats {
+        let mut stats = ffi::mlkv_io_stats {
+            depth: 0,
+            pending: 0,
+            latency_us: 0.0,
+            min_latency_us: 0.0,
+            iops: 0.0,
+            throttled: 0,
+            throttled_ns: 0,
+        };
+        unsafe { ffi::mlkv_get_io_stats(self.faster_t, &mut stats) }
+        stats
+    }
+
     pub fn start_session(&self) -> () {
         unsafe { ffi::faster_start_session(self.faster_t) }
     }
@@ -132,6 +384,84 @@ impl FasterKv {
         }
     }
 
+    pub fn new_with_policy(table_size_bytes : u64, log_size_bytes : u64, filename : CString, mode : u8, bound : i32) -> Self {
+        let policy = ffi::mlkv_staleness_policy { mode: mode, bound: bound };
+        unsafe {
+            let store = ffi::faster_open_with_policy(table_size_bytes, log_size_bytes, filename.clone().into_raw(), &policy);
+            FasterKv {faster_t : store, filename : filename.into_string().ok()}
+        }
+    }
+
+    // Every record holds a row of exactly row_length bytes (64, 128, 256 or 512), weights and optimizer state included
+    pub fn new_fixed(table_size_bytes : u64, log_size_bytes : u64, filename : CString, row_length : u32) -> Option<Self> {
+        unsafe {
+            let store = ffi::faster_open_fixed(table_size_bytes, log_size_bytes, filename.clone().into_raw(), row_length, std::ptr::null());
+            if store.is_null() {
+                return None;
+            }
+            Some(FasterKv {faster_t : store, filename : filename.into_string().ok()})
+        }
+    }
+
+    pub fn recover_fixed(table_size_bytes : u64, log_size_bytes : u64, filename : CString, checkpoint_token : CString, row_length : u32) -> Self {
+        unsafe {
+            let store = ffi::faster_recover_fixed(table_size_bytes,
+                                                  log_size_bytes,
+                                                  filename.clone().into_raw(),
+                                                  checkpoint_token.clone().into_raw(),
+                                                  row_length);
+            FasterKv {faster_t : store, filename : filename.into_string().ok()}
+        }
+    }
+
+    // Keys are dense IDs in [0, num_keys), each mapped to its own index slot; row_length 0 means variable-length rows
+    pub fn new_dense(num_keys : u64, log_size_bytes : u64, filename : CString, row_length : u32) -> Option<Self> {
+        unsafe {
+            let store = ffi::faster_open_dense(num_keys, log_size_bytes, filename.clone().into_raw(), row_length, std::ptr::null());
+            if store.is_null() {
+                return None;
+            }
+            Some(FasterKv {faster_t : store, filename : filename.into_string().ok()})
+        }
+    }
+
+    pub fn recover_dense(num_keys : u64, log_size_bytes : u64, filename : CString, checkpoint_token : CString, row_length : u32) -> Self {
+        unsafe {
+            let store = ffi::faster_recover_dense(num_keys,
+                                                  log_size_bytes,
+                                                  filename.clone().into_raw(),
+                                                  checkpoint_token.clone().into_raw(),
+                                                  row_length);
+            FasterKv {faster_t : store, filename : filename.into_string().ok()}
+        }
+    }
+
+    // Opens a store on the I/O backend (ffi::faster_io_backend_*) and with the log geometry that options selects; zero fields take the defaults.
+    // On the null backend, operations that would append records fail with OutOfMemory once the log is full
+    pub fn new_ex(table_size_bytes : u64, log_size_bytes : u64, filename : CString, options : &ffi::faster_options) -> Option<Self> {
+        unsafe {
+            let store = ffi::faster_open_ex(table_size_bytes, log_size_bytes, filename.clone().into_raw(), options, std::ptr::null());
+            if store.is_null() {
+                return None;
+            }
+            Some(FasterKv {faster_t : store, filename : filename.into_string().ok()})
+        }
+    }
+
+    pub fn recover_ex(table_size_bytes : u64, log_size_bytes : u64, filename : CString, checkpoint_token : CString, options : &ffi::faster_options) -> Option<Self> {
+        unsafe {
+            let store = ffi::faster_recover_ex(table_size_bytes,
+                                               log_size_bytes,
+                                               filename.clone().into_raw(),
+                                               checkpoint_token.clone().into_raw(),
+                                               options);
+            if store.is_null() {
+                return None;
+            }
+            Some(FasterKv {faster_t : store, filename : filename.into_string().ok()})
+        }
+    }
+
     fn destroy(&self) -> () {
         unsafe {
             ffi::faster_destroy(self.faster_t);
@@ -139,6 +469,55 @@ impl FasterKv {
     }
 }
 
+// A row returned by mlkv_read_pinned(); dropping it unpins the row's page or returns its buffer
+pub struct PinnedRow<'a> {
+    faster: &'a FasterKv,
+    row: ffi::mlkv_pinned_row,
+}
+
+impl<'a> PinnedRow<'a> {
+    // The row's bytes, possibly in place in the log, where writers may update them at any time
+    pub fn as_ptr(&self) -> *const u8 {
+        self.row.data
+    }
+
+    pub fn len(&self) -> usize {
+        if self.row.data.is_null() { 0 } else { self.row.length as usize }
+    }
+
+    // Copies the row into "out" (up to its length), then returns validate(): if false, the copy may be torn
+    pub fn copy_to(&self, out: &mut [u8]) -> bool {
+        // Volatile reads, as for a seqlock: the bytes may change under the copy
+        let len = std::cmp::min(out.len(), self.len());
+        for idx in 0..len {
+            out[idx] = unsafe { std::ptr::read_volatile(self.row.data.add(idx)) };
+        }
+        self.validate()
+    }
+
+    // Safety: a row read in place is log memory that other threads may write while the slice
+    // lives, which Rust references forbid. The caller must ensure that no writer updates the row
+    // meanwhile (e.g., by running no writes to this key concurrently), and should still check
+    // validate() once done with the slice.
+    pub unsafe fn data(&self) -> &[u8] {
+        if self.row.data.is_null() {
+            return &[];
+        }
+        std::slice::from_raw_parts(self.row.data, self.row.length as usize)
+    }
+
+    // False if a writer may have updated the row since it was read
+    pub fn validate(&self) -> bool {
+        unsafe { ffi::mlkv_validate_pinned(self.faster.faster_t, &self.row) }
+    }
+}
+
+impl<'a> Drop for PinnedRow<'a> {
+    fn drop(&mut self) {
+        unsafe { ffi::mlkv_release_pinned(self.faster.faster_t, &mut self.row) }
+    }
+}
+
 // In order to make sure we release the resources the C interface has allocated for the store
 impl Drop for FasterKv {
     fn drop(&mut self) {